@@ -69,6 +69,12 @@ int main(int argc, char* argv[]) {
 #endif
 
 	std::string patchPath;
+	std::string metricsPath;
+	bool benchmarkDraw = false;
+	bool benchmarkPanels = false;
+	bool benchmarkStep = false;
+	bool benchmarkBarrier = false;
+	bool benchmarkPatch = false;
 	bool screenshot = false;
 	float screenshotZoom = 1.f;
 	const std::string appInfo = APP_NAME + " " + APP_EDITION_NAME + " " + APP_VERSION + " " + APP_OS_NAME + " " + APP_CPU_NAME;
@@ -83,6 +89,12 @@ int main(int argc, char* argv[]) {
 		{"user", required_argument, NULL, 'u'},
 		{"version", no_argument, NULL, 'v'},
 		{"help", no_argument, NULL, 256},
+		{"metrics", required_argument, NULL, 257},
+		{"benchmark-patch", no_argument, NULL, 258},
+		{"benchmark-draw", no_argument, NULL, 259},
+		{"benchmark-panels", no_argument, NULL, 260},
+		{"benchmark-step", no_argument, NULL, 261},
+		{"benchmark-barrier", no_argument, NULL, 262},
 		{NULL, 0, NULL, 0}
 	};
 	int c;
@@ -118,6 +130,24 @@ int main(int argc, char* argv[]) {
 				std::fprintf(stderr, "https://vcvrack.com/manual/Installing#Command-line-usage\n");
 				return 0;
 			}
+			case 257: { // --metrics
+				metricsPath = optarg;
+			} break;
+			case 258: { // --benchmark-patch
+				benchmarkPatch = true;
+			} break;
+			case 259: { // --benchmark-draw
+				benchmarkDraw = true;
+			} break;
+			case 260: { // --benchmark-panels
+				benchmarkPanels = true;
+			} break;
+			case 261: { // --benchmark-step
+				benchmarkStep = true;
+			} break;
+			case 262: { // --benchmark-barrier
+				benchmarkBarrier = true;
+			} break;
 			// Mac "app translocation" passes a nonsense -psn_... flag, so -p is reserved.
 			case 'p': break;
 			default: break;
@@ -250,6 +280,11 @@ int main(int argc, char* argv[]) {
 	}
 #endif
 
+	// Benchmarks replace or reload the patch, so they must not overwrite the user's autosave on exit
+	if (benchmarkBarrier || benchmarkPatch || benchmarkDraw || benchmarkPanels || benchmarkStep) {
+		APP->patch->useTemporaryAutosave();
+	}
+
 	// Initialize patch
 	if (logger::wasTruncated() && osdialog_message(OSDIALOG_INFO, OSDIALOG_YES_NO, "VCV Rack crashed during the last session, possibly due to a buggy module in your patch. Clear your patch and start over?")) {
 		// Do nothing, which leaves a blank patch
@@ -261,7 +296,15 @@ int main(int argc, char* argv[]) {
 	APP->engine->startFallbackThread();
 
 	// Run context
-	if (settings::headless) {
+	if (benchmarkBarrier) {
+		INFO("Benchmarking engine thread barriers");
+		engine::Engine::benchmarkBarrier();
+	}
+	else if (benchmarkPatch) {
+		INFO("Benchmarking serialization of patch");
+		APP->patch->benchmarkSerialization();
+	}
+	else if (settings::headless) {
 		printf("Press enter to exit.\n");
 		getchar();
 	}
@@ -269,6 +312,18 @@ int main(int argc, char* argv[]) {
 		INFO("Taking screenshots of all modules at %gx zoom", screenshotZoom);
 		APP->window->screenshotModules(asset::user("screenshots"), screenshotZoom);
 	}
+	else if (benchmarkDraw) {
+		INFO("Benchmarking drawing of patch");
+		APP->window->benchmarkDraw();
+	}
+	else if (benchmarkPanels) {
+		INFO("Benchmarking rendering of module panels");
+		APP->window->benchmarkPanels();
+	}
+	else if (benchmarkStep) {
+		INFO("Benchmarking stepping of a large rack");
+		APP->window->benchmarkStep();
+	}
 	else {
 		INFO("Running window");
 		APP->window->run();
@@ -282,6 +337,21 @@ int main(int argc, char* argv[]) {
 		// APP->window->run();
 	}
 
+	// Dump engine metrics for diagnosing overloads after the fact
+	if (!metricsPath.empty()) {
+		INFO("Saving metrics %s", metricsPath.c_str());
+		json_t* metricsJ = APP->engine->metricsToJson();
+		DEFER({json_decref(metricsJ);});
+		FILE* file = std::fopen(metricsPath.c_str(), "w");
+		if (file) {
+			json_dumpf(metricsJ, file, JSON_INDENT(2));
+			std::fclose(file);
+		}
+		else {
+			WARN("Could not open metrics file %s", metricsPath.c_str());
+		}
+	}
+
 	// Destroy context
 	INFO("Deleting context");
 	delete APP;
@@ -66,11 +66,17 @@ struct CableWidget : widget::Widget {
 	}
 	math::Vec getInputPos();
 	math::Vec getOutputPos();
+	/** Returns the bounding box of the cable curve and its shadow, in RackWidget coordinates, for culling. */
+	PRIVATE math::Rect getDrawBox();
 	void mergeJson(json_t* rootJ);
 	void fromJson(json_t* rootJ);
 	void step() override;
 	void draw(const DrawArgs& args) override;
 	void drawLayer(const DrawArgs& args, int layer) override;
+	/** Draws the shadows of all given cables, batching shadows with the same stroke into one path.
+	Equivalent to drawing each cable's layer -1.
+	*/
+	PRIVATE static void drawShadows(const DrawArgs& args, const std::vector<CableWidget*>& cws);
 	engine::Cable* releaseCable();
 	void onAdd(const AddEvent& e) override;
 	void onRemove(const RemoveEvent& e) override;
@@ -20,5 +20,14 @@ struct LightWidget : widget::TransparentWidget {
 };
 
 
+/** Starts gathering the circles drawn by the default LightWidget::drawLight() and drawHalo() instead of drawing them.
+Overridden drawLight() and drawHalo() methods still draw immediately.
+Use around a layer 1 pass that doesn't scissor or change global alpha, since batched lights ignore them.
+*/
+PRIVATE void beginLightBatch(NVGcontext* vg);
+/** Draws the gathered lights with one fill per distinct color, followed by the halos. */
+PRIVATE void endLightBatch(NVGcontext* vg);
+
+
 } // namespace app
 } // namespace rack
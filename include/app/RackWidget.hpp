@@ -11,6 +11,7 @@
 #include <history.hpp>
 
 #include <set>
+#include <map>
 
 
 namespace rack {
@@ -49,6 +50,28 @@ struct RackWidget : widget::OpaqueWidget {
 	void clear();
 	void mergeJson(json_t* rootJ);
 	void fromJson(json_t* rootJ);
+
+	/** Where a ModuleWidget is placed when a patch is loaded. */
+	struct ModuleLayout {
+		int64_t id;
+		/** Position of the ModuleWidget's box */
+		math::Vec pos;
+	};
+	/** How a CableWidget looks when a patch is loaded. */
+	struct CableLayout {
+		int64_t id;
+		/** Hex color string, or empty to use the next cable color */
+		std::string color;
+		/** Order of the cable's plugs among all plugs, or 0 if unknown */
+		int inputPlugOrder = 0;
+		int outputPlugOrder = 0;
+	};
+	/** Creates ModuleWidgets and CableWidgets for Modules and Cables already added to the Engine.
+	Used by fromJson(), and by binary patches, which store layouts without JSON.
+	*/
+	PRIVATE void fromLayout(const std::vector<ModuleLayout>& moduleLayouts, const std::vector<CableLayout>& cableLayouts);
+	/** Returns the order of each plug in the plug container, starting at 1, as saved in "inputPlugOrder" and "outputPlugOrder". */
+	PRIVATE std::map<widget::Widget*, int> getPlugOrders();
 	/** Pastes module JSON or selection JSON at the mouse position. */
 	void pasteJsonAction(json_t* rootJ);
 	void pasteModuleJsonAction(json_t* moduleJ);
@@ -148,6 +171,15 @@ struct RackWidget : widget::OpaqueWidget {
 	void setTouchedParam(ParamWidget* pw);
 
 	PRIVATE void updateExpanders();
+	/** Removes a module from the ID lookup index. Called by ModuleWidget when deleted, so the index never holds deleted ModuleWidgets. */
+	PRIVATE void unindexModule(ModuleWidget* mw);
+	/** Adds a cable to the ID and port lookup index. Called by CableWidget when added to the cable container. */
+	PRIVATE void indexCable(CableWidget* cw);
+	PRIVATE void unindexCable(CableWidget* cw);
+	/** Rebuilds the cable index before the next lookup. Call after changing a cable's ports or ID, or reordering plugs. */
+	PRIVATE void invalidateCableIndex();
+	/** Sets whether ModuleWidgets outside the viewport are stepped at a reduced rate instead of every frame. Enabled by default. */
+	PRIVATE static void setOffscreenStepThrottling(bool enabled);
 };
 
 
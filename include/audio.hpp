@@ -2,6 +2,7 @@
 #include <vector>
 #include <set>
 #include <mutex>
+#include <atomic>
 
 #include <jansson.h>
 
@@ -76,6 +77,16 @@ struct Device {
 	/** Ensures that ports do not subscribe/unsubscribe while processBuffer() is called. */
 	std::mutex processMutex;
 
+	// Metrics, readable from any thread
+	/** Number of processBuffer() calls since the device was created. */
+	std::atomic<int64_t> blockCount{0};
+	/** Number of processBuffer() calls that took longer than the duration of their block. */
+	std::atomic<int64_t> deadlineMissCount{0};
+	/** Number of input overflows and output underflows reported by the driver. */
+	std::atomic<int64_t> xrunCount{0};
+	/** Longest processBuffer() duration divided by block duration. */
+	std::atomic<float> maxLoad{0.f};
+
 	virtual ~Device() {}
 
 	virtual std::string getName() {
@@ -129,6 +140,8 @@ struct Device {
 	Overwrites all `output`, so it is unnecessary to initialize.
 	*/
 	void processBuffer(const float* input, int inputStride, float* output, int outputStride, int frames);
+	/** Called by driver code when the driver reports an input overflow or output underflow. */
+	void onXrun();
 	/** Called by driver code when stream starts. */
 	void onStartStream();
 	/** Called by driver code when stream stops. */
@@ -218,6 +231,9 @@ Driver ID is stored in patches and must be unique. -1 is reserved.
 void addDriver(int driverId, Driver* driver);
 std::vector<int> getDriverIds();
 Driver* getDriver(int driverId);
+/** Serializes the metrics of all Devices with at least one subscribed Port.
+*/
+json_t* devicesMetricsToJson();
 
 
 } // namespace audio
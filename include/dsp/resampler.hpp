@@ -19,6 +19,10 @@ struct SampleRateConverter {
 	int quality = SPEEX_RESAMPLER_QUALITY_DEFAULT;
 	int inRate = 44100;
 	int outRate = 44100;
+	/** Multiplies the conversion ratio `inRate / outRate`. */
+	double ratioCorrection = 1.0;
+	/** Accumulated fractional frames of ratio correction when `inRate == outRate`, applied by dropping or repeating a frame. */
+	double slipPhase = 0.0;
 
 	SampleRateConverter() {
 		refreshState();
@@ -54,16 +58,43 @@ struct SampleRateConverter {
 		refreshState();
 	}
 
+	/** Slightly adjusts the conversion ratio without resetting the resampler state.
+	Values greater than 1 consume more input frames per output frame.
+	Useful for compensating clock drift between two unsynchronized devices.
+	Each change recomputes the resampler's filter, so avoid calling this with a new value every block.
+	If `inRate == outRate`, no resampler is created, and the correction is applied by occasionally dropping or repeating a frame.
+	*/
+	void setRatioCorrection(double ratioCorrection) {
+		if (ratioCorrection == this->ratioCorrection)
+			return;
+		this->ratioCorrection = ratioCorrection;
+		if (ratioCorrection == 1.0)
+			slipPhase = 0.0;
+		if (st)
+			applyRatio();
+	}
+
+	void applyRatio() {
+		// Scale rates so the ratio has sub-ppm resolution while fitting in spx_uint32_t.
+		const double scale = 1000.0;
+		spx_uint32_t num = std::round(inRate * scale * ratioCorrection);
+		spx_uint32_t den = std::round(outRate * scale);
+		speex_resampler_set_rate_frac(st, num, den, inRate, outRate);
+	}
+
 	void refreshState() {
 		if (st) {
 			speex_resampler_destroy(st);
 			st = NULL;
 		}
 
+		slipPhase = 0.0;
 		if (channels > 0 && inRate != outRate) {
 			int err;
 			st = speex_resampler_init(channels, inRate, outRate, quality, &err);
 			(void) err;
+			if (ratioCorrection != 1.0)
+				applyRatio();
 		}
 	}
 
@@ -88,7 +119,7 @@ struct SampleRateConverter {
 			*inFrames = inLen;
 			*outFrames = outLen;
 		}
-		else {
+		else if (ratioCorrection == 1.0) {
 			// Simply copy the buffer without conversion
 			int frames = std::min(*inFrames, *outFrames);
 			for (int i = 0; i < frames; i++) {
@@ -99,6 +130,31 @@ struct SampleRateConverter {
 			*inFrames = frames;
 			*outFrames = frames;
 		}
+		else {
+			// Copy the buffer, dropping an input frame or repeating the previous one whenever the correction accumulates to a whole frame.
+			// At ppm-scale corrections this happens about once per second, which is far cheaper than resampling every frame.
+			int i = 0;
+			int o = 0;
+			while (i < *inFrames && o < *outFrames) {
+				slipPhase += ratioCorrection - 1.0;
+				if (slipPhase >= 1.0) {
+					slipPhase -= 1.0;
+					i++;
+					if (i >= *inFrames)
+						break;
+				}
+				for (int c = 0; c < channels; c++) {
+					out[outStride * o + c] = in[inStride * i + c];
+				}
+				o++;
+				if (slipPhase <= -1.0)
+					slipPhase += 1.0;
+				else
+					i++;
+			}
+			*inFrames = i;
+			*outFrames = o;
+		}
 	}
 
 	void process(const Frame<MAX_CHANNELS>* in, int* inFrames, Frame<MAX_CHANNELS>* out, int* outFrames) {
@@ -5,6 +5,7 @@
 #include <engine/Module.hpp>
 #include <engine/Cable.hpp>
 #include <engine/ParamHandle.hpp>
+#include <engine/Metrics.hpp>
 
 
 namespace rack {
@@ -23,6 +24,8 @@ struct Engine {
 	struct Internal;
 	Internal* internal;
 
+	/** Worker threads use the Context that is current when the Engine is constructed, so create a Context per Engine and set it with contextSet() first.
+	*/
 	PRIVATE Engine();
 	PRIVATE ~Engine();
 
@@ -59,6 +62,51 @@ struct Engine {
 	/** Returns the inverse of the current sample rate.
 	*/
 	float getSampleTime();
+	/** Thread pool settings of an Engine.
+	Each Engine owns its worker threads, so multiple Engines can run in one process, e.g. for rendering many patches headlessly.
+	*/
+	struct ThreadConfig {
+		/** Number of threads including the thread calling stepBlock(). */
+		int threadCount = 1;
+		/** Logical CPUs to pin worker threads to, round-robin. Empty to not pin. */
+		std::vector<int> cpus;
+		/** Real-time priority of worker threads. 0 to not change. */
+		int priority = 0;
+	};
+	/** Returns the thread settings that the next stepBlock() call will launch workers with.
+	*/
+	ThreadConfig getThreadConfig();
+	/** Overrides `settings::threadCount`, `settings::threadCpus`, and `settings::threadPriority` for this Engine.
+	Workers are relaunched on the next stepBlock() call.
+	Hosts running several Engines should give each a disjoint set of CPUs.
+	*/
+	void setThreadConfig(const ThreadConfig& config);
+	/** Reverts to following the global thread settings.
+	Also rereads `settings::threadCpus` and `settings::threadPriority`, which are otherwise only read when the Engine is created.
+	*/
+	void clearThreadConfig();
+	/** Scheduling of an engine thread, as reported by the OS after applying the thread settings.
+	*/
+	struct ThreadInfo {
+		/** 0 for the thread calling stepBlock(), 1 and above for worker threads. */
+		int threadId = 0;
+		/** Logical CPUs the thread is allowed to run on. Empty if unknown. */
+		std::vector<int> cpus;
+		/** Scheduling policy and priority, e.g. "SCHED_FIFO 80". */
+		std::string scheduling;
+		/** Whether the requested CPU affinity was applied. */
+		bool affinityApplied = false;
+		/** Whether the requested real-time priority was applied. */
+		bool priorityApplied = false;
+	};
+	/** Returns scheduling info of each engine thread.
+	Only worker threads are pinned and prioritized. The info of thread 0 is for reference.
+	*/
+	std::vector<ThreadInfo> getThreadInfos();
+	/** Logs the scheduling of threads launched since the last call.
+	Threads don't log it themselves, since one of them is the audio thread. Called by the UI each frame.
+	*/
+	PRIVATE void logThreadInfos();
 	/** Causes worker threads to block on a mutex instead of spinlock.
 	Call this in your Module::stepBlock() method to hint that the operation will take more than ~0.1 ms.
 	*/
@@ -87,6 +135,29 @@ struct Engine {
 	double getMeterAverage();
 	double getMeterMax();
 
+	// Metrics
+	/** Returns the histogram of stepBlock() durations.
+	Lock-free.
+	*/
+	DurationHistogram* getBlockDurationHistogram();
+	/** Returns the histogram of time that a thread spends waiting for other threads at the end of sampled frames.
+	Thread 0 is the thread calling stepBlock(), and the rest are worker threads.
+	Returns NULL if `threadId` is out of range.
+	Lock-free.
+	*/
+	DurationHistogram* getBarrierWaitHistogram(int threadId);
+	/** Returns the number of stepBlock() calls that took longer than the duration of their block.
+	*/
+	int64_t getDeadlineMissCount();
+	/** Resets all engine and module metrics.
+	Share-locks.
+	*/
+	void resetMetrics();
+	/** Serializes engine, module, and audio device metrics.
+	Share-locks.
+	*/
+	json_t* metricsToJson();
+
 	// Modules
 	size_t getNumModules();
 	/** Fills `moduleIds` with up to `len` module IDs in the rack.
@@ -229,10 +300,22 @@ struct Engine {
 	Exclusively locks.
 	*/
 	void fromJson(json_t* rootJ);
+	/** Clears the Engine, then creates and deserializes the Modules of a patch without adding them to the Engine.
+	Since Modules are not added yet, their onAdd() is not called and their patch storage need not exist yet.
+	*/
+	PRIVATE std::vector<Module*> modulesFromJson(json_t* rootJ);
+	/** Adds Modules returned by modulesFromJson(), and deserializes cables and the master module.
+	Exclusively locks.
+	*/
+	PRIVATE void fromJson(json_t* rootJ, const std::vector<Module*>& modules);
 
 	/** If no master module is set, the fallback Engine thread will step blocks, using the CPU clock for timing.
 	*/
 	PRIVATE void startFallbackThread();
+	/** Logs the per-frame latency, throughput, and total CPU usage of the engine thread barriers for 1 to `maxThreads` threads, or the number of logical cores if 0.
+	Frames contain no modules, so only synchronization is measured.
+	*/
+	PRIVATE static void benchmarkBarrier(int maxThreads = 0, int blocks = 400);
 };
 
 
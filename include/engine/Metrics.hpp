@@ -0,0 +1,39 @@
+#pragma once
+#include <atomic>
+
+#include <jansson.h>
+
+#include <common.hpp>
+
+
+namespace rack {
+namespace engine {
+
+
+/** Histogram of durations with half-octave bins, starting at 100 ns.
+
+Lock-free: any thread can add() while other threads read.
+Reads taken while another thread is writing may be off by a few counts.
+*/
+struct DurationHistogram {
+	static constexpr int BINS = 48;
+
+	std::atomic<uint64_t> counts[BINS];
+
+	DurationHistogram();
+	void reset();
+	/** Adds a duration in seconds. */
+	void add(double duration);
+	uint64_t getCount();
+	/** Returns the upper edge in seconds of the bin containing the given quantile in [0, 1].
+	Returns 0 if the histogram is empty.
+	*/
+	double getQuantile(double quantile);
+	/** Returns the upper edge in seconds of the given bin. */
+	static double getBinEdge(int bin);
+	json_t* toJson();
+};
+
+
+} // namespace engine
+} // namespace rack
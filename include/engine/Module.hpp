@@ -25,6 +25,9 @@ struct Model;
 namespace engine {
 
 
+struct DurationHistogram;
+
+
 /** DSP processor instance for your module. */
 struct Module {
 	struct Internal;
@@ -255,6 +258,8 @@ struct Module {
 
 	Patch storage files of deleted modules are garbage collected when user saves the patch.
 	To allow the Undo feature to restore patch storage if the module is accidentally deleted, it is recommended to not delete patch storage in onRemove().
+
+	Large files that clones of the module can share, such as samples, can be stored with `APP->patch->addBlob()` instead, listing their hashes in the "blobs" array of dataToJson().
 	*/
 	std::string createPatchStorageDirectory();
 	std::string getPatchStorageDirectory();
@@ -467,7 +472,21 @@ struct Module {
 	PRIVATE const float* meterBuffer();
 	PRIVATE int meterLength();
 	PRIVATE int meterIndex();
+	/** Histogram of sampled process() durations, recorded while the CPU meter is enabled. */
+	PRIVATE DurationHistogram* getProcessHistogram();
 	PRIVATE void doProcess(const ProcessArgs& args);
+	/** Copies light brightnesses and peak plug light levels to a snapshot for the UI, if the UI has acquired the previous one.
+	Called by the engine after each block.
+	*/
+	PRIVATE void publishSnapshot();
+	/** Acquires the latest snapshot published by the engine and smooths its plug light peaks into each Port's `plugLights`.
+	Called by the UI once per frame before reading the snapshot.
+	*/
+	PRIVATE void updateSnapshot();
+	/** Returns the light's brightness in the acquired snapshot, or 0 if none has been published. */
+	PRIVATE float getSnapshotLightBrightness(int lightId);
+	/** Returns the plug light brightness of a port, smoothed by the UI. */
+	PRIVATE float getPlugLightBrightness(Port::Type type, int portId, int colorId);
 	PRIVATE static void jsonStripIds(json_t* rootJ);
 	/** Sets module of expander and dispatches ExpanderChangeEvent if changed. */
 	PRIVATE void setExpanderModule(Module* module, uint8_t side);
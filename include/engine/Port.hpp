@@ -31,6 +31,7 @@ struct Port {
 	};
 	/** For rendering plug lights on cables.
 	Green for positive, red for negative, and blue for polyphonic.
+	Smoothed by the UI thread each frame from the peak levels published by the engine.
 	*/
 	Light plugLights[3];
 
@@ -192,6 +192,12 @@ struct State {
 	std::string getRedoName();
 	void setSaved();
 	bool isSaved();
+	/** Returns an ID of the current patch state, which stays valid while undoing and redoing. */
+	PRIVATE uint64_t getStateId();
+	/** Marks the state with the given ID as saved, if it is still reachable by undo and redo.
+	Used to mark a patch saved when a background save of an earlier state completes.
+	*/
+	PRIVATE void setSavedStateId(uint64_t stateId);
 };
 
 
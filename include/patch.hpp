@@ -1,10 +1,26 @@
 #pragma once
+#include <vector>
+#include <functional>
+#include <memory>
+
 #include <jansson.h>
 
 #include <common.hpp>
 
 
 namespace rack {
+
+
+namespace engine {
+struct Module;
+} // namespace engine
+
+
+namespace system {
+struct MappedFile;
+} // namespace system
+
+
 /** Handles the Rack patch file state */
 namespace patch {
 
@@ -26,18 +42,58 @@ struct Manager {
 	PRIVATE Manager();
 	PRIVATE ~Manager();
 	PRIVATE void launch(std::string pathArg);
+	/** Copies the autosave dir to a temporary dir, and autosaves there instead until it is deleted on exit.
+	Used by benchmarks, which replace or reload the patch, so the user's autosave is never overwritten.
+	*/
+	PRIVATE void useTemporaryAutosave();
 	/** Clears the patch. */
 	void clear();
-	/** Saves the patch and nothing else. */
+	/** Saves the patch and nothing else.
+	The patch is snapshotted immediately, but patch.json and the archive are written on a background thread.
+	If an archive is still being written, the snapshot is taken when it finishes instead, and repeated saves to the same path are combined.
+	Use waitForSaves() to block until the file is written.
+	*/
 	void save(std::string path);
+	/** Blocks until all saves and autosaves queued on the background thread are written. */
+	void waitForSaves();
+	/** Starts deferred saves and marks the patch saved when a save completes.
+	Called by Scene each frame.
+	*/
+	PRIVATE void step();
+	/** Shows a dialog for each background save that failed since the last call.
+	Called by Window each frame after polling events, where event handlers open their dialogs, rather than while the Scene is stepped.
+	*/
+	PRIVATE void showSaveErrors();
 	void saveDialog();
 	void saveAsDialog(bool setPath = true);
 	void saveTemplateDialog();
 	void saveAutosave();
+	/** Snapshots the patch and writes patch.json on a background thread.
+	If an autosave is already waiting to be written, it is replaced by this newer one.
+	*/
+	void saveAutosaveAsync();
 	/** Delete and re-create autosave dir. */
 	void clearAutosave();
 	/** Clean up nonexistent module patch storage dirs in autosave dir. */
 	void cleanAutosave();
+	/** Adds a file to the patch's content-addressed blob store.
+	Instead of copying large files such as samples into their patch storage directory, modules can list blob hashes in a "blobs" array of strings in dataToJson(), so cloned and pasted modules share the blob and each blob is archived once per patch.
+	Blobs are also kept in the user's blob cache, so modules pasted from another patch can find them.
+	The file is hashed and copied on the patch save thread. `action` is then called on the UI thread with its hash, or "" if the file can't be read, unless `module` was removed in the meantime.
+	*/
+	void addBlob(engine::Module* module, const std::string& filePath, std::function<void(const std::string& hash)> action);
+	/** Adds data to the blob store and returns its hash.
+	Throws Exception if the blob can't be written.
+	*/
+	std::string addBlob(const std::vector<uint8_t>& data);
+	/** Returns the path of a blob added with addBlob(), restoring it from the user's blob cache if needed, or "" if not found.
+	Blobs not listed in the "blobs" array of any module's data are removed from the patch when it is saved.
+	*/
+	std::string getBlobPath(const std::string& hash);
+	/** Maps a blob into memory, like getBlobPath() followed by system::mapFile(), or returns NULL if not found.
+	Modules can play samples and wavetables from the mapping without copying them to the heap, since a blob never changes.
+	*/
+	std::shared_ptr<system::MappedFile> mapBlob(const std::string& hash);
 	/** Loads a patch and nothing else.
 	Returns whether the patch was loaded successfully.
 	*/
@@ -66,6 +122,10 @@ struct Manager {
 	Returns whether the user requests to cancel loading the patch.
 	*/
 	bool checkUnavailableModulesJson(json_t* rootJ);
+	/** Logs the time spent in each stage of saving and loading the current patch: toJson(), json_dumps(), json_loads(), and fromJson(), and writing and reading it as a binary patch.
+	Reloads the patch `iterations` times in each format.
+	*/
+	PRIVATE void benchmarkSerialization(int iterations = 5);
 };
 
 
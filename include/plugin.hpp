@@ -28,6 +28,17 @@ Model* getModelFallback(const std::string& pluginSlug, const std::string& modelS
 Throws an Exception if the model is not found.
 */
 Model* modelFromJson(json_t* moduleJ);
+/** Returns the Model defined by the plugin library, loading the library first if it was deferred by `settings::lazyPluginLoading`.
+Returns `model` itself if its library is already loaded.
+Throws an Exception if the library could not be loaded.
+*/
+Model* loadModel(Model* model);
+/** Loads the plugin library if it was deferred by `settings::lazyPluginLoading`.
+Throws an Exception if the library could not be loaded.
+*/
+void loadPluginLibrary(Plugin* plugin);
+/** Returns false if the plugin library was deferred and has not been loaded yet. */
+bool isPluginLibraryLoaded(Plugin* plugin);
 /** Checks that the slug contains only alphanumeric characters, "-", and "_" */
 bool isSlugValid(const std::string& slug);
 /** Returns a string containing only the valid slug characters. */
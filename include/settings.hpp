@@ -67,6 +67,16 @@ extern float knobLinearSensitivity;
 extern float knobScrollSensitivity;
 extern float sampleRate;
 extern int threadCount;
+/** Logical CPU indices to pin engine worker threads to, assigned round-robin by worker.
+Empty to let the OS schedule workers on any CPU.
+Read when the Engine is created, or by Engine::clearThreadConfig().
+*/
+extern std::vector<int> threadCpus;
+/** SCHED_FIFO priority of engine worker threads, or 0 to inherit the scheduling policy of the thread that launches them.
+Falls back to the inherited policy if not permitted.
+Read when the Engine is created, or by Engine::clearThreadConfig().
+*/
+extern int threadPriority;
 extern bool tooltips;
 extern bool cpuMeter;
 extern bool lockModules;
@@ -74,15 +84,27 @@ extern bool squeezeModules;
 extern bool preferDarkPanels;
 /** Maximum screen redraw frequency in Hz, or 0 for unlimited. */
 extern float frameRateLimit;
+/** Only redraws regions of the window that changed, and skips frames where nothing changed. */
+extern bool skipIdleFrames;
+/** Megapixels of framebuffers to keep before freeing those of widgets that are no longer drawn, or 0 for unlimited. */
+extern float framebufferBudget;
 /** Interval between autosaves in seconds. */
 extern float autosaveInterval;
 extern bool skipLoadOnLaunch;
+/** Saves patch files with patch.bin, a flat binary layout written and read without building JSON for each module, instead of patch.json.
+Module data is still stored as JSON. Patches saved this way can't be opened by Rack versions that don't support patch.bin.
+*/
+extern bool binaryPatches;
 extern std::list<std::string> recentPatchPaths;
 extern std::vector<NVGcolor> cableColors;
 extern std::vector<std::string> cableLabels;
 extern bool cableAutoRotate;
 extern bool autoCheckUpdates;
 extern bool verifyHttpsCerts;
+/** Defers loading each plugin library until one of its modules is first created.
+Module metadata is read from plugin manifests instead. Takes effect on restart.
+*/
+extern bool lazyPluginLoading;
 extern bool showTipsOnLaunch;
 extern int tipIndex;
 enum BrowserSort {
@@ -1,5 +1,7 @@
 #pragma once
 #include <vector>
+#include <functional>
+#include <memory>
 
 #include <common.hpp>
 
@@ -30,6 +32,12 @@ bool isFile(const std::string& path);
 /** Returns whether the given path is a directory. */
 bool isDirectory(const std::string& path);
 uint64_t getFileSize(const std::string& path);
+/** Returns the time the file was last modified, in seconds since the Unix epoch, or 0 if it doesn't exist. */
+double getModifiedTime(const std::string& path);
+/** Sets the file's last modified time to the current time.
+Returns whether successful.
+*/
+bool touchFile(const std::string& path);
 /** Moves a file or directory.
 Does not overwrite the destination. If this behavior is needed, use remove() or removeRecursively() before moving.
 Returns whether the rename was successful.
@@ -40,6 +48,11 @@ Overwrites destination if already exists.
 Returns whether the copy was successful.
 */
 bool copy(const std::string& srcPath, const std::string& destPath);
+/** Creates a hard link to a file, so both paths share the same data on disk.
+Fails if the paths are on different filesystems or the filesystem doesn't support hard links.
+Returns whether the link was created.
+*/
+bool createHardLink(const std::string& srcPath, const std::string& destPath);
 /** Creates a directory.
 The parent directory must exist.
 Returns whether the creation was successful.
@@ -117,6 +130,34 @@ Throws on error.
 std::vector<uint8_t> readFile(const std::string& path);
 uint8_t* readFile(const std::string& path, size_t* size);
 
+/** A read-only memory mapping of an entire file.
+Pages are read by the OS on first access and are shared with the page cache, so large files such as samples and wavetables can be used in place without copying them to the heap.
+The file must not be modified or truncated while mapped.
+*/
+struct MappedFile {
+	struct Internal;
+	Internal* internal;
+
+	/** Maps a file.
+	Throws on error.
+	*/
+	MappedFile(const std::string& path);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/** Returns the mapped file contents, or NULL if the file is empty. */
+	const uint8_t* getData();
+	size_t getSize();
+	/** Hints that the whole file will be read soon, so the OS can read it ahead asynchronously. */
+	void prefetch();
+};
+
+/** Maps a file for reading. The mapping is released when the last shared_ptr is destroyed.
+Throws on error.
+*/
+std::shared_ptr<MappedFile> mapFile(const std::string& path);
+
 /** Writes a memory buffer to a file, overwriting if already exists.
 Throws on error.
 */
@@ -137,6 +178,26 @@ Throws on error.
 void archiveDirectory(const std::string& archivePath, const std::string& dirPath, int compressionLevel = 1);
 std::vector<uint8_t> archiveDirectory(const std::string& dirPath, int compressionLevel = 1);
 
+/** Options that only set `compressionLevel`, with `skipCompressedFiles` disabled, write the same archives as the overloads above. */
+struct ArchiveOptions {
+	/** Zstandard compression level */
+	int compressionLevel = 1;
+	/** Number of Zstandard worker threads compressing in parallel with reading files, or 0 to compress on the calling thread. */
+	int threads = 0;
+	/** Finds repeated data up to 128 MiB apart, such as duplicate samples, at the cost of memory and speed. */
+	bool longDistanceMatching = false;
+	/** Stores files larger than 64 KiB with already-compressed extensions (.flac, .png, .zip, etc.) at the fastest compression level. */
+	bool skipCompressedFiles = true;
+	/** Files, relative to the directory, to archive before all others if they exist.
+	Lets readers that extract the archive as a stream, such as patch loading, use these files before the rest is extracted.
+	*/
+	std::vector<std::string> firstPaths;
+	/** Files, relative to the directory, to leave out of the archive. */
+	std::vector<std::string> excludePaths;
+};
+void archiveDirectory(const std::string& archivePath, const std::string& dirPath, const ArchiveOptions& options);
+std::vector<uint8_t> archiveDirectory(const std::string& dirPath, const ArchiveOptions& options);
+
 /** Extracts an archive into a directory.
 An equivalent shell command is
 
@@ -153,6 +214,10 @@ Throws on error.
 */
 void unarchiveToDirectory(const std::string& archivePath, const std::string& dirPath);
 void unarchiveToDirectory(const std::vector<uint8_t>& archiveData, const std::string& dirPath);
+/** Extracts an archive into a directory, calling `onFile` with the archive-relative path of each regular file after it is written.
+Allows using files such as a patch's patch.json before the rest of the archive is extracted.
+*/
+void unarchiveToDirectory(const std::string& archivePath, const std::string& dirPath, const std::function<void(const std::string& path)>& onFile);
 
 
 // Threading
@@ -161,6 +226,20 @@ void unarchiveToDirectory(const std::vector<uint8_t>& archiveData, const std::st
 int getLogicalCoreCount();
 /** Sets a name of the current thread for debuggers and OS-specific process viewers. */
 void setThreadName(const std::string& name);
+/** Restricts the current thread to run on the given logical CPU indices.
+Returns false if not supported by the OS or not permitted.
+Only supported on Linux.
+*/
+bool setThreadAffinity(const std::vector<int>& cpus);
+/** Returns the logical CPU indices the current thread is allowed to run on, or an empty vector if unknown. */
+std::vector<int> getThreadAffinity();
+/** Switches the current thread to real-time FIFO scheduling with the given priority, typically 1 to 99.
+Returns false if not supported by the OS or not permitted (e.g. missing rtprio limits), in which case the scheduling policy is unchanged.
+Only supported on Linux and Mac.
+*/
+bool setThreadRealTimePriority(int priority);
+/** Returns a description of the current thread's scheduling policy and priority, e.g. "SCHED_FIFO 80". */
+std::string getThreadScheduling();
 
 // Querying
 
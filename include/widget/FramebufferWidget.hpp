@@ -28,9 +28,14 @@ struct FramebufferWidget : Widget {
 	/** Requests to re-render children to the framebuffer on the next draw(). */
 	void setDirty(bool dirty = true);
 	int getImageHandle();
+	/** Returns the framebuffer, which is shared with other FramebufferWidgets if packed into an atlas. */
 	NVGLUframebuffer* getFramebuffer();
 	math::Vec getFramebufferSize();
 	void deleteFramebuffer();
+	/** Allows packing the framebuffer into a shared atlas texture if it's small.
+	Only use if drawFramebuffer() is not overridden and the framebuffer isn't accessed with getFramebuffer() or getImageHandle().
+	*/
+	PRIVATE void setPackable(bool packable);
 
 	void step() override;
 	/** Draws the framebuffer to the NanoVG scene, re-rendering it if necessary.
@@ -43,6 +48,17 @@ struct FramebufferWidget : Widget {
 	/** Initializes the current GL context and draws children to it.
 	*/
 	virtual void drawFramebuffer();
+	/** Renders framebuffers that draw() skipped in previous frames for lack of frame time, nearest to the center of the viewport first, until the frame time is used up.
+	Call before drawing the scene.
+	*/
+	PRIVATE static void renderQueue();
+	/** Returns the number of pixels of all allocated framebuffers and atlases. */
+	PRIVATE static int64_t getTotalPixels();
+	/** If framebuffers exceed `settings::framebufferBudget`, deletes framebuffers not drawn in the current frame, least recently drawn first, until under budget.
+	Framebuffers packed in an atlas are only evicted together, when none of them were drawn in the current frame.
+	Call after drawing the scene.
+	*/
+	PRIVATE static void evictUnused();
 
 	void onDirty(const DirtyEvent& e) override;
 	void onContextCreate(const ContextCreateEvent& e) override;
@@ -1,5 +1,6 @@
 #pragma once
 #include <memory>
+#include <vector>
 
 #include <nanovg.h>
 #include <nanosvg.h>
@@ -50,15 +51,32 @@ struct Svg {
 	int getNumShapes();
 	int getNumPaths();
 	int getNumPoints();
+	/** Draws the SVG.
+	The first draw converts the SVG to a draw list with precomputed path windings and paints, which later draws reuse.
+	*/
 	void draw(NVGcontext* vg);
 
-	/** Loads Svg from a cache. */
+	/** Loads Svg from a cache.
+	If the file is being parsed in the background by preload(), waits for it to finish.
+	*/
 	static std::shared_ptr<Svg> load(const std::string& filename);
+	/** Starts parsing SVG files on background threads, so later calls to load() return without parsing. */
+	PRIVATE static void preload(const std::vector<std::string>& filenames);
+	/** Stops parsing files queued by preload() and frees parsed files that weren't loaded by load(). */
+	PRIVATE static void cancelPreload();
+	/** Appends the filename of each following call to load() to `filenames`, until endRecording(). */
+	PRIVATE static void beginRecording(std::vector<std::string>* filenames);
+	PRIVATE static void endRecording();
+	/** Enables or disables caching draw lists in draw(), for benchmarking. */
+	PRIVATE static void setDrawListsEnabled(bool enabled);
 };
 
 DEPRECATED typedef Svg SVG;
 
 
+/** Draws an SVG without caching.
+Prefer Svg::draw(), which reuses the converted SVG between draws.
+*/
 void svgDraw(NVGcontext* vg, NSVGimage* svg);
 
 
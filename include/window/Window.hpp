@@ -18,6 +18,13 @@
 
 
 namespace rack {
+
+
+namespace widget {
+struct Widget;
+} // namespace widget
+
+
 /** Handles OS windowing, OpenGL, and NanoVG
 */
 namespace window {
@@ -102,6 +109,16 @@ struct Window {
 	double getLastFrameDuration();
 	/** Returns the current time remaining in seconds until the frame deadline, according to the frame rate limit. */
 	double getFrameDurationRemaining();
+	/** Returns the number of frames per second drawn over the last second. */
+	PRIVATE double getRenderedFrameRate();
+	/** Returns the number of frames per second skipped because nothing changed, over the last second. */
+	PRIVATE double getSkippedFrameRate();
+	/** Redraws the whole window in the next frame. */
+	PRIVATE void setDirty();
+	/** Redraws a rectangle in the widget's local coordinates in the next frame.
+	Widgets whose appearance changes without an input event call this so the change isn't skipped when `settings::skipIdleFrames` is enabled.
+	*/
+	PRIVATE void setDirtyRect(widget::Widget* w, math::Rect rect);
 
 	/** Loads and caches a Font from a file path.
 	Do not store this reference across screen frames, as the Window may have changed, invalidating the Font.
@@ -118,6 +135,13 @@ struct Window {
 		return Svg::load(filename);
 	}
 
+	/** Renders frames of the current patch at several zoom levels and logs the mean and maximum frame durations. */
+	PRIVATE void benchmarkDraw(int frames = 120);
+	/** Re-renders the panel of every module with and without cached SVG draw lists and logs the mean render durations. */
+	PRIVATE void benchmarkPanels(int renders = 20);
+	/** Replaces the patch with a rack of modules and logs the UI thread's CPU time per frame with and without throttled stepping of off-screen modules. */
+	PRIVATE void benchmarkStep(int modules = 1000, int frames = 120);
+
 	PRIVATE bool& fbDirtyOnSubpixelChange();
 	PRIVATE int& fbCount();
 };
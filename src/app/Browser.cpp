@@ -22,6 +22,7 @@
 #include <app/ModuleWidget.hpp>
 #include <app/Scene.hpp>
 #include <plugin.hpp>
+#include <asset.hpp>
 #include <context.hpp>
 #include <engine/Engine.hpp>
 #include <plugin/Model.hpp>
@@ -48,6 +49,17 @@ static void modelDbInit() {
 	modelDb.setWeights({0.9f, 0.75f, 1.0f, 0.8f, 0.9f});
 	modelDb.setThreshold(0.5f);
 
+	// Join all aliases of each tag once, rather than for each model
+	std::vector<std::string> tagAliasStrs;
+	for (const std::vector<std::string>& aliases : tag::tagAliases) {
+		std::string tagAliasStr;
+		for (const std::string& tagAlias : aliases) {
+			tagAliasStr += tagAlias;
+			tagAliasStr += " ";
+		}
+		tagAliasStrs.push_back(tagAliasStr);
+	}
+
 	// Iterate plugins
 	for (plugin::Plugin* plugin : plugin::plugins) {
 		// Iterate model in plugin
@@ -55,11 +67,7 @@ static void modelDbInit() {
 			// Get search fields for model
 			std::string tagStr;
 			for (int tagId : model->tagIds) {
-				// Add all aliases of a tag
-				for (const std::string& tagAlias : tag::tagAliases[tagId]) {
-					tagStr += tagAlias;
-					tagStr += " ";
-				}
+				tagStr += tagAliasStrs[tagId];
 			}
 			std::vector<std::string> fields = {
 				model->plugin->brand,
@@ -75,7 +83,17 @@ static void modelDbInit() {
 }
 
 
+/** Returns NULL if the Model's plugin library could not be loaded. */
 static ModuleWidget* chooseModel(plugin::Model* model) {
+	// Load the plugin library if it was deferred
+	try {
+		model = plugin::loadModel(model);
+	}
+	catch (Exception& e) {
+		WARN("Cannot create module: %s", e.what());
+		return NULL;
+	}
+
 	// Record usage
 	settings::ModuleInfo& mi = settings::moduleInfos[model->plugin->slug][model->slug];
 	mi.added++;
@@ -152,6 +170,12 @@ struct ModelBox : widget::OpaqueWidget {
 	widget::FramebufferWidget* fb = NULL;
 	ModuleWidgetContainer* mwc = NULL;
 	ModuleWidget* moduleWidget = NULL;
+	/** Set if the Model's plugin library could not be loaded, so the preview is not attempted again. */
+	bool previewFailed = false;
+	/** Screenshot saved by `--screenshot`, shown instead of the preview while the plugin library is deferred. */
+	std::string screenshotPath;
+	/** Size of the screenshot at zoom 1, or zero if there is none. */
+	math::Vec screenshotSize;
 
 	ModelBox() {
 		updateZoom();
@@ -159,6 +183,11 @@ struct ModelBox : widget::OpaqueWidget {
 
 	void setModel(plugin::Model* model) {
 		this->model = model;
+		if (!plugin::isPluginLibraryLoaded(model->plugin)) {
+			std::string path = system::join(asset::user("screenshots"), model->plugin->slug, model->slug + ".png");
+			if (system::isFile(path))
+				screenshotPath = path;
+		}
 	}
 
 	void updateZoom() {
@@ -169,6 +198,9 @@ struct ModelBox : widget::OpaqueWidget {
 			zoomWidget->setZoom(zoom);
 			box.size.x = moduleWidget->box.size.x * zoom;
 		}
+		else if (!screenshotSize.isZero()) {
+			box.size.x = screenshotSize.x * zoom;
+		}
 		else {
 			// Approximate size as 12HP before we know the actual size.
 			// We need a nonzero size, otherwise too many ModelBoxes will lazily render in the same frame.
@@ -179,9 +211,22 @@ struct ModelBox : widget::OpaqueWidget {
 	}
 
 	void createPreview() {
-		if (previewWidget)
+		if (previewWidget || previewFailed)
+			return;
+
+		// Browsing shouldn't load deferred plugin libraries, so draw a placeholder until the library is loaded, e.g. by adding the module.
+		if (!plugin::isPluginLibraryLoaded(model->plugin))
 			return;
 
+		// Get the Model defined by the plugin library
+		try {
+			plugin::loadModel(model);
+		}
+		catch (Exception& e) {
+			previewFailed = true;
+			return;
+		}
+
 		previewWidget = new widget::TransparentWidget;
 		addChild(previewWidget);
 
@@ -227,7 +272,10 @@ struct ModelBox : widget::OpaqueWidget {
 		float b = math::clamp(settings::rackBrightness + 0.2f, 0.f, 1.f);
 		nvgGlobalTint(args.vg, nvgRGBAf(b, b, b, 1));
 
-		OpaqueWidget::draw(args);
+		if (previewWidget)
+			OpaqueWidget::draw(args);
+		else
+			drawPlaceholder(args);
 
 		// Draw favorite border
 		const settings::ModuleInfo* mi = settings::getModuleInfo(model->plugin->slug, model->slug);
@@ -241,6 +289,47 @@ struct ModelBox : widget::OpaqueWidget {
 		}
 	}
 
+	/** Draws the cached screenshot if there is one, or the name and brand from the plugin manifest. */
+	void drawPlaceholder(const DrawArgs& args) {
+		if (!screenshotPath.empty()) {
+			std::shared_ptr<window::Image> image = APP->window->loadImage(screenshotPath);
+			if (image && image->handle >= 0) {
+				int width, height;
+				nvgImageSize(args.vg, image->handle, &width, &height);
+				if (screenshotSize.isZero() && height > 0) {
+					// Screenshots may be taken at any zoom, so scale them to the rack height.
+					screenshotSize = math::Vec(width * RACK_GRID_HEIGHT / height, RACK_GRID_HEIGHT);
+					updateZoom();
+				}
+				nvgBeginPath(args.vg);
+				nvgRect(args.vg, 0, 0, box.size.x, box.size.y);
+				nvgFillPaint(args.vg, nvgImagePattern(args.vg, 0, 0, box.size.x, box.size.y, 0.f, image->handle, 1.f));
+				nvgFill(args.vg);
+				return;
+			}
+			// Don't retry an unreadable screenshot every frame
+			screenshotPath = "";
+		}
+
+		nvgBeginPath(args.vg);
+		nvgRect(args.vg, 0, 0, box.size.x, box.size.y);
+		nvgFillColor(args.vg, nvgRGB(0x30, 0x30, 0x30));
+		nvgFill(args.vg);
+
+		std::shared_ptr<window::Font> font = APP->window->uiFont;
+		if (!font || font->handle < 0)
+			return;
+		float zoom = std::pow(2.f, settings::browserZoom);
+		nvgFontFaceId(args.vg, font->handle);
+		nvgFontSize(args.vg, 13 * zoom);
+		nvgTextAlign(args.vg, NVG_ALIGN_CENTER | NVG_ALIGN_TOP);
+		nvgFillColor(args.vg, nvgRGBf(0.9, 0.9, 0.9));
+		nvgTextBox(args.vg, 0, box.size.y * 0.4f, box.size.x, model->name.c_str(), NULL);
+		nvgFontSize(args.vg, 10 * zoom);
+		nvgFillColor(args.vg, nvgRGBf(0.6, 0.6, 0.6));
+		nvgTextBox(args.vg, 0, box.size.y * 0.4f + 20 * zoom, box.size.x, model->plugin->brand.c_str(), NULL);
+	}
+
 	void step() override {
 		OpaqueWidget::step();
 	}
@@ -260,14 +349,15 @@ struct ModelBox : widget::OpaqueWidget {
 	void onButton(const ButtonEvent& e) override {
 		if (e.action == GLFW_PRESS && e.button == GLFW_MOUSE_BUTTON_LEFT && (e.mods & RACK_MOD_MASK) == 0) {
 			ModuleWidget* mw = chooseModel(model);
-
-			// Pretend the moduleWidget was clicked so it can be dragged in the RackWidget
-			e.consume(mw);
-
-			// Set the drag position at the center of the module
-			mw->dragOffset() = mw->box.size.div(2);
-			// Disable dragging temporarily until the mouse has moved a bit.
-			mw->dragEnabled() = false;
+			if (mw) {
+				// Pretend the moduleWidget was clicked so it can be dragged in the RackWidget
+				e.consume(mw);
+
+				// Set the drag position at the center of the module
+				mw->dragOffset() = mw->box.size.div(2);
+				// Disable dragging temporarily until the mouse has moved a bit.
+				mw->dragEnabled() = false;
+			}
 		}
 
 		// Toggle favorite
@@ -90,10 +90,9 @@ void PlugWidget::step() {
 
 	PortWidget* pw = internal->cableWidget->getPort(internal->type);
 	if (pw && internal->plugLight->isVisible()) {
-		engine::Port* port = pw->getPort();
-		if (port) {
+		if (pw->module) {
 			for (int i = 0; i < 3; i++) {
-				values[i] = port->plugLights[i].getBrightness();
+				values[i] = pw->module->getPlugLightBrightness(pw->type, pw->portId, i);
 			}
 		}
 	}
@@ -134,6 +133,16 @@ engine::Port::Type PlugWidget::getType() {
 struct CableWidget::Internal {
 	/** For making history consistent when disconnecting and reconnecting cable. */
 	int64_t cableId = -1;
+
+	// Tessellated curves, in RackWidget coordinates.
+	// Reused between frames until the endpoints, cable tension, or zoom bucket changes.
+	bool geometryValid = false;
+	math::Vec geometryOutputPos;
+	math::Vec geometryInputPos;
+	float geometryTension = 0.f;
+	float geometryZoom = 0.f;
+	std::vector<math::Vec> points;
+	std::vector<math::Vec> shadowPoints;
 };
 
 
@@ -181,6 +190,8 @@ void CableWidget::updateCable() {
 		APP->engine->addCable(cable);
 		internal->cableId = cable->id;
 	}
+	if (parent)
+		APP->scene->rack->invalidateCableIndex();
 }
 
 
@@ -213,6 +224,8 @@ void CableWidget::setCable(engine::Cable* cable) {
 		outputPort = NULL;
 		inputPort = NULL;
 	}
+	if (parent)
+		APP->scene->rack->invalidateCableIndex();
 }
 
 
@@ -275,6 +288,19 @@ static math::Vec getSlumpPos(math::Vec pos1, math::Vec pos2) {
 }
 
 
+math::Rect CableWidget::getDrawBox() {
+	math::Vec outputPos = getOutputPos();
+	math::Vec inputPos = getInputPos();
+	math::Vec slump = getSlumpPos(outputPos, inputPos);
+	math::Vec shadowSlump = slump.plus(math::Vec(0, 30));
+	// A quadratic Bézier curve lies within the convex hull of its control points
+	math::Vec a = outputPos.min(inputPos).min(slump).min(shadowSlump);
+	math::Vec b = outputPos.max(inputPos).max(slump).max(shadowSlump);
+	// Pad by half the maximum stroke width
+	return math::Rect::fromMinMax(a, b).grow(math::Vec(5, 5));
+}
+
+
 void CableWidget::step() {
 	math::Vec outputPos = getOutputPos();
 	math::Vec inputPos = getInputPos();
@@ -306,41 +332,77 @@ void CableWidget::draw(const DrawArgs& args) {
 }
 
 
-void CableWidget::drawLayer(const DrawArgs& args, int layer) {
-	// Cable shadow and cable
-	float opacity = settings::cableOpacity;
+/** Computes the stroke thickness and opacity of the cable.
+Returns false if the cable is fully transparent.
+*/
+static bool CableWidget_getStyle(CableWidget* that, float* thickness, float* opacity) {
+	*opacity = settings::cableOpacity;
 	bool thick = false;
 
-	if (isComplete()) {
-		engine::Output* output = &cable->outputModule->outputs[cable->outputId];
+	if (that->isComplete()) {
+		engine::Output* output = &that->cable->outputModule->outputs[that->cable->outputId];
 		// Increase thickness if output port is polyphonic
 		if (output->isPolyphonic()) {
 			thick = true;
 		}
 
 		// Draw opaque if mouse is hovering over a connected port
-		Widget* hoveredWidget = APP->event->hoveredWidget;
-		if (outputPort == hoveredWidget || inputPort == hoveredWidget) {
-			opacity = 1.0;
+		widget::Widget* hoveredWidget = APP->event->hoveredWidget;
+		if (that->outputPort == hoveredWidget || that->inputPort == hoveredWidget) {
+			*opacity = 1.0;
 		}
 		// Draw translucent cable if not active (i.e. 0 channels)
 		else if (output->getChannels() == 0) {
-			opacity *= 0.5;
+			*opacity *= 0.5;
 		}
 	}
 	else {
 		// Draw opaque if the cable is incomplete
-		opacity = 1.0;
+		*opacity = 1.0;
 	}
 
-	if (opacity <= 0.0)
-		return;
-	nvgAlpha(args.vg, std::pow(opacity, 1.5));
+	*thickness = thick ? 9.0 : 6.0;
+	return *opacity > 0.0;
+}
+
+
+/** Flattens the quadratic Bézier curve p0, p1, p2 into line segments that deviate from the curve by at most 1/4 px at the given zoom. */
+static void tessellateQuad(math::Vec p0, math::Vec p1, math::Vec p2, float zoom, std::vector<math::Vec>& points) {
+	// The distance between each segment and the curve is at most |p0 - 2 p1 + p2| / (4 n^2)
+	float d = p0.minus(p1.mult(2)).plus(p2).norm();
+	if (!std::isfinite(d))
+		d = 0.f;
+	int n = math::clamp((int) std::ceil(std::sqrt(d * zoom)), 1, 256);
+
+	points.resize(n + 1);
+	for (int i = 0; i <= n; i++) {
+		float t = (float) i / n;
+		float u = 1.f - t;
+		points[i] = p0.mult(u * u).plus(p1.mult(2.f * u * t)).plus(p2.mult(t * t));
+	}
+}
 
-	math::Vec outputPos = getOutputPos();
-	math::Vec inputPos = getInputPos();
 
-	float thickness = thick ? 9.0 : 6.0;
+/** Re-tessellates the cable and shadow curves if the endpoints, cable tension, or zoom bucket changed. */
+static void CableWidget_updateGeometry(CableWidget* that, float zoom) {
+	CableWidget::Internal* internal = that->internal;
+	math::Vec outputPos = that->getOutputPos();
+	math::Vec inputPos = that->getInputPos();
+	// Tessellate for the next power-of-2 zoom level so zooming within a bucket reuses the geometry
+	float zoomBucket = std::exp2(std::ceil(std::log2(std::max(zoom, 1 / 64.f))));
+
+	if (internal->geometryValid
+		&& outputPos.equals(internal->geometryOutputPos)
+		&& inputPos.equals(internal->geometryInputPos)
+		&& settings::cableTension == internal->geometryTension
+		&& zoomBucket == internal->geometryZoom)
+		return;
+
+	internal->geometryValid = true;
+	internal->geometryOutputPos = outputPos;
+	internal->geometryInputPos = inputPos;
+	internal->geometryTension = settings::cableTension;
+	internal->geometryZoom = zoomBucket;
 
 	// The endpoints are off-center
 	math::Vec slump = getSlumpPos(outputPos, inputPos);
@@ -348,16 +410,44 @@ void CableWidget::drawLayer(const DrawArgs& args, int layer) {
 	outputPos = outputPos.plus(slump.minus(outputPos).normalize().mult(dist));
 	inputPos = inputPos.plus(slump.minus(inputPos).normalize().mult(dist));
 
+	math::Vec shadowSlump = slump.plus(math::Vec(0, 30));
+	tessellateQuad(outputPos, slump, inputPos, zoomBucket, internal->points);
+	tessellateQuad(outputPos, shadowSlump, inputPos, zoomBucket, internal->shadowPoints);
+}
+
+
+static void addPolyline(NVGcontext* vg, const std::vector<math::Vec>& points) {
+	nvgMoveTo(vg, VEC_ARGS(points[0]));
+	for (size_t i = 1; i < points.size(); i++) {
+		nvgLineTo(vg, VEC_ARGS(points[i]));
+	}
+}
+
+
+static float getZoom(NVGcontext* vg) {
+	float t[6];
+	nvgCurrentTransform(vg, t);
+	return std::hypot(t[0], t[1]);
+}
+
+
+void CableWidget::drawLayer(const DrawArgs& args, int layer) {
+	// Cable shadow and cable
+	float thickness, opacity;
+	if (!CableWidget_getStyle(this, &thickness, &opacity))
+		return;
+	nvgAlpha(args.vg, std::pow(opacity, 1.5));
+
+	CableWidget_updateGeometry(this, getZoom(args.vg));
+
 	nvgLineCap(args.vg, NVG_ROUND);
 	// Avoids glitches when cable is bent
 	nvgLineJoin(args.vg, NVG_ROUND);
 
 	if (layer == -1) {
 		// Draw cable shadow
-		math::Vec shadowSlump = slump.plus(math::Vec(0, 30));
 		nvgBeginPath(args.vg);
-		nvgMoveTo(args.vg, VEC_ARGS(outputPos));
-		nvgQuadTo(args.vg, VEC_ARGS(shadowSlump), VEC_ARGS(inputPos));
+		addPolyline(args.vg, internal->shadowPoints);
 		NVGcolor shadowColor = nvgRGBAf(0, 0, 0, 0.10);
 		nvgStrokeColor(args.vg, shadowColor);
 		nvgStrokeWidth(args.vg, thickness - 1.0);
@@ -366,8 +456,7 @@ void CableWidget::drawLayer(const DrawArgs& args, int layer) {
 	else if (layer == 0) {
 		// Draw cable outline
 		nvgBeginPath(args.vg);
-		nvgMoveTo(args.vg, VEC_ARGS(outputPos));
-		nvgQuadTo(args.vg, VEC_ARGS(slump), VEC_ARGS(inputPos));
+		addPolyline(args.vg, internal->points);
 		// nvgStrokePaint(args.vg, nvgLinearGradient(args.vg, VEC_ARGS(outputPos), VEC_ARGS(inputPos), color::mult(color, 0.5), color));
 		nvgStrokeColor(args.vg, color::mult(color, 0.8));
 		nvgStrokeWidth(args.vg, thickness);
@@ -383,10 +472,59 @@ void CableWidget::drawLayer(const DrawArgs& args, int layer) {
 }
 
 
+void CableWidget::drawShadows(const DrawArgs& args, const std::vector<CableWidget*>& cws) {
+	struct Shadow {
+		CableWidget* cw;
+		float thickness;
+		float alpha;
+	};
+	std::vector<Shadow> shadows;
+	shadows.reserve(cws.size());
+	float zoom = getZoom(args.vg);
+	for (CableWidget* cw : cws) {
+		Shadow shadow;
+		shadow.cw = cw;
+		float opacity;
+		if (!CableWidget_getStyle(cw, &shadow.thickness, &opacity))
+			continue;
+		shadow.alpha = std::pow(opacity, 1.5);
+		CableWidget_updateGeometry(cw, zoom);
+		shadows.push_back(shadow);
+	}
+
+	// Shadows are all the same color, and strokes aren't stenciled, so overlapping subpaths of one stroke blend like separate strokes.
+	// Stroke each group of shadows with the same width and alpha as a single path.
+	std::sort(shadows.begin(), shadows.end(), [](const Shadow& a, const Shadow& b) {
+		if (a.thickness != b.thickness)
+			return a.thickness < b.thickness;
+		return a.alpha < b.alpha;
+	});
+
+	nvgSave(args.vg);
+	nvgLineCap(args.vg, NVG_ROUND);
+	nvgLineJoin(args.vg, NVG_ROUND);
+	nvgStrokeColor(args.vg, nvgRGBAf(0, 0, 0, 0.10));
+	for (size_t i = 0; i < shadows.size();) {
+		size_t j = i;
+		nvgBeginPath(args.vg);
+		for (; j < shadows.size() && shadows[j].thickness == shadows[i].thickness && shadows[j].alpha == shadows[i].alpha; j++) {
+			addPolyline(args.vg, shadows[j].cw->internal->shadowPoints);
+		}
+		nvgAlpha(args.vg, shadows[i].alpha);
+		nvgStrokeWidth(args.vg, shadows[i].thickness - 1.0);
+		nvgStroke(args.vg);
+		i = j;
+	}
+	nvgRestore(args.vg);
+}
+
+
 engine::Cable* CableWidget::releaseCable() {
 	engine::Cable* cable = this->cable;
 	this->cable = NULL;
 	internal->cableId = -1;
+	if (parent)
+		APP->scene->rack->invalidateCableIndex();
 	return cable;
 }
 
@@ -395,11 +533,13 @@ void CableWidget::onAdd(const AddEvent& e) {
 	Widget* plugContainer = APP->scene->rack->getPlugContainer();
 	plugContainer->addChild(outputPlug);
 	plugContainer->addChild(inputPlug);
+	APP->scene->rack->indexCable(this);
 	Widget::onAdd(e);
 }
 
 
 void CableWidget::onRemove(const RemoveEvent& e) {
+	APP->scene->rack->unindexCable(this);
 	Widget* plugContainer = APP->scene->rack->getPlugContainer();
 	plugContainer->removeChild(outputPlug);
 	plugContainer->removeChild(inputPlug);
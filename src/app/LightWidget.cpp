@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include <app/LightWidget.hpp>
 #include <color.hpp>
 #include <settings.hpp>
@@ -7,6 +9,140 @@ namespace rack {
 namespace app {
 
 
+/** Lights and halos gathered between beginLightBatch() and endLightBatch() */
+struct LightBatch {
+	struct Instance {
+		/** Center in device coordinates */
+		math::Vec center;
+		float radius;
+		/** Outer radius of halo gradient */
+		float outerRadius;
+		NVGcolor color;
+		/** Color quantized to RGBA8, for grouping lights by color */
+		uint32_t key;
+	};
+
+	/** The context being batched, or NULL if not batching */
+	NVGcontext* vg = NULL;
+	std::vector<Instance> lights;
+	std::vector<Instance> halos;
+};
+
+
+static LightBatch lightBatch;
+
+
+static uint32_t LightBatch_getKey(NVGcolor color) {
+	uint32_t key = 0;
+	for (int i = 0; i < 4; i++) {
+		key <<= 8;
+		key |= (uint32_t) std::round(math::clamp(color.rgba[i], 0.f, 1.f) * 255.f);
+	}
+	return key;
+}
+
+
+/** Adds a circle centered at `center` in the current transform.
+Returns false if the light must be drawn immediately instead.
+*/
+static bool LightBatch_push(std::vector<LightBatch::Instance>& instances, NVGcontext* vg, math::Vec center, float radius, float outerRadius, NVGcolor color) {
+	if (!lightBatch.vg || lightBatch.vg != vg)
+		return false;
+	// Only translation and uniform scale can be reduced to a center and radius
+	float t[6];
+	nvgCurrentTransform(vg, t);
+	if (t[1] != 0.f || t[2] != 0.f || t[0] != t[3])
+		return false;
+
+	LightBatch::Instance instance;
+	instance.center = math::Vec(t[0] * center.x + t[4], t[3] * center.y + t[5]);
+	instance.radius = radius * t[0];
+	instance.outerRadius = outerRadius * t[0];
+	instance.color = color;
+	instance.key = LightBatch_getKey(color);
+	instances.push_back(instance);
+	return true;
+}
+
+
+void beginLightBatch(NVGcontext* vg) {
+	assert(!lightBatch.vg);
+	lightBatch.vg = vg;
+}
+
+
+void endLightBatch(NVGcontext* vg) {
+	assert(lightBatch.vg == vg);
+	lightBatch.vg = NULL;
+	if (lightBatch.lights.empty() && lightBatch.halos.empty())
+		return;
+
+	nvgSave(vg);
+	nvgResetTransform(vg);
+	// Screen blending is commutative, so drawing lights out of widget order gives the same result.
+	nvgGlobalCompositeBlendFunc(vg, NVG_ONE_MINUS_DST_COLOR, NVG_ONE);
+
+	// Lights with the same RGBA8 color are indistinguishable in the framebuffer, so fill each color with as few paths as possible.
+	// A path fills overlapping circles only once, but separately drawn lights blend twice where they overlap, so a path only contains circles that don't overlap.
+	auto& lights = lightBatch.lights;
+	std::sort(lights.begin(), lights.end(), [](const LightBatch::Instance& a, const LightBatch::Instance& b) {
+		if (a.key != b.key)
+			return a.key < b.key;
+		return a.center.x < b.center.x;
+	});
+	for (size_t i = 0; i < lights.size();) {
+		size_t j = i;
+		float maxRadius = 0.f;
+		nvgBeginPath(vg);
+		for (; j < lights.size() && lights[j].key == lights[i].key; j++) {
+			// Circles are sorted by x, so only check previous circles that are close enough in x to overlap
+			bool overlaps = false;
+			for (size_t k = j; k-- > i;) {
+				if (lights[j].center.x - lights[k].center.x >= lights[j].radius + maxRadius)
+					break;
+				float r = lights[j].radius + lights[k].radius;
+				if (lights[j].center.minus(lights[k].center).square() < r * r)
+					overlaps = true;
+			}
+			if (overlaps)
+				break;
+			nvgCircle(vg, VEC_ARGS(lights[j].center), lights[j].radius);
+			maxRadius = std::max(maxRadius, lights[j].radius);
+		}
+		nvgFillColor(vg, lights[i].color);
+		nvgFill(vg);
+		i = j;
+	}
+
+	// Each halo needs its own gradient fill, but halos with the same color and radii share a paint translated to each center.
+	auto& halos = lightBatch.halos;
+	std::sort(halos.begin(), halos.end(), [](const LightBatch::Instance& a, const LightBatch::Instance& b) {
+		if (a.key != b.key)
+			return a.key < b.key;
+		if (a.radius != b.radius)
+			return a.radius < b.radius;
+		return a.outerRadius < b.outerRadius;
+	});
+	NVGcolor ocol = nvgRGBA(0, 0, 0, 0);
+	NVGpaint paint;
+	for (size_t i = 0; i < halos.size(); i++) {
+		const LightBatch::Instance& halo = halos[i];
+		if (i == 0 || halo.key != halos[i - 1].key || halo.radius != halos[i - 1].radius || halo.outerRadius != halos[i - 1].outerRadius)
+			paint = nvgRadialGradient(vg, 0, 0, halo.radius, halo.outerRadius, halo.color, ocol);
+		nvgResetTransform(vg);
+		nvgTranslate(vg, VEC_ARGS(halo.center));
+		nvgBeginPath(vg);
+		nvgRect(vg, -halo.outerRadius, -halo.outerRadius, 2 * halo.outerRadius, 2 * halo.outerRadius);
+		nvgFillPaint(vg, paint);
+		nvgFill(vg);
+	}
+
+	nvgRestore(vg);
+	lightBatch.lights.clear();
+	lightBatch.halos.clear();
+}
+
+
 void LightWidget::draw(const DrawArgs& args) {
 	drawBackground(args);
 
@@ -51,6 +187,9 @@ void LightWidget::drawLight(const DrawArgs& args) {
 	// Foreground
 	if (color.a > 0.0) {
 		float radius = std::min(box.size.x, box.size.y) / 2.0;
+		if (LightBatch_push(lightBatch.lights, args.vg, math::Vec(radius, radius), radius, radius, color))
+			return;
+
 		nvgBeginPath(args.vg);
 		nvgCircle(args.vg, radius, radius, radius);
 
@@ -76,11 +215,13 @@ void LightWidget::drawHalo(const DrawArgs& args) {
 	math::Vec c = box.size.div(2);
 	float radius = std::min(box.size.x, box.size.y) / 2.0;
 	float oradius = radius + std::min(radius * 4.f, 15.f);
+	NVGcolor icol = color::mult(color, halo);
+	if (LightBatch_push(lightBatch.halos, args.vg, c, radius, oradius, icol))
+		return;
 
 	nvgBeginPath(args.vg);
 	nvgRect(args.vg, c.x - oradius, c.y - oradius, 2 * oradius, 2 * oradius);
 
-	NVGcolor icol = color::mult(color, halo);
 	NVGcolor ocol = nvgRGBA(0, 0, 0, 0);
 	NVGpaint paint = nvgRadialGradient(args.vg, c.x, c.y, radius, oradius, icol, ocol);
 	nvgFillPaint(args.vg, paint);
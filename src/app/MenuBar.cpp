@@ -420,6 +420,8 @@ struct ViewButton : MenuButton {
 			}
 		}));
 
+		menu->addChild(createBoolPtrMenuItem("Skip unchanged frames", "", &settings::skipIdleFrames));
+
 		ZoomSlider* zoomSlider = new ZoomSlider;
 		zoomSlider->box.size.x = 250.0;
 		menu->addChild(zoomSlider);
@@ -675,6 +677,27 @@ struct EngineButton : MenuButton {
 			settings::cpuMeter ^= true;
 		}));
 
+		menu->addChild(createSubmenuItem("Metrics", "", [=](ui::Menu* menu) {
+			engine::Engine* engine = APP->engine;
+			auto histogramText = [](engine::DurationHistogram* histogram) {
+				return string::f("p50 %.3f ms  p99 %.3f ms", histogram->getQuantile(0.50) * 1e3, histogram->getQuantile(0.99) * 1e3);
+			};
+			menu->addChild(createMenuLabel(string::f("Deadline misses: %lld", (long long) engine->getDeadlineMissCount())));
+			menu->addChild(createMenuLabel(string::f("Screen frames: %.1f drawn/s  %.1f skipped/s", APP->window->getRenderedFrameRate(), APP->window->getSkippedFrameRate())));
+			menu->addChild(createMenuLabel("Block duration: " + histogramText(engine->getBlockDurationHistogram())));
+			int threadCount = engine->getThreadConfig().threadCount;
+			for (int i = 0; i < threadCount; i++) {
+				engine::DurationHistogram* histogram = engine->getBarrierWaitHistogram(i);
+				if (!histogram)
+					break;
+				menu->addChild(createMenuLabel(string::f("Thread %d barrier wait: ", i + 1) + histogramText(histogram)));
+			}
+			menu->addChild(new ui::MenuSeparator);
+			menu->addChild(createMenuItem("Reset metrics", "", [=]() {
+				APP->engine->resetMetrics();
+			}));
+		}));
+
 		menu->addChild(createMenuItem<SampleRateItem>("Sample rate", RIGHT_ARROW));
 
 		menu->addChild(createSubmenuItem("Threads", string::f("%d", settings::threadCount), [=](ui::Menu* menu) {
@@ -692,6 +715,47 @@ struct EngineButton : MenuButton {
 					[=]() {settings::threadCount = i;}
 				));
 			}
+
+#if defined ARCH_LIN
+			// Scheduling settings are only read by the Engine when it's created or its thread config is cleared
+			menu->addChild(new ui::MenuSeparator);
+			menu->addChild(createBoolMenuItem("Pin workers to CPUs", "",
+				[=]() {return !settings::threadCpus.empty();},
+				[=](bool pin) {
+					settings::threadCpus.clear();
+					if (pin) {
+						// Leave CPU 0 to the OS and audio driver if possible
+						int cpus = system::getLogicalCoreCount();
+						for (int cpu = (cpus > 1) ? 1 : 0; cpu < cpus; cpu++)
+							settings::threadCpus.push_back(cpu);
+					}
+					APP->engine->clearThreadConfig();
+				}
+			));
+			std::string priorityText = settings::threadPriority > 0 ? string::f("%d", settings::threadPriority) : "Off";
+			menu->addChild(createSubmenuItem("Worker real-time priority", priorityText, [=](ui::Menu* menu) {
+				for (int priority : {0, 10, 40, 70, 90}) {
+					menu->addChild(createCheckMenuItem(priority > 0 ? string::f("%d", priority) : "Off", "",
+						[=]() {return settings::threadPriority == priority;},
+						[=]() {
+							settings::threadPriority = priority;
+							APP->engine->clearThreadConfig();
+						}
+					));
+				}
+			}));
+#endif
+
+			// Report scheduling actually applied to each thread
+			menu->addChild(new ui::MenuSeparator);
+			for (const engine::Engine::ThreadInfo& info : APP->engine->getThreadInfos()) {
+				std::string text = string::f("Thread %d: %s", info.threadId + 1, info.scheduling.c_str());
+				if (info.cpus.size() == 1)
+					text += string::f(", CPU %d", info.cpus[0]);
+				else if (!info.cpus.empty())
+					text += string::f(", %d CPUs", (int) info.cpus.size());
+				menu->addChild(createMenuLabel(text));
+			}
 		}));
 	}
 };
@@ -920,6 +984,9 @@ struct LibraryMenu : ui::Menu {
 				}
 			}
 		}
+
+		addChild(new ui::MenuSeparator);
+		addChild(createBoolPtrMenuItem("Load plugins on demand", "(restart required)", &settings::lazyPluginLoading));
 	}
 };
 
@@ -1037,25 +1104,12 @@ struct HelpButton : MenuButton {
 
 
 struct InfoLabel : ui::Label {
-	int frameCount = 0;
-	double frameDurationTotal = 0.0;
-	double frameDurationAvg = NAN;
 	// double uiLastTime = 0.0;
 	// double uiLastThreadTime = 0.0;
 	// double uiFrac = 0.0;
 
 	void step() override {
-		// Compute frame rate
-		double frameDuration = APP->window->getLastFrameDuration();
-		if (std::isfinite(frameDuration)) {
-			frameDurationTotal += frameDuration;
-			frameCount++;
-		}
-		if (frameDurationTotal >= 1.0) {
-			frameDurationAvg = frameDurationTotal / frameCount;
-			frameDurationTotal = 0.0;
-			frameCount = 0;
-		}
+		std::string oldText = text;
 
 		// Compute UI thread CPU
 		// double time = system::getTime();
@@ -1069,16 +1123,20 @@ struct InfoLabel : ui::Label {
 
 		text = "";
 
-		if (box.size.x >= 460) {
-			double fps = std::isfinite(frameDurationAvg) ? 1.0 / frameDurationAvg : 0.0;
+		if (box.size.x >= 560) {
+			double fps = APP->window->getRenderedFrameRate();
+			double skippedFps = APP->window->getSkippedFrameRate();
 			double meterAverage = APP->engine->getMeterAverage();
 			double meterMax = APP->engine->getMeterMax();
-			text += string::f("%.1f fps  %.1f%% avg  %.1f%% max", fps, meterAverage * 100, meterMax * 100);
+			text += string::f("%.1f fps  %.1f skipped  %.1f%% avg  %.1f%% max", fps, skippedFps, meterAverage * 100, meterMax * 100);
 			text += "     ";
 		}
 
 		text += APP_NAME + " " + APP_EDITION_NAME + " " + APP_VERSION + " " + APP_OS_NAME + " " + APP_CPU_NAME;
 
+		if (text != oldText)
+			APP->window->setDirtyRect(this, box.zeroPos());
+
 		Label::step();
 	}
 };
@@ -114,7 +114,7 @@ void ModuleLightWidget::step() {
 		}
 		else if (0 <= firstLightId && lastLightId <= (int) module->lights.size()) {
 			for (size_t i = 0; i < baseColors.size(); i++) {
-				float b = module->lights[firstLightId + i].getBrightness();
+				float b = module->getSnapshotLightBrightness(firstLightId + i);
 				if (!std::isfinite(b))
 					b = 0.f;
 				b = math::clamp(b, 0.f, 1.f);
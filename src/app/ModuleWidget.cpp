@@ -46,6 +46,9 @@ ModuleWidget::ModuleWidget() {
 }
 
 ModuleWidget::~ModuleWidget() {
+	// Plugins may delete a ModuleWidget without RackWidget::removeModule(), so don't leave it in the ID index
+	if (module && APP->scene)
+		APP->scene->rack->unindexModule(this);
 	clearChildren();
 	setModule(NULL);
 	delete internal;
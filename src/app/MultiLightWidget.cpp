@@ -1,5 +1,7 @@
 #include <app/MultiLightWidget.hpp>
 #include <color.hpp>
+#include <context.hpp>
+#include <window/Window.hpp>
 
 
 namespace rack {
@@ -17,6 +19,7 @@ void MultiLightWidget::addBaseColor(NVGcolor baseColor) {
 
 void MultiLightWidget::setBrightnesses(const std::vector<float>& brightnesses) {
 	assert(brightnesses.size() == baseColors.size());
+	NVGcolor oldColor = color;
 	color = nvgRGBAf(0, 0, 0, 0);
 	for (size_t i = 0; i < baseColors.size(); i++) {
 		NVGcolor c = baseColors[i];
@@ -24,6 +27,11 @@ void MultiLightWidget::setBrightnesses(const std::vector<float>& brightnesses) {
 		color = color::screen(color, c);
 	}
 	color = color::clamp(color);
+
+	if (!color::isEqual(color, oldColor)) {
+		// Include the halo, which extends up to 15 px outside the light
+		APP->window->setDirtyRect(this, box.zeroPos().grow(math::Vec(15, 15)));
+	}
 }
 
 
@@ -178,6 +178,7 @@ void ParamWidget::step() {
 			ChangeEvent eChange;
 			onChange(eChange);
 			internal->lastValue = value;
+			APP->window->setDirtyRect(this, box.zeroPos());
 		}
 	}
 
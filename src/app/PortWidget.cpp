@@ -482,6 +482,7 @@ void PortWidget::onDragStart(const DragStartEvent& e) {
 			assert(plug);
 			APP->scene->rack->getPlugContainer()->removeChild(plug);
 			APP->scene->rack->getPlugContainer()->addChild(plug);
+			APP->scene->rack->invalidateCableIndex();
 		}
 	}
 
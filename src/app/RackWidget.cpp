@@ -1,14 +1,29 @@
 #include <map>
+#include <unordered_map>
 #include <algorithm>
 #include <queue>
 #include <functional>
+#include <typeinfo>
+#include <set>
 
 #include <osdialog.h>
 
 #include <app/RackWidget.hpp>
 #include <widget/TransparentWidget.hpp>
+#include <widget/OpaqueWidget.hpp>
+#include <widget/SvgWidget.hpp>
+#include <widget/FramebufferWidget.hpp>
 #include <app/RailWidget.hpp>
+#include <app/LightWidget.hpp>
+#include <app/MultiLightWidget.hpp>
+#include <app/SvgPanel.hpp>
+#include <app/SvgScrew.hpp>
+#include <app/CircularShadow.hpp>
+#include <widget/TransformWidget.hpp>
+#include <app/ParamWidget.hpp>
+#include <app/PortWidget.hpp>
 #include <app/Scene.hpp>
+#include <window/Svg.hpp>
 #include <settings.hpp>
 #include <plugin.hpp>
 #include <engine/Engine.hpp>
@@ -37,9 +52,68 @@ struct RackWidget::Internal {
 	math::Vec selectionEnd;
 	std::set<ModuleWidget*> selectedModules;
 	std::map<widget::Widget*, math::Vec> moduleOldPositions;
+
+	/** Module ID -> ModuleWidget, maintained when modules are added and removed. */
+	std::unordered_map<int64_t, ModuleWidget*> modulesById;
+	/** Cable ID -> CableWidget, for cables with an engine::Cable */
+	std::unordered_map<int64_t, CableWidget*> cablesById;
+	/** Port -> cables attached to the port, in plug order */
+	std::unordered_map<PortWidget*, std::vector<CableWidget*>> cablesByPort;
+	/** Whether the cable index must be rebuilt before the next lookup.
+	Set when cable ports or IDs change, since CableWidget fields are public and set directly in many places.
+	*/
+	bool cableIndexDirty = true;
 };
 
 
+static void RackWidget_indexModule(RackWidget* that, ModuleWidget* mw) {
+	that->internal->modulesById[mw->module->id] = mw;
+}
+
+
+static void RackWidget_rebuildModuleIndex(RackWidget* that) {
+	that->internal->modulesById.clear();
+	for (widget::Widget* w : that->internal->moduleContainer->children) {
+		ModuleWidget* mw = dynamic_cast<ModuleWidget*>(w);
+		assert(mw);
+		RackWidget_indexModule(that, mw);
+	}
+}
+
+
+static void RackWidget_rebuildCableIndex(RackWidget* that) {
+	that->internal->cablesById.clear();
+	that->internal->cablesByPort.clear();
+	for (widget::Widget* w : that->internal->cableContainer->children) {
+		CableWidget* cw = dynamic_cast<CableWidget*>(w);
+		assert(cw);
+		if (cw->cable)
+			that->internal->cablesById[cw->cable->id] = cw;
+	}
+	// Iterate plugs rather than cables so each port's cable list is in plug order
+	for (widget::Widget* w : that->internal->plugContainer->children) {
+		PlugWidget* plug = dynamic_cast<PlugWidget*>(w);
+		assert(plug);
+		CableWidget* cw = plug->getCable();
+		PortWidget* port = cw->getPort(plug->getType());
+		if (port)
+			that->internal->cablesByPort[port].push_back(cw);
+	}
+	that->internal->cableIndexDirty = false;
+}
+
+
+static const std::vector<CableWidget*>& RackWidget_getCablesOnPort(RackWidget* that, PortWidget* port) {
+	static const std::vector<CableWidget*> empty;
+	if (that->internal->cableIndexDirty)
+		RackWidget_rebuildCableIndex(that);
+	auto it = that->internal->cablesByPort.find(port);
+	if (it == that->internal->cablesByPort.end())
+		return empty;
+	return it->second;
+}
+
+
 /** Creates a new Module and ModuleWidget */
 static ModuleWidget* moduleWidgetFromJson(json_t* moduleJ) {
 	plugin::Model* model = plugin::modelFromJson(moduleJ);
@@ -57,20 +131,415 @@ static ModuleWidget* moduleWidgetFromJson(json_t* moduleJ) {
 }
 
 
+/** Model -> SVG files loaded while creating its ModuleWidget.
+Saved across sessions so that loading a patch can parse its panels in the background before creating the widgets.
+*/
+static std::map<std::string, std::vector<std::string>> moduleSvgs;
+static bool moduleSvgsLoaded = false;
+
+
+static std::string getModuleSvgsPath() {
+	return asset::user("module-svgs.json");
+}
+
+
+static std::vector<std::string>& getModuleSvgs(plugin::Model* model) {
+	if (!moduleSvgsLoaded) {
+		moduleSvgsLoaded = true;
+		FILE* file = std::fopen(getModuleSvgsPath().c_str(), "r");
+		if (file) {
+			DEFER({std::fclose(file);});
+			json_t* rootJ = json_loadf(file, 0, NULL);
+			if (rootJ) {
+				DEFER({json_decref(rootJ);});
+				const char* key;
+				json_t* filenamesJ;
+				json_object_foreach(rootJ, key, filenamesJ) {
+					if (!json_is_array(filenamesJ))
+						continue;
+					std::vector<std::string>& filenames = moduleSvgs[key];
+					size_t i;
+					json_t* filenameJ;
+					json_array_foreach(filenamesJ, i, filenameJ) {
+						const char* filename = json_string_value(filenameJ);
+						if (!filename)
+							continue;
+						filenames.push_back(filename);
+					}
+				}
+			}
+		}
+	}
+	return moduleSvgs[model->plugin->slug + "/" + model->slug];
+}
+
+
+static void saveModuleSvgs() {
+	json_t* rootJ = json_object();
+	DEFER({json_decref(rootJ);});
+	for (const auto& pair : moduleSvgs) {
+		json_t* filenamesJ = json_array();
+		for (const std::string& filename : pair.second) {
+			json_array_append_new(filenamesJ, json_string(filename.c_str()));
+		}
+		json_object_set_new(rootJ, pair.first.c_str(), filenamesJ);
+	}
+
+	std::string path = getModuleSvgsPath();
+	std::string tmpPath = path + ".tmp";
+	FILE* file = std::fopen(tmpPath.c_str(), "w");
+	if (!file)
+		return;
+	json_dumpf(rootJ, file, JSON_COMPACT);
+	std::fclose(file);
+	system::remove(path);
+	system::rename(tmpPath, path);
+}
+
+
+/** Width of a ModuleContainer grid cell. Cells are one rack row high. */
+static const float MODULE_CELL_WIDTH = RACK_GRID_WIDTH * 32;
+/** Modules spanning more cells than this aren't bucketed, and are always considered. */
+static const int MODULE_CELL_MAX = 64;
+/** Modules outside the viewport are stepped once every this many frames, staggered so each frame steps an equal share. */
+static const int OFFSCREEN_STEP_INTERVAL = 8;
+static bool offscreenStepThrottling = true;
+
+
+/** Returns whether a widget's appearance only changes on input events or when it calls Window::setDirtyRect().
+Other widgets, such as displays drawn by plugins, are assumed to change every frame.
+*/
+static bool isTrackedWidget(widget::Widget* w) {
+	widget::FramebufferWidget* fb = dynamic_cast<widget::FramebufferWidget*>(w);
+	if (fb && !fb->bypassed) {
+		// Children are only drawn when the framebuffer is dirty, which it reports
+		return true;
+	}
+	// Generic containers are matched by exact type, since plugin displays subclass them to override draw().
+	bool container = typeid(*w) == typeid(widget::Widget)
+		|| typeid(*w) == typeid(widget::TransparentWidget)
+		|| typeid(*w) == typeid(widget::OpaqueWidget)
+		|| typeid(*w) == typeid(widget::TransformWidget)
+		|| typeid(*w) == typeid(widget::FramebufferWidget)
+		|| typeid(*w) == typeid(widget::SvgWidget);
+	// Rack's component classes are matched by base class, since plugins subclass them for each component.
+	// Params and ports redraw when their value or cables change, ModuleLightWidget::step() redraws the light when its color changes, and panels and screws never change.
+	bool known = container
+		|| dynamic_cast<ParamWidget*>(w)
+		|| dynamic_cast<PortWidget*>(w)
+		|| dynamic_cast<ModuleLightWidget*>(w)
+		|| dynamic_cast<SvgPanel*>(w)
+		|| dynamic_cast<SvgScrew*>(w)
+		|| dynamic_cast<CircularShadow*>(w)
+		|| dynamic_cast<PanelBorder*>(w);
+	if (!known)
+		return false;
+	for (widget::Widget* child : w->children) {
+		if (!isTrackedWidget(child))
+			return false;
+	}
+	return true;
+}
+
+
+/** Returns whether all of a ModuleWidget's children are tracked.
+The ModuleWidget itself is a plugin class, but only draws its children and the CPU meter.
+*/
+static bool isTrackedModuleWidget(widget::Widget* mw) {
+	for (widget::Widget* child : mw->children) {
+		if (!isTrackedWidget(child))
+			return false;
+	}
+	return true;
+}
+
+
+/** Buckets ModuleWidgets into a uniform grid of cells, so that drawing and hit-testing only visit modules near the clip box or mouse position instead of all modules.
+Module positions are set in many places, including by plugins, without notifying the container, so the index is synced with the children's boxes before each use and whenever RackWidget moves modules.
+*/
 struct ModuleContainer : widget::Widget {
+	struct Entry {
+		math::Rect box;
+		/** Index in `children`, for preserving draw and event order */
+		size_t order = 0;
+		uint32_t generation = 0;
+		/** Cell range, or empty if not bucketed */
+		int cellLeft = 0;
+		int cellTop = 0;
+		int cellRight = -1;
+		int cellBottom = -1;
+		/** Cached result of isTrackedModuleWidget(), or -1 if not computed */
+		int tracked = -1;
+		/** Number of children when `tracked` was computed */
+		size_t trackedChildren = 0;
+	};
+	std::unordered_map<widget::Widget*, Entry> entries;
+	std::unordered_map<uint64_t, std::vector<widget::Widget*>> cells;
+	/** Children too large to bucket */
+	std::set<widget::Widget*> unbucketed;
+	uint32_t generation = 0;
+
+	/** Children that may intersect `visibleRect`, reused between draw layers and frames until the index or clip box changes */
+	std::vector<widget::Widget*> visibleChildren;
+	math::Rect visibleRect;
+	bool visibleValid = false;
+	/** Number of step() calls, for staggering steps of off-screen modules */
+	uint64_t stepFrame = 0;
+	size_t lastChildCount = 0;
+
+	static uint64_t getCellKey(int x, int y) {
+		return ((uint64_t) (uint32_t) x << 32) | (uint32_t) y;
+	}
+
+	void bucket(widget::Widget* child, Entry& entry) {
+		math::Rect box = entry.box;
+		entry.cellRight = -1;
+		entry.cellBottom = -1;
+		if (!box.pos.isFinite() || !box.size.isFinite() || box.size.x / MODULE_CELL_WIDTH > MODULE_CELL_MAX || box.size.y / RACK_GRID_HEIGHT > MODULE_CELL_MAX) {
+			unbucketed.insert(child);
+			return;
+		}
+		entry.cellLeft = std::floor(box.getLeft() / MODULE_CELL_WIDTH);
+		entry.cellTop = std::floor(box.getTop() / RACK_GRID_HEIGHT);
+		entry.cellRight = std::floor(box.getRight() / MODULE_CELL_WIDTH);
+		entry.cellBottom = std::floor(box.getBottom() / RACK_GRID_HEIGHT);
+		for (int y = entry.cellTop; y <= entry.cellBottom; y++) {
+			for (int x = entry.cellLeft; x <= entry.cellRight; x++) {
+				cells[getCellKey(x, y)].push_back(child);
+			}
+		}
+	}
+
+	void unbucket(widget::Widget* child, Entry& entry) {
+		unbucketed.erase(child);
+		for (int y = entry.cellTop; y <= entry.cellBottom; y++) {
+			for (int x = entry.cellLeft; x <= entry.cellRight; x++) {
+				auto it = cells.find(getCellKey(x, y));
+				if (it == cells.end())
+					continue;
+				std::vector<widget::Widget*>& cell = it->second;
+				cell.erase(std::remove(cell.begin(), cell.end(), child), cell.end());
+				if (cell.empty())
+					cells.erase(it);
+			}
+		}
+	}
+
+	/** Re-buckets children whose box changed, and drops removed children. O(n) but cheap compared to visiting each child's draw(). */
+	void updateIndex() {
+		generation++;
+		bool changed = false;
+		size_t order = 0;
+		for (widget::Widget* child : children) {
+			auto it = entries.find(child);
+			if (it == entries.end()) {
+				Entry& entry = entries[child];
+				entry.box = child->box;
+				bucket(child, entry);
+				it = entries.find(child);
+				changed = true;
+			}
+			else if (!it->second.box.equals(child->box)) {
+				unbucket(child, it->second);
+				it->second.box = child->box;
+				bucket(child, it->second);
+				changed = true;
+			}
+			if (it->second.order != order)
+				changed = true;
+			it->second.order = order++;
+			it->second.generation = generation;
+		}
+
+		// Drop entries of removed children
+		if (entries.size() != children.size()) {
+			for (auto it = entries.begin(); it != entries.end();) {
+				if (it->second.generation != generation) {
+					unbucket(it->first, it->second);
+					it = entries.erase(it);
+				}
+				else {
+					it++;
+				}
+			}
+			changed = true;
+		}
+
+		if (changed)
+			visibleValid = false;
+	}
+
+	/** Returns children whose box may intersect `rect`, in `children` order. */
+	void queryIndex(math::Rect rect, std::vector<widget::Widget*>& result) {
+		result.clear();
+		// Scanning cells is slower than scanning children if the rect covers many cells
+		float cellCount = (rect.size.x / MODULE_CELL_WIDTH + 1) * (rect.size.y / RACK_GRID_HEIGHT + 1);
+		if (!rect.pos.isFinite() || !rect.size.isFinite() || cellCount > entries.size()) {
+			result.assign(children.begin(), children.end());
+			return;
+		}
+
+		int left = std::floor(rect.getLeft() / MODULE_CELL_WIDTH);
+		int top = std::floor(rect.getTop() / RACK_GRID_HEIGHT);
+		int right = std::floor(rect.getRight() / MODULE_CELL_WIDTH);
+		int bottom = std::floor(rect.getBottom() / RACK_GRID_HEIGHT);
+		for (int y = top; y <= bottom; y++) {
+			for (int x = left; x <= right; x++) {
+				auto it = cells.find(getCellKey(x, y));
+				if (it == cells.end())
+					continue;
+				result.insert(result.end(), it->second.begin(), it->second.end());
+			}
+		}
+		result.insert(result.end(), unbucketed.begin(), unbucketed.end());
+
+		// Sort by child order and remove modules found in multiple cells
+		std::sort(result.begin(), result.end(), [&](widget::Widget* a, widget::Widget* b) {
+			return entries[a].order < entries[b].order;
+		});
+		result.erase(std::unique(result.begin(), result.end()), result.end());
+	}
+
+	const std::vector<widget::Widget*>& getVisibleChildren(math::Rect clipBox) {
+		if (!visibleValid || !visibleRect.equals(clipBox)) {
+			queryIndex(clipBox, visibleChildren);
+			visibleRect = clipBox;
+			visibleValid = true;
+		}
+		return visibleChildren;
+	}
+
+	void drawVisibleChildren(const DrawArgs& args, int layer) {
+		for (widget::Widget* child : getVisibleChildren(args.clipBox)) {
+			// Same filter as Widget::drawLayer()
+			if (!child->isVisible())
+				continue;
+			if (!args.clipBox.intersects(child->box))
+				continue;
+			drawChild(child, args, layer);
+		}
+	}
+
+	/** Like recursePositionEvent(), but only visits children in the cell under the event position. */
+	template <typename TMethod, class TEvent>
+	void recurseIndexedPositionEvent(TMethod f, const TEvent& e) {
+		// Children may have been moved or deleted since the last frame
+		updateIndex();
+		std::vector<widget::Widget*> hits;
+		queryIndex(math::Rect(e.pos, math::Vec()), hits);
+		for (auto it = hits.rbegin(); it != hits.rend(); it++) {
+			// Stop propagation if requested
+			if (!e.isPropagating())
+				break;
+			widget::Widget* child = *it;
+			// Filter child by visibility and position
+			if (!child->visible)
+				continue;
+			if (!child->box.contains(e.pos))
+				continue;
+
+			// Clone event and adjust its position
+			TEvent e2 = e;
+			e2.pos = e.pos.minus(child->box.pos);
+			// Call child event handler
+			(child->*f)(e2);
+		}
+	}
+
+	/** Returns whether the module's widgets report their changes, so it doesn't need to be redrawn every frame. */
+	bool isTracked(widget::Widget* child) {
+		// ModuleWidget draws the CPU meter directly
+		if (settings::cpuMeter)
+			return false;
+		auto it = entries.find(child);
+		if (it == entries.end())
+			return false;
+		Entry& entry = it->second;
+		if (entry.tracked < 0 || entry.trackedChildren != child->children.size()) {
+			entry.tracked = isTrackedModuleWidget(child);
+			entry.trackedChildren = child->children.size();
+		}
+		return entry.tracked;
+	}
+
+	void step() override {
+		stepFrame++;
+		// Modules just outside the viewport step every frame, so scrolling doesn't reveal stale knobs and lights
+		math::Rect viewport = getViewport().grow(math::Vec(MODULE_CELL_WIDTH, RACK_GRID_HEIGHT));
+		bool throttle = offscreenStepThrottling && viewport.pos.isFinite() && viewport.size.isFinite();
+
+		size_t index = 0;
+		for (auto it = children.begin(); it != children.end();) {
+			widget::Widget* child = *it;
+			// Delete children if a delete is requested, same as Widget::step()
+			if (child->requestedDelete) {
+				RemoveEvent eRemove;
+				child->onRemove(eRemove);
+				APP->event->finalizeWidget(child);
+				it = children.erase(it);
+				child->parent = NULL;
+				delete child;
+				continue;
+			}
+
+			bool visible = viewport.intersects(child->box);
+			if (!throttle || visible || (stepFrame + index) % OFFSCREEN_STEP_INTERVAL == 0) {
+				// Acquire lights published by the engine before the module's widgets read them
+				engine::Module* module = static_cast<ModuleWidget*>(child)->module;
+				if (module)
+					module->updateSnapshot();
+				child->step();
+			}
+			if (visible && !isTracked(child))
+				APP->window->setDirtyRect(child, child->box.zeroPos());
+			it++;
+			index++;
+		}
+
+		// Redraw everything when modules are added or removed
+		if (children.size() != lastChildCount) {
+			lastChildCount = children.size();
+			APP->window->setDirty();
+		}
+	}
+
 	void draw(const DrawArgs& args) override {
+		updateIndex();
+
 		// Draw ModuleWidget shadows
-		Widget::drawLayer(args, -1);
+		drawVisibleChildren(args, -1);
 
-		Widget::draw(args);
+		drawVisibleChildren(args, 0);
 	}
 
 	void drawLayer(const DrawArgs& args, int layer) override {
 		// Draw lights after translucent rectangle
 		if (layer == 1) {
-			Widget::drawLayer(args, 1);
+			drawVisibleChildren(args, 1);
 		}
 	}
+
+	void onHover(const HoverEvent& e) override {
+		recurseIndexedPositionEvent(&Widget::onHover, e);
+	}
+	void onButton(const ButtonEvent& e) override {
+		recurseIndexedPositionEvent(&Widget::onButton, e);
+	}
+	void onHoverKey(const HoverKeyEvent& e) override {
+		recurseIndexedPositionEvent(&Widget::onHoverKey, e);
+	}
+	void onHoverText(const HoverTextEvent& e) override {
+		recurseIndexedPositionEvent(&Widget::onHoverText, e);
+	}
+	void onHoverScroll(const HoverScrollEvent& e) override {
+		recurseIndexedPositionEvent(&Widget::onHoverScroll, e);
+	}
+	void onDragHover(const DragHoverEvent& e) override {
+		recurseIndexedPositionEvent(&Widget::onDragHover, e);
+	}
+	void onPathDrop(const PathDropEvent& e) override {
+		recurseIndexedPositionEvent(&Widget::onPathDrop, e);
+	}
 };
 
 
@@ -96,17 +565,32 @@ struct PlugContainer : widget::TransparentWidget {
 
 
 struct CableContainer : widget::TransparentWidget {
+	std::vector<CableWidget*> visibleCables;
+
 	void draw(const DrawArgs& args) override {
 		// Don't draw on layer 0
 	}
 
 	void drawLayer(const DrawArgs& args, int layer) override {
 		if (layer == 3) {
+			// CableWidget boxes are unbounded, so cull by the cable's curve instead
+			visibleCables.clear();
+			for (widget::Widget* w : children) {
+				CableWidget* cw = static_cast<CableWidget*>(w);
+				if (!cw->isVisible())
+					continue;
+				if (!args.clipBox.intersects(cw->getDrawBox()))
+					continue;
+				visibleCables.push_back(cw);
+			}
+
 			// Draw cable shadows
-			Widget::drawLayer(args, -1);
+			CableWidget::drawShadows(args, visibleCables);
 
 			// Draw cables
-			Widget::draw(args);
+			for (CableWidget* cw : visibleCables) {
+				drawChild(cw, args);
+			}
 		}
 	}
 };
@@ -137,6 +621,10 @@ void RackWidget::step() {
 	Widget::step();
 }
 
+void RackWidget::setOffscreenStepThrottling(bool enabled) {
+	offscreenStepThrottling = enabled;
+}
+
 void RackWidget::draw(const DrawArgs& args) {
 	float b = settings::rackBrightness;
 
@@ -159,7 +647,9 @@ void RackWidget::draw(const DrawArgs& args) {
 	}
 
 	// Draw lights and halos
+	beginLightBatch(args.vg);
 	Widget::drawLayer(args, 1);
+	endLightBatch(args.vg);
 
 	// Tint all draws after this point
 	nvgGlobalTint(args.vg, nvgRGBAf(b, b, b, 1));
@@ -288,12 +778,7 @@ void RackWidget::mergeJson(json_t* rootJ) {
 		json_object_set_new(moduleJ, "pos", posJ);
 	}
 
-	// Calculate plug orders
-	std::map<Widget*, int> plugOrders;
-	int plugOrder = 1;
-	for (Widget* w : internal->plugContainer->children) {
-		plugOrders[w] = plugOrder++;
-	}
+	std::map<Widget*, int> plugOrders = getPlugOrders();
 
 	// cables
 	json_t* cablesJ = json_object_get(rootJ, "cables");
@@ -348,72 +833,135 @@ void RackWidget::fromJson(json_t* rootJ) {
 	if (!modulesJ)
 		return;
 
+	std::vector<ModuleLayout> moduleLayouts;
 	size_t moduleIndex;
 	json_t* moduleJ;
 	json_array_foreach(modulesJ, moduleIndex, moduleJ) {
+		ModuleLayout ml;
 		// Get module ID
 		json_t* idJ = json_object_get(moduleJ, "id");
-		int64_t id;
 		if (idJ)
-			id = json_integer_value(idJ);
+			ml.id = json_integer_value(idJ);
 		else
-			id = moduleIndex;
-
-		// Get Module
-		engine::Module* module = APP->engine->getModule(id);
-		if (!module) {
-			WARN("Cannot find Module %lld", (long long) id);
-			continue;
-		}
-
-		// Create ModuleWidget
-		INFO("Creating module widget %s", module->model->getFullName().c_str());
-		ModuleWidget* mw = module->model->createModuleWidget(module);
+			ml.id = moduleIndex;
 
 		// pos
 		json_t* posJ = json_object_get(moduleJ, "pos");
 		double x = 0.0, y = 0.0;
 		json_unpack(posJ, "[F, F]", &x, &y);
-		math::Vec pos = math::Vec(x, y);
+		ml.pos = math::Vec(x, y);
 		if (legacyV05) {
 			// In <=v0.5, positions were in pixel units
 		}
 		else {
-			pos = pos.mult(RACK_GRID_SIZE);
+			ml.pos = ml.pos.mult(RACK_GRID_SIZE);
 		}
-		pos = pos.plus(RACK_OFFSET);
-		setModulePosForce(mw, pos);
-
-		internal->moduleContainer->addChild(mw);
+		ml.pos = ml.pos.plus(RACK_OFFSET);
+		moduleLayouts.push_back(ml);
 	}
 
-	updateExpanders();
-
-	std::map<Widget*, int> plugOrders;
-
+	std::vector<CableLayout> cableLayouts;
 	// cables
 	json_t* cablesJ = json_object_get(rootJ, "cables");
 	// In <=v0.6, cables were called wires
 	if (!cablesJ)
 		cablesJ = json_object_get(rootJ, "wires");
-	if (!cablesJ)
-		return;
 	size_t cableIndex;
 	json_t* cableJ;
 	json_array_foreach(cablesJ, cableIndex, cableJ) {
+		CableLayout cl;
 		// Get cable ID
 		json_t* idJ = json_object_get(cableJ, "id");
-		int64_t id;
 		// In <=v0.6, the cable ID was the index in the array.
 		if (idJ)
-			id = json_integer_value(idJ);
+			cl.id = json_integer_value(idJ);
 		else
-			id = cableIndex;
+			cl.id = cableIndex;
+
+		// color
+		// In <v0.6.0, cables used JSON objects instead of hex strings. Just ignore them if so and use the next cable color.
+		json_t* colorJ = json_object_get(cableJ, "color");
+		if (colorJ && json_is_string(colorJ))
+			cl.color = json_string_value(colorJ);
+
+		// inputPlugOrder
+		json_t* inputPlugOrderJ = json_object_get(cableJ, "inputPlugOrder");
+		if (inputPlugOrderJ)
+			cl.inputPlugOrder = json_integer_value(inputPlugOrderJ);
 
+		// outputPlugOrder
+		json_t* outputPlugOrderJ = json_object_get(cableJ, "outputPlugOrder");
+		if (outputPlugOrderJ)
+			cl.outputPlugOrder = json_integer_value(outputPlugOrderJ);
+		cableLayouts.push_back(cl);
+	}
+
+	fromLayout(moduleLayouts, cableLayouts);
+}
+
+
+void RackWidget::fromLayout(const std::vector<ModuleLayout>& moduleLayouts, const std::vector<CableLayout>& cableLayouts) {
+	// Parse the SVGs that each module loaded last time in the background, in the order the widgets are created below
+	std::vector<std::string> svgFilenames;
+	for (const ModuleLayout& ml : moduleLayouts) {
+		engine::Module* module = APP->engine->getModule(ml.id);
+		if (!module)
+			continue;
+		const std::vector<std::string>& filenames = getModuleSvgs(module->model);
+		svgFilenames.insert(svgFilenames.end(), filenames.begin(), filenames.end());
+	}
+	window::Svg::preload(svgFilenames);
+	bool moduleSvgsChanged = false;
+
+	for (const ModuleLayout& ml : moduleLayouts) {
+		// Get Module
+		engine::Module* module = APP->engine->getModule(ml.id);
+		if (!module) {
+			WARN("Cannot find Module %lld", (long long) ml.id);
+			continue;
+		}
+
+		// Create ModuleWidget
+		INFO("Creating module widget %s", module->model->getFullName().c_str());
+		ModuleWidget* mw;
+		{
+			std::vector<std::string> filenames;
+			window::Svg::beginRecording(&filenames);
+			DEFER({window::Svg::endRecording();});
+			mw = module->model->createModuleWidget(module);
+
+			// Remove repeated loads of the same file, keeping the first
+			std::set<std::string> seen;
+			filenames.erase(std::remove_if(filenames.begin(), filenames.end(), [&](const std::string& filename) {
+				return !seen.insert(filename).second;
+			}), filenames.end());
+
+			std::vector<std::string>& oldFilenames = getModuleSvgs(module->model);
+			if (filenames != oldFilenames) {
+				oldFilenames = filenames;
+				moduleSvgsChanged = true;
+			}
+		}
+
+		setModulePosForce(mw, ml.pos);
+
+		internal->moduleContainer->addChild(mw);
+		RackWidget_indexModule(this, mw);
+	}
+
+	// Free SVGs parsed for modules that no longer load them
+	window::Svg::cancelPreload();
+	updateExpanders();
+	if (moduleSvgsChanged)
+		saveModuleSvgs();
+
+	std::map<Widget*, int> plugOrders;
+
+	for (const CableLayout& cl : cableLayouts) {
 		// Get Cable
-		engine::Cable* cable = APP->engine->getCable(id);
+		engine::Cable* cable = APP->engine->getCable(cl.id);
 		if (!cable) {
-			WARN("Cannot find Cable %lld", (long long) id);
+			WARN("Cannot find Cable %lld", (long long) cl.id);
 			continue;
 		}
 
@@ -421,7 +969,6 @@ void RackWidget::fromJson(json_t* rootJ) {
 		CableWidget* cw = new CableWidget;
 		try {
 			cw->setCable(cable);
-			cw->fromJson(cableJ);
 		}
 		catch (Exception& e) {
 			delete cw;
@@ -430,27 +977,37 @@ void RackWidget::fromJson(json_t* rootJ) {
 			delete cable;
 			continue;
 		}
+		// In <=v1, cable colors were not serialized.
+		if (!cl.color.empty())
+			cw->color = color::fromHexString(cl.color);
+		else
+			cw->color = getNextCableColor();
 		addCable(cw);
 
-		// inputPlugOrder
-		json_t* inputPlugOrderJ = json_object_get(cableJ, "inputPlugOrder");
-		if (inputPlugOrderJ) {
-			plugOrders[cw->inputPlug] = json_integer_value(inputPlugOrderJ);
-		}
-
-		// outputPlugOrder
-		json_t* outputPlugOrderJ = json_object_get(cableJ, "outputPlugOrder");
-		if (outputPlugOrderJ) {
-			plugOrders[cw->outputPlug] = json_integer_value(outputPlugOrderJ);
-		}
+		if (cl.inputPlugOrder)
+			plugOrders[cw->inputPlug] = cl.inputPlugOrder;
+		if (cl.outputPlugOrder)
+			plugOrders[cw->outputPlug] = cl.outputPlugOrder;
 	}
 
 	// Reorder plugs, approximately O(n log(n) log(n))
 	internal->plugContainer->children.sort([&](Widget* w1, Widget* w2) {
 		return get(plugOrders, w1, 0) < get(plugOrders, w2, 0);
 	});
+	invalidateCableIndex();
 }
 
+
+std::map<widget::Widget*, int> RackWidget::getPlugOrders() {
+	std::map<Widget*, int> plugOrders;
+	int plugOrder = 1;
+	for (Widget* w : internal->plugContainer->children) {
+		plugOrders[w] = plugOrder++;
+	}
+	return plugOrders;
+}
+
+
 struct PasteJsonResult {
 	/** Old module ID -> new module */
 	std::map<int64_t, ModuleWidget*> newModules;
@@ -500,6 +1057,7 @@ static PasteJsonResult RackWidget_pasteJson(RackWidget* that, json_t* rootJ, his
 		maxPos = maxPos.max(mw->box.getBottomRight());
 
 		that->internal->moduleContainer->addChild(mw);
+		RackWidget_indexModule(that, mw);
 		that->select(mw);
 
 		newModules[id] = mw;
@@ -664,6 +1222,7 @@ void RackWidget::addModule(ModuleWidget* m) {
 		throw Exception("Module %s height is %g px, must be %g px", m->model->getFullName().c_str(), m->box.size.y, RACK_GRID_HEIGHT);
 
 	internal->moduleContainer->addChild(m);
+	RackWidget_indexModule(this, m);
 
 	updateExpanders();
 }
@@ -697,18 +1256,39 @@ void RackWidget::removeModule(ModuleWidget* m) {
 
 	// Remove module from ModuleContainer
 	internal->moduleContainer->removeChild(m);
+	unindexModule(m);
 
 	updateExpanders();
 }
 
 ModuleWidget* RackWidget::getModule(int64_t moduleId) {
-	for (widget::Widget* w : internal->moduleContainer->children) {
-		ModuleWidget* mw = dynamic_cast<ModuleWidget*>(w);
-		assert(mw);
-		if (mw->module->id == moduleId)
+	auto it = internal->modulesById.find(moduleId);
+	if (it != internal->modulesById.end()) {
+		// Deleted ModuleWidgets unindex themselves, but modules can be removed from the ModuleContainer directly or their IDs changed.
+		ModuleWidget* mw = it->second;
+		if (mw->parent == internal->moduleContainer && mw->module && mw->module->id == moduleId)
 			return mw;
+		RackWidget_rebuildModuleIndex(this);
 	}
-	return NULL;
+	// Resync if modules were added to the ModuleContainer directly
+	else if (internal->modulesById.size() != internal->moduleContainer->children.size()) {
+		RackWidget_rebuildModuleIndex(this);
+	}
+	else {
+		return NULL;
+	}
+	it = internal->modulesById.find(moduleId);
+	if (it == internal->modulesById.end())
+		return NULL;
+	return it->second;
+}
+
+void RackWidget::unindexModule(ModuleWidget* mw) {
+	if (!mw->module)
+		return;
+	auto it = internal->modulesById.find(mw->module->id);
+	if (it != internal->modulesById.end() && it->second == mw)
+		internal->modulesById.erase(it);
 }
 
 std::vector<ModuleWidget*> RackWidget::getModules() {
@@ -1483,15 +2063,10 @@ CableWidget* RackWidget::getIncompleteCable() {
 
 PlugWidget* RackWidget::getTopPlug(PortWidget* port) {
 	assert(port);
-	for (auto it = internal->plugContainer->children.rbegin(); it != internal->plugContainer->children.rend(); it++) {
-		PlugWidget* plug = dynamic_cast<PlugWidget*>(*it);
-		assert(plug);
-		CableWidget* cw = plug->getCable();
-		PortWidget* port2 = cw->getPort(plug->getType());
-		if (port2 == port)
-			return plug;
-	}
-	return NULL;
+	const std::vector<CableWidget*>& cws = RackWidget_getCablesOnPort(this, port);
+	if (cws.empty())
+		return NULL;
+	return cws.back()->getPlug(port->type);
 }
 
 CableWidget* RackWidget::getTopCable(PortWidget* port) {
@@ -1502,21 +2077,26 @@ CableWidget* RackWidget::getTopCable(PortWidget* port) {
 }
 
 CableWidget* RackWidget::getCable(int64_t cableId) {
-	for (widget::Widget* w : internal->cableContainer->children) {
-		CableWidget* cw = dynamic_cast<CableWidget*>(w);
-		assert(cw);
-		if (!cw->cable)
-			continue;
-		if (cw->cable->id == cableId)
-			return cw;
-	}
-	return NULL;
+	if (internal->cableIndexDirty)
+		RackWidget_rebuildCableIndex(this);
+	auto it = internal->cablesById.find(cableId);
+	if (it == internal->cablesById.end())
+		return NULL;
+	return it->second;
 }
 
 CableWidget* RackWidget::getCable(PortWidget* outputPort, PortWidget* inputPort) {
-	for (widget::Widget* w : internal->cableContainer->children) {
-		CableWidget* cw = dynamic_cast<CableWidget*>(w);
-		assert(cw);
+	if (!outputPort && !inputPort) {
+		for (widget::Widget* w : internal->cableContainer->children) {
+			CableWidget* cw = dynamic_cast<CableWidget*>(w);
+			assert(cw);
+			if (!cw->outputPort && !cw->inputPort)
+				return cw;
+		}
+		return NULL;
+	}
+	// Search the cables on one port, which is usually a handful
+	for (CableWidget* cw : RackWidget_getCablesOnPort(this, outputPort ? outputPort : inputPort)) {
 		if (cw->outputPort == outputPort && cw->inputPort == inputPort)
 			return cw;
 	}
@@ -1561,35 +2141,60 @@ std::vector<CableWidget*> RackWidget::getIncompleteCables() {
 
 std::vector<CableWidget*> RackWidget::getCablesOnPort(PortWidget* port) {
 	assert(port);
-	std::vector<CableWidget*> cws;
-	for (widget::Widget* w : internal->plugContainer->children) {
-		PlugWidget* plug = dynamic_cast<PlugWidget*>(w);
-		assert(plug);
-		CableWidget* cw = plug->getCable();
-		PortWidget* port2 = cw->getPort(plug->getType());
-		if (port2 == port)
-			cws.push_back(cw);
-	}
-	return cws;
+	return RackWidget_getCablesOnPort(this, port);
 }
 
 std::vector<CableWidget*> RackWidget::getCompleteCablesOnPort(PortWidget* port) {
 	assert(port);
 	std::vector<CableWidget*> cws;
-	for (widget::Widget* w : internal->plugContainer->children) {
-		PlugWidget* plug = dynamic_cast<PlugWidget*>(w);
-		assert(plug);
-		CableWidget* cw = plug->getCable();
-		if (!cw->isComplete())
-			continue;
-		PortWidget* port2 = cw->getPort(plug->getType());
-		if (port2 == port)
+	for (CableWidget* cw : RackWidget_getCablesOnPort(this, port)) {
+		if (cw->isComplete())
 			cws.push_back(cw);
 	}
 	return cws;
 }
 
 
+void RackWidget::indexCable(CableWidget* cw) {
+	if (internal->cableIndexDirty)
+		return;
+	if (cw->cable)
+		internal->cablesById[cw->cable->id] = cw;
+	// Plugs are appended to the PlugContainer, so the cable is on top of both ports.
+	if (cw->outputPort)
+		internal->cablesByPort[cw->outputPort].push_back(cw);
+	if (cw->inputPort)
+		internal->cablesByPort[cw->inputPort].push_back(cw);
+}
+
+
+void RackWidget::unindexCable(CableWidget* cw) {
+	if (internal->cableIndexDirty)
+		return;
+	if (cw->cable) {
+		auto it = internal->cablesById.find(cw->cable->id);
+		if (it != internal->cablesById.end() && it->second == cw)
+			internal->cablesById.erase(it);
+	}
+	for (PortWidget* port : {cw->outputPort, cw->inputPort}) {
+		if (!port)
+			continue;
+		auto it = internal->cablesByPort.find(port);
+		if (it == internal->cablesByPort.end())
+			continue;
+		std::vector<CableWidget*>& cws = it->second;
+		cws.erase(std::remove(cws.begin(), cws.end(), cw), cws.end());
+		if (cws.empty())
+			internal->cablesByPort.erase(it);
+	}
+}
+
+
+void RackWidget::invalidateCableIndex() {
+	internal->cableIndexDirty = true;
+}
+
+
 int RackWidget::getNextCableColorId() {
 	return internal->nextCableColorId;
 }
@@ -1627,31 +2232,28 @@ void RackWidget::setTouchedParam(ParamWidget* pw) {
 
 
 void RackWidget::updateExpanders() {
+	// Modules were probably moved, added, or removed
+	static_cast<ModuleContainer*>(internal->moduleContainer)->updateIndex();
+
+	// Index modules by the grid positions of their left and right edges
+	std::map<std::pair<float, float>, ModuleWidget*> leftEdges;
+	std::map<std::pair<float, float>, ModuleWidget*> rightEdges;
 	for (widget::Widget* w : internal->moduleContainer->children) {
 		ModuleWidget* mw = (ModuleWidget*) w;
+		math::Rect gridBox = mw->getGridBox();
+		leftEdges[std::make_pair(gridBox.getTop(), gridBox.getLeft())] = mw;
+		rightEdges[std::make_pair(gridBox.getTop(), gridBox.getRight())] = mw;
+	}
 
-		math::Vec pLeft = mw->getGridBox().getTopLeft();
-		math::Vec pRight = mw->getGridBox().getTopRight();
-		ModuleWidget* mwLeft = NULL;
-		ModuleWidget* mwRight = NULL;
+	for (widget::Widget* w : internal->moduleContainer->children) {
+		ModuleWidget* mw = (ModuleWidget*) w;
+		math::Rect gridBox = mw->getGridBox();
 
 		// Find adjacent modules
-		for (widget::Widget* w2 : internal->moduleContainer->children) {
-			ModuleWidget* mw2 = (ModuleWidget*) w2;
-			if (mw2 == mw)
-				continue;
-
-			math::Vec p2Left = mw2->getGridBox().getTopLeft();
-			math::Vec p2Right = mw2->getGridBox().getTopRight();
-
-			// Check if this is a left module
-			if (p2Right.equals(pLeft))
-				mwLeft = mw2;
-
-			// Check if this is a right module
-			if (p2Left.equals(pRight))
-				mwRight = mw2;
-		}
+		auto leftIt = rightEdges.find(std::make_pair(gridBox.getTop(), gridBox.getLeft()));
+		ModuleWidget* mwLeft = (leftIt != rightEdges.end() && leftIt->second != mw) ? leftIt->second : NULL;
+		auto rightIt = leftEdges.find(std::make_pair(gridBox.getTop(), gridBox.getRight()));
+		ModuleWidget* mwRight = (rightIt != leftEdges.end() && rightIt->second != mw) ? rightIt->second : NULL;
 
 		mw->module->leftExpander.moduleId = mwLeft ? mwLeft->module->id : -1;
 		mw->module->rightExpander.moduleId = mwRight ? mwRight->module->id : -1;
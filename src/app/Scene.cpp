@@ -12,6 +12,7 @@
 #include <history.hpp>
 #include <settings.hpp>
 #include <patch.hpp>
+#include <engine/Engine.hpp>
 #include <asset.hpp>
 
 
@@ -110,10 +111,12 @@ void Scene::step() {
 		double time = system::getTime();
 		if (time - internal->lastAutosaveTime >= settings::autosaveInterval) {
 			internal->lastAutosaveTime = time;
-			APP->patch->saveAutosave();
+			APP->patch->saveAutosaveAsync();
 			settings::save();
 		}
 	}
+	APP->patch->step();
+	APP->engine->logThreadInfos();
 
 	// Scroll RackScrollWidget with arrow keys
 	math::Vec arrowDelta;
@@ -144,6 +147,15 @@ void Scene::step() {
 	}
 
 	Widget::step();
+
+	// Menus, tooltips, and other overlays may change without an event, so redraw them every frame
+	for (widget::Widget* child : children) {
+		if (child == rackScroll || child == menuBar || child == internal->resizeHandle)
+			continue;
+		if (!child->isVisible())
+			continue;
+		APP->window->setDirtyRect(child, child->box.zeroPos());
+	}
 }
 
 
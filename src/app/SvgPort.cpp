@@ -7,6 +7,7 @@ namespace app {
 
 SvgPort::SvgPort() {
 	fb = new widget::FramebufferWidget;
+	fb->setPackable(true);
 	addChild(fb);
 
 	shadow = new CircularShadow;
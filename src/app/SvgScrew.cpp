@@ -8,6 +8,7 @@ namespace app {
 
 SvgScrew::SvgScrew() {
 	fb = new widget::FramebufferWidget;
+	fb->setPackable(true);
 	addChild(fb);
 
 	sw = new widget::SvgWidget;
@@ -7,6 +7,7 @@ namespace app {
 
 SvgSlider::SvgSlider() {
 	fb = new widget::FramebufferWidget;
+	fb->setPackable(true);
 	addChild(fb);
 
 	background = new widget::SvgWidget;
@@ -1,6 +1,7 @@
 #include <audio.hpp>
 #include <string.hpp>
 #include <math.hpp>
+#include <system.hpp>
 
 
 namespace rack {
@@ -9,6 +10,10 @@ namespace audio {
 
 static std::vector<std::pair<int, Driver*>> drivers;
 
+/** Devices with at least one subscribed Port, for metrics reporting. */
+static std::set<Device*> activeDevices;
+static std::mutex activeDevicesMutex;
+
 ////////////////////
 // Driver
 ////////////////////
@@ -19,18 +24,32 @@ static std::vector<std::pair<int, Driver*>> drivers;
 ////////////////////
 
 void Device::subscribe(Port* port) {
-	std::lock_guard<std::mutex> lock(processMutex);
-	subscribed.insert(port);
+	{
+		std::lock_guard<std::mutex> lock(processMutex);
+		subscribed.insert(port);
+	}
+	std::lock_guard<std::mutex> devicesLock(activeDevicesMutex);
+	activeDevices.insert(this);
 }
 
 void Device::unsubscribe(Port* port) {
-	std::lock_guard<std::mutex> lock(processMutex);
-	auto it = subscribed.find(port);
-	if (it != subscribed.end())
-		subscribed.erase(it);
+	bool empty;
+	{
+		std::lock_guard<std::mutex> lock(processMutex);
+		auto it = subscribed.find(port);
+		if (it != subscribed.end())
+			subscribed.erase(it);
+		empty = subscribed.empty();
+	}
+	// Drivers delete the Device after the last Port unsubscribes, so remove it from the active set now.
+	if (empty) {
+		std::lock_guard<std::mutex> devicesLock(activeDevicesMutex);
+		activeDevices.erase(this);
+	}
 }
 
 void Device::processBuffer(const float* input, int inputStride, float* output, int outputStride, int frames) {
+	double startTime = system::getTime();
 	// Zero output since Ports might not write to all elements, or no Ports exist
 	std::fill_n(output, frames * outputStride, 0.f);
 
@@ -48,6 +67,22 @@ void Device::processBuffer(const float* input, int inputStride, float* output, i
 		contextSet(port->context);
 		port->processOutput(output + port->outputOffset, outputStride, frames);
 	}
+
+	// Update metrics
+	blockCount++;
+	float sampleRate = getSampleRate();
+	if (sampleRate > 0.f && frames > 0) {
+		double duration = system::getTime() - startTime;
+		float load = duration * sampleRate / frames;
+		if (load > 1.f)
+			deadlineMissCount++;
+		if (load > maxLoad.load(std::memory_order_relaxed))
+			maxLoad.store(load, std::memory_order_relaxed);
+	}
+}
+
+void Device::onXrun() {
+	xrunCount++;
 }
 
 void Device::onStartStream() {
@@ -416,6 +451,28 @@ Driver* getDriver(int driverId) {
 	return NULL;
 }
 
+json_t* devicesMetricsToJson() {
+	json_t* devicesJ = json_array();
+	std::lock_guard<std::mutex> lock(activeDevicesMutex);
+	for (Device* device : activeDevices) {
+		json_t* deviceJ = json_object();
+		try {
+			json_object_set_new(deviceJ, "name", json_string(device->getName().c_str()));
+			json_object_set_new(deviceJ, "sampleRate", json_real(device->getSampleRate()));
+			json_object_set_new(deviceJ, "blockSize", json_integer(device->getBlockSize()));
+		}
+		catch (Exception& e) {
+			WARN("Audio device could not get metrics info: %s", e.what());
+		}
+		json_object_set_new(deviceJ, "blocks", json_integer(device->blockCount));
+		json_object_set_new(deviceJ, "deadlineMisses", json_integer(device->deadlineMissCount));
+		json_object_set_new(deviceJ, "xruns", json_integer(device->xrunCount));
+		json_object_set_new(deviceJ, "maxLoad", json_real(device->maxLoad));
+		json_array_append_new(devicesJ, deviceJ);
+	}
+	return devicesJ;
+}
+
 
 } // namespace audio
 } // namespace rack
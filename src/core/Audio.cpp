@@ -1,4 +1,5 @@
 #include <mutex>
+#include <atomic>
 #include <chrono>
 #include <thread>
 #include <condition_variable>
@@ -12,6 +13,121 @@ namespace rack {
 namespace core {
 
 
+/** Holds the fill level of a ring buffer between two unsynchronized clocks near a target by nudging the resampling ratio.
+
+A critically damped PI loop (a second-order DLL) acts on the low-passed fill error, measured in seconds of audio.
+*/
+struct BufferFillController {
+	struct Stats {
+		/** Low-passed buffer fill, in engine frames. */
+		float fill = 0.f;
+		float targetFill = 0.f;
+		/** Current ratio correction in parts per million. */
+		float correctionPpm = 0.f;
+		/** Number of times the buffer was hard-cleared because it drifted too far from the target. */
+		int64_t resets = 0;
+		/** Number of device blocks in which the buffer ran empty. */
+		int64_t underruns = 0;
+	};
+
+	/** Loop time constant in seconds. */
+	double tau = 2.0;
+	/** Time constant of the fill low-pass filter in seconds. */
+	double fillTau = 0.25;
+	/** Maximum ratio deviation from 1. */
+	double maxCorrection = 0.005;
+	/** The correction applied to the resampler is rounded to this step.
+	Each change makes the resampler recompute its filter on the audio thread, so small changes aren't worth applying.
+	*/
+	double correctionStep = 1e-6;
+	/** Minimum time between changes of the applied correction, in seconds. Much shorter than `tau`, so the loop stays stable. */
+	double updateInterval = 0.25;
+
+	double fill = 0.0;
+	double integral = 0.0;
+	double correction = 1.0;
+	double timeSinceUpdate = 0.0;
+	bool settled = false;
+
+	/** Statistics written by the audio thread and read by the UI thread */
+	std::atomic<float> statsFill{0.f};
+	std::atomic<float> statsTargetFill{0.f};
+	std::atomic<float> statsCorrectionPpm{0.f};
+	std::atomic<int64_t> statsResets{0};
+	std::atomic<int64_t> statsUnderruns{0};
+
+	void reset() {
+		integral = 0.0;
+		correction = 1.0;
+		timeSinceUpdate = 0.0;
+		settled = false;
+	}
+
+	Stats getStats() {
+		Stats stats;
+		stats.fill = statsFill.load(std::memory_order_relaxed);
+		stats.targetFill = statsTargetFill.load(std::memory_order_relaxed);
+		stats.correctionPpm = statsCorrectionPpm.load(std::memory_order_relaxed);
+		stats.resets = statsResets.load(std::memory_order_relaxed);
+		stats.underruns = statsUnderruns.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	void resetStats() {
+		statsFill.store(0.f, std::memory_order_relaxed);
+		statsTargetFill.store(0.f, std::memory_order_relaxed);
+		statsCorrectionPpm.store(0.f, std::memory_order_relaxed);
+		statsResets.store(0, std::memory_order_relaxed);
+		statsUnderruns.store(0, std::memory_order_relaxed);
+	}
+
+	void onUnderrun() {
+		statsUnderruns.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/** Updates the loop once per device block and returns the ratio correction to apply to the resampler.
+	`dt` is the duration of the device block in seconds.
+	*/
+	double process(int currentFill, int targetFill, float sampleRate, double dt) {
+		if (!settled) {
+			fill = currentFill;
+			settled = true;
+		}
+		else {
+			double alpha = std::min(dt / fillTau, 1.0);
+			fill += (currentFill - fill) * alpha;
+		}
+
+		double omega = 1.0 / tau;
+		double error = (fill - targetFill) / sampleRate;
+		integral += error * dt;
+		// Anti-windup: don't let the integrator alone exceed the correction range
+		double maxIntegral = maxCorrection / (omega * omega);
+		integral = std::fmax(std::fmin(integral, maxIntegral), -maxIntegral);
+		double u = 2.0 * omega * error + omega * omega * integral;
+		u = std::fmax(std::fmin(u, maxCorrection), -maxCorrection);
+		// Hold the applied correction between updates so the resampler isn't reconfigured every block
+		timeSinceUpdate += dt;
+		double newCorrection = 1.0 + std::round(u / correctionStep) * correctionStep;
+		if (newCorrection != correction && timeSinceUpdate >= updateInterval) {
+			correction = newCorrection;
+			timeSinceUpdate = 0.0;
+		}
+
+		statsFill.store(fill, std::memory_order_relaxed);
+		statsTargetFill.store(targetFill, std::memory_order_relaxed);
+		statsCorrectionPpm.store((correction - 1.0) * 1e6, std::memory_order_relaxed);
+		return correction;
+	}
+
+	/** Call when the buffer is cleared to recover from a large excursion. */
+	void onReset() {
+		statsResets.fetch_add(1, std::memory_order_relaxed);
+		settled = false;
+	}
+};
+
+
 template <int NUM_AUDIO_INPUTS, int NUM_AUDIO_OUTPUTS>
 struct AudioPort : audio::Port {
 	Module* module;
@@ -22,6 +138,12 @@ struct AudioPort : audio::Port {
 	dsp::SampleRateConverter<NUM_AUDIO_INPUTS> inputSrc;
 	dsp::SampleRateConverter<NUM_AUDIO_OUTPUTS> outputSrc;
 
+	/** Drift compensation for secondary (non-master) devices.
+	inputFillController holds engineInputBuffer, outputFillController holds engineOutputBuffer.
+	*/
+	BufferFillController inputFillController;
+	BufferFillController outputFillController;
+
 	// Port variable caches
 	int deviceNumInputs = 0;
 	int deviceNumOutputs = 0;
@@ -73,12 +195,27 @@ struct AudioPort : audio::Port {
 
 		// DEBUG("%p: %d block, engineOutputBuffer still has %d", this, frames, (int) engineOutputBuffer.size());
 
-		// Consider engine buffers "too full" if they contain a bit more than the audio device's number of frames, converted to engine sample rate.
-		int maxEngineFrames = (int) std::ceil(frames * sampleRateRatio * 2.0) - 1;
-		// If the engine output buffer is too full, clear it to keep latency low. No need to clear if master because it's always cleared below.
-		if (!isMasterCached && (int) engineOutputBuffer.size() > maxEngineFrames) {
-			engineOutputBuffer.clear();
-			// DEBUG("%p: clearing engine output", this);
+		// Target fill of engine buffers for secondary devices: one device block, converted to engine sample rate.
+		int targetEngineFrames = (int) std::ceil(frames * sampleRateRatio);
+		// Beyond this, drift compensation has failed (e.g. after a stall), so clear the buffer to keep latency low.
+		int maxEngineFrames = targetEngineFrames * 4;
+		double blockTime = frames / deviceSampleRate;
+
+		if (isMasterCached) {
+			// The engine is stepped by exactly as many frames as the buffers need, so no drift compensation is needed.
+			outputFillController.reset();
+			outputSrc.setRatioCorrection(1.0);
+		}
+		else if (deviceNumInputs > 0) {
+			if ((int) engineOutputBuffer.size() > maxEngineFrames) {
+				engineOutputBuffer.clear();
+				outputFillController.onReset();
+			}
+			if (engineOutputBuffer.empty())
+				outputFillController.onUnderrun();
+			// Measure fill before pushing this block, so the engine has drained it since the last block.
+			double correction = outputFillController.process(engineOutputBuffer.size(), targetEngineFrames, engineSampleRate, blockTime);
+			outputSrc.setRatioCorrection(correction);
 		}
 
 		if (deviceNumInputs > 0) {
@@ -111,11 +248,13 @@ struct AudioPort : audio::Port {
 	}
 
 	void processOutput(float* output, int outputStride, int frames) override {
-		// bool isMasterCached = isMaster();
+		bool isMasterCached = isMaster();
 		float engineSampleRate = APP->engine->getSampleRate();
 		float sampleRateRatio = engineSampleRate / deviceSampleRate;
 
 		if (deviceNumOutputs > 0) {
+			if (!isMasterCached && (int) engineInputBuffer.size() < frames * sampleRateRatio)
+				inputFillController.onUnderrun();
 			// Set up sample rate converter
 			inputSrc.setRates(engineSampleRate, deviceSampleRate);
 			inputSrc.setChannels(deviceNumOutputs);
@@ -142,28 +281,64 @@ struct AudioPort : audio::Port {
 
 		// DEBUG("%p: %d block, engineInputBuffer left %d", this, frames, (int) engineInputBuffer.size());
 
-		// If the engine input buffer is too full, clear it to keep latency low.
-		int maxEngineFrames = (int) std::ceil(frames * sampleRateRatio * 2.0) - 1;
+		int targetEngineFrames = (int) std::ceil(frames * sampleRateRatio);
+		int maxEngineFrames = targetEngineFrames * 4;
 		if ((int) engineInputBuffer.size() > maxEngineFrames) {
+			// If the engine input buffer is much too full, clear it to keep latency low.
 			engineInputBuffer.clear();
-			// DEBUG("%p: clearing engine input", this);
+			inputFillController.onReset();
+		}
+		else if (isMasterCached) {
+			inputFillController.reset();
+			inputSrc.setRatioCorrection(1.0);
+		}
+		else if (deviceNumOutputs > 0) {
+			// Measure fill after this block is consumed, so the engine refills it before the next block.
+			double correction = inputFillController.process(engineInputBuffer.size(), targetEngineFrames, engineSampleRate, frames / deviceSampleRate);
+			inputSrc.setRatioCorrection(correction);
 		}
 
 		// DEBUG("%p %s:\tframes %d requestedEngineFrames %d\toutputBuffer %d engineInputBuffer %d\t", this, isMasterCached ? "master" : "secondary", frames, requestedEngineFrames, engineOutputBuffer.size(), engineInputBuffer.size());
 	}
 
+	/** Returns drift compensation statistics of the engine -> device buffer. */
+	BufferFillController::Stats getInputFillStats() {
+		return inputFillController.getStats();
+	}
+
+	/** Returns drift compensation statistics of the device -> engine buffer. */
+	BufferFillController::Stats getOutputFillStats() {
+		return outputFillController.getStats();
+	}
+
+	void resetFillControllers() {
+		inputFillController.reset();
+		outputFillController.reset();
+		inputSrc.setRatioCorrection(1.0);
+		outputSrc.setRatioCorrection(1.0);
+	}
+
 	void onStartStream() override {
 		engineInputBuffer.clear();
 		engineOutputBuffer.clear();
+		resetFillControllers();
+		inputFillController.resetStats();
+		outputFillController.resetStats();
 		// DEBUG("onStartStream");
 	}
 
 	void onStopStream() override {
+		for (BufferFillController* controller : {&outputFillController, &inputFillController}) {
+			BufferFillController::Stats stats = controller->getStats();
+			if (stats.resets > 0 || stats.underruns > 0)
+				INFO("Audio port %s drift compensation: %lld resets, %lld underruns, last correction %+.1f ppm", (controller == &outputFillController) ? "input" : "output", (long long) stats.resets, (long long) stats.underruns, stats.correctionPpm);
+		}
 		deviceNumInputs = 0;
 		deviceNumOutputs = 0;
 		deviceSampleRate = 0.f;
 		engineInputBuffer.clear();
 		engineOutputBuffer.clear();
+		resetFillControllers();
 		// We can be in an Engine write-lock here (e.g. onReset() calls this indirectly), so use non-locking master module API.
 		// setMaster(false);
 		if (APP->engine->getMasterModule() == module)
@@ -248,6 +423,7 @@ struct Audio : Module {
 	void onSampleRateChange(const SampleRateChangeEvent& e) override {
 		port.engineInputBuffer.clear();
 		port.engineOutputBuffer.clear();
+		port.resetFillControllers();
 
 		for (int i = 0; i < NUM_AUDIO_INPUTS; i++) {
 			dcFilters[i].setCutoffFreq(10.f * e.sampleTime);
@@ -614,6 +790,16 @@ struct AudioWidget : ModuleWidget {
 		));
 
 		menu->addChild(createBoolPtrMenuItem("DC blocker", "", &module->dcFilterEnabled));
+
+		if (!module->port.isMaster() && module->port.getDevice()) {
+			menu->addChild(new MenuSeparator);
+			menu->addChild(createMenuLabel("Drift compensation"));
+			auto addStats = [&](std::string name, BufferFillController::Stats stats) {
+				menu->addChild(createMenuLabel(string::f("%s: %.0f/%.0f frames, %+.1f ppm, %lld resets, %lld underruns", name.c_str(), stats.fill, stats.targetFill, stats.correctionPpm, (long long) stats.resets, (long long) stats.underruns)));
+			};
+			addStats("Device input", module->port.getOutputFillStats());
+			addStats("Device output", module->port.getInputFillStats());
+		}
 	}
 };
 
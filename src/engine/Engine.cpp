@@ -6,6 +6,12 @@
 #include <atomic>
 #include <tuple>
 #include <pthread.h>
+#if defined ARCH_LIN
+	#include <climits>
+	#include <unistd.h> // for syscall
+	#include <sys/syscall.h>
+	#include <linux/futex.h>
+#endif
 
 #include <engine/Engine.hpp>
 #include <settings.hpp>
@@ -14,6 +20,7 @@
 #include <patch.hpp>
 #include <plugin.hpp>
 #include <mutex.hpp>
+#include <audio.hpp>
 #include <simd/common.hpp>
 
 
@@ -21,38 +28,9 @@ namespace rack {
 namespace engine {
 
 
-/** Barrier based on mutexes.
-Not finished or tested, do not use.
-*/
-struct Barrier {
-	int count = 0;
-	uint8_t step = 0;
-	int threads = 0;
-
-	std::mutex mutex;
-	std::condition_variable cv;
-
-	void setThreads(int threads) {
-		this->threads = threads;
-	}
-
-	void wait() {
-		std::unique_lock<std::mutex> lock(mutex);
-		uint8_t s = step;
-		if (++count >= threads) {
-			// We're the last thread. Reset next phase.
-			count = 0;
-			// Allow other threads to exit wait()
-			step++;
-			cv.notify_all();
-			return;
-		}
-
-		cv.wait(lock, [&] {
-			return step != s;
-		});
-	}
-};
+// Arbitrary prime number, like Module's CPU meter divider, so barrier waits are sampled at uncorrelated frames.
+static const int METRICS_DIVIDER = 37;
+static const int METRICS_MAX_THREADS = 64;
 
 
 /** 2-phase barrier based on spin-locking.
@@ -90,18 +68,34 @@ struct SpinBarrier {
 };
 
 
-/** Barrier that spin-locks until yield() is called, and then all threads switch to a mutex.
-yield() should be called if it is likely that all threads will block for a while and continuing to spin-lock is unnecessary.
-Saves CPU power after yield is called.
+/** Barrier that spin-locks for short waits and parks threads for long waits.
+
+The spin duration adapts to recently measured wait times.
+Waits between frames of a block are usually short enough that spinning gives the lowest latency, while waits much longer than the cost of parking and waking a thread (such as when one thread processes a heavy module) are cheaper to park through.
+yield() should be called if it is likely that all threads will block for a while, such as between blocks, so waiting threads park immediately.
+On Linux, threads park on a futex. Elsewhere they park on a condition variable.
 */
-struct HybridBarrier {
+struct AdaptiveBarrier {
+	/** Spin at least this long, since parking and waking costs roughly this much. */
+	static constexpr float MIN_SPIN_TIME = 2e-6f;
+	/** Waits longer than this are considered long, so threads spin for only MIN_SPIN_TIME before parking. */
+	static constexpr float MAX_SPIN_TIME = 50e-6f;
+
 	std::atomic<int> count{0};
-	std::atomic<uint8_t> step{0};
+	/** 32-bit so it can be used as a futex word. */
+	std::atomic<uint32_t> step{0};
 	int threads = 0;
 
 	std::atomic<bool> yielded{false};
+	/** Number of threads currently parked, so the last thread only wakes them if needed. */
+	std::atomic<int> parked{0};
+	/** Exponential moving average of wait durations in seconds. */
+	std::atomic<float> averageWait{0.f};
+
+#if !defined ARCH_LIN
 	std::mutex mutex;
 	std::condition_variable cv;
+#endif
 
 	void setThreads(int threads) {
 		this->threads = threads;
@@ -111,36 +105,90 @@ struct HybridBarrier {
 		yielded = true;
 	}
 
+	float getSpinTime() {
+		float wait = averageWait.load(std::memory_order_relaxed);
+		if (wait > MAX_SPIN_TIME)
+			return MIN_SPIN_TIME;
+		return std::fmin(std::fmax(2.f * wait, MIN_SPIN_TIME), MAX_SPIN_TIME);
+	}
+
+	void recordWait(float wait) {
+		// Races between threads only lose a sample, which is harmless for an average.
+		float average = averageWait.load(std::memory_order_relaxed);
+		averageWait.store(average + (wait - average) * 0.125f, std::memory_order_relaxed);
+	}
+
 	void wait() {
-		uint8_t s = step;
+		uint32_t s = step;
 		if (count.fetch_add(1, std::memory_order_acquire) + 1 >= threads) {
 			// We're the last thread. Reset next phase.
 			count = 0;
-			bool wasYielded = yielded;
 			yielded = false;
 			// Allow other threads to exit wait()
 			step++;
-			if (wasYielded) {
-				std::unique_lock<std::mutex> lock(mutex);
-				cv.notify_all();
-			}
+			if (parked > 0)
+				wakeAll();
 			return;
 		}
 
-		// Spin until the last thread begins waiting
-		while (!yielded.load(std::memory_order_relaxed)) {
-			if (step.load(std::memory_order_relaxed) != s)
-				return;
+		// Spin until the last thread begins waiting, unless it's likely to take a while
+		double startTime = system::getTime();
+		float spinTime = getSpinTime();
+		double time = startTime;
+		bool spinYielded = false;
+		while (true) {
+			if (yielded.load(std::memory_order_relaxed)) {
+				spinYielded = true;
+				break;
+			}
+			// Checking the time is slower than a pause, so only check occasionally.
+			for (int i = 0; i < 32; i++) {
+				if (step.load(std::memory_order_relaxed) != s) {
+					recordWait(system::getTime() - startTime);
+					return;
+				}
 #if defined ARCH_X64
-			__builtin_ia32_pause();
+				__builtin_ia32_pause();
 #endif
+			}
+			time = system::getTime();
+			if (time - startTime >= spinTime)
+				break;
 		}
 
-		// Wait on mutex CV
+		park(s);
+		// Yielded waits last until the next block, so they would make the average useless for choosing a spin time.
+		// The last thread resets `yielded` before releasing us, so it must be checked before parking.
+		if (!spinYielded)
+			recordWait(system::getTime() - startTime);
+	}
+
+	/** Blocks until `step` is no longer `s`. */
+	void park(uint32_t s) {
+		// Sequentially consistent ordering of `parked` and `step` ensures that either this thread sees the new step, or the last thread sees it parked.
+		parked++;
+#if defined ARCH_LIN
+		while (step.load() == s) {
+			syscall(SYS_futex, (uint32_t*) &step, FUTEX_WAIT_PRIVATE, s, NULL, NULL, 0);
+		}
+#else
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [&] {
+				return step != s;
+			});
+		}
+#endif
+		parked--;
+	}
+
+	void wakeAll() {
+#if defined ARCH_LIN
+		syscall(SYS_futex, (uint32_t*) &step, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
 		std::unique_lock<std::mutex> lock(mutex);
-		cv.wait(lock, [&] {
-			return step != s;
-		});
+		cv.notify_all();
+#endif
 	}
 };
 
@@ -158,17 +206,11 @@ struct EngineWorker {
 		}
 		running = true;
 
-		// Launch thread with same scheduling policy and priority as current thread (ID 0)
+		// Launch thread with same scheduling policy and priority as current thread (ID 0).
+		// run() then applies CPU affinity and real-time priority from settings.
 		int err;
 		err = pthread_create(&thread, NULL, [](void* p) -> void* {
 			EngineWorker* that = (EngineWorker*) p;
-
-			// int policy;
-			// sched_param param;
-			// if (!pthread_getschedparam(pthread_self(), &policy, &param)) {
-			// 	DEBUG("EngineWorker %d thread launched with policy %d priority %d", that->id, policy, param.sched_priority);
-			// }
-
 			that->run();
 			return NULL;
 		}, this);
@@ -219,6 +261,13 @@ struct Engine::Internal {
 	double meterLastAverage = 0.0;
 	double meterLastMax = 0.0;
 
+	// Metrics
+	DurationHistogram blockDurationHistogram;
+	std::atomic<int64_t> deadlineMissCount{0};
+	DurationHistogram barrierWaitHistograms[METRICS_MAX_THREADS];
+	/** CPU time in seconds consumed by each engine thread since it was launched, sampled rarely since it requires a syscall. */
+	std::atomic<double> threadCpuTimes[METRICS_MAX_THREADS] = {};
+
 	// Parameter smoothing
 	Module* smoothModule = NULL;
 	int smoothParamId = 0;
@@ -234,9 +283,29 @@ struct Engine::Internal {
 	std::mutex blockMutex;
 
 	int threadCount = 0;
+	/** Scheduling settings the current workers were launched with */
+	std::vector<int> threadCpus;
+	int threadPriority = 0;
 	std::vector<EngineWorker> workers;
-	HybridBarrier engineBarrier;
-	HybridBarrier workerBarrier;
+	/** Indexed by thread ID */
+	std::vector<Engine::ThreadInfo> threadInfos;
+	/** IDs of threads whose info was recorded since logThreadInfos() was last called */
+	std::vector<int> unloggedThreadIds;
+	std::mutex threadInfosMutex;
+	/** If set, `threadConfig` is used instead of the global thread settings.
+	Otherwise `threadConfig` holds a copy of `settings::threadCpus` and `settings::threadPriority`, so the audio thread never reads the global vector.
+	*/
+	bool threadConfigOverridden = false;
+	Engine::ThreadConfig threadConfig;
+	std::mutex threadConfigMutex;
+	/** Incremented when `threadConfig` changes */
+	std::atomic<uint32_t> threadConfigVersion{1};
+	/** Copy of `threadConfig` owned by the thread calling stepBlock(), refreshed when the version changes */
+	uint32_t blockThreadConfigVersion = 0;
+	bool blockThreadConfigOverridden = false;
+	Engine::ThreadConfig blockThreadConfig;
+	AdaptiveBarrier engineBarrier;
+	AdaptiveBarrier workerBarrier;
 	std::atomic<int> workerModuleIndex;
 	// For worker threads
 	Context* context;
@@ -267,9 +336,41 @@ static void Engine_updateExpander_NoLock(Engine* that, Module* module, uint8_t s
 }
 
 
-static void Engine_relaunchWorkers(Engine* that, int threadCount) {
+/** Applies the CPUs and priority the workers were launched with to the current worker thread and records what the OS actually applied.
+*/
+static void Engine_configureThread(Engine* that, int threadId) {
+	Engine::Internal* internal = that->internal;
+	Engine::ThreadInfo info;
+	info.threadId = threadId;
+
+	if (threadId > 0) {
+		if (!internal->threadCpus.empty()) {
+			int cpu = internal->threadCpus[(threadId - 1) % internal->threadCpus.size()];
+			info.affinityApplied = system::setThreadAffinity({cpu});
+		}
+		if (internal->threadPriority > 0) {
+			info.priorityApplied = system::setThreadRealTimePriority(internal->threadPriority);
+		}
+	}
+
+	info.cpus = system::getThreadAffinity();
+	info.scheduling = system::getThreadScheduling();
+
+	// Thread 0 is the audio thread, so logging is left to logThreadInfos()
+	std::lock_guard<std::mutex> lock(internal->threadInfosMutex);
+	if (threadId < (int) internal->threadInfos.size()) {
+		internal->threadInfos[threadId] = info;
+		internal->unloggedThreadIds.push_back(threadId);
+	}
+}
+
+
+/** Relaunches workers if the thread count changed, or if `schedulingChanged` is set.
+Workers are pinned and prioritized with `blockThreadConfig`.
+*/
+static void Engine_relaunchWorkers(Engine* that, int threadCount, bool schedulingChanged) {
 	Engine::Internal* internal = that->internal;
-	if (threadCount == internal->threadCount)
+	if (threadCount == internal->threadCount && !(threadCount > 0 && schedulingChanged))
 		return;
 
 	if (internal->threadCount > 0) {
@@ -288,12 +389,27 @@ static void Engine_relaunchWorkers(Engine* that, int threadCount) {
 
 	// Configure engine
 	internal->threadCount = threadCount;
+	internal->threadCpus = internal->blockThreadConfig.cpus;
+	internal->threadPriority = internal->blockThreadConfig.priority;
+	{
+		std::lock_guard<std::mutex> lock(internal->threadInfosMutex);
+		internal->threadInfos.clear();
+		internal->threadInfos.resize(threadCount);
+		internal->unloggedThreadIds.clear();
+	}
+	// Worker threads are new, so their CPU times restart from zero
+	for (int i = 0; i < METRICS_MAX_THREADS; i++) {
+		internal->threadCpuTimes[i] = 0.0;
+	}
 
 	// Set barrier counts
 	internal->engineBarrier.setThreads(threadCount);
 	internal->workerBarrier.setThreads(threadCount);
 
 	if (threadCount > 0) {
+		// Record scheduling of the current thread (ID 0), which is owned by the audio driver and left unchanged
+		Engine_configureThread(that, 0);
+
 		// Create and start engine workers
 		internal->workers.resize(threadCount - 1);
 		for (int id = 1; id < threadCount; id++) {
@@ -332,6 +448,24 @@ static void Engine_stepWorker(Engine* that, int threadId) {
 }
 
 
+/** Waits on the worker barrier, sampling the wait duration every METRICS_DIVIDER frames.
+`frame` must be read before the barrier, since the main thread advances it afterwards.
+*/
+static void Engine_waitWorkerBarrier(Engine* that, int threadId, int64_t frame) {
+	Engine::Internal* internal = that->internal;
+	if (frame % METRICS_DIVIDER != 0 || threadId >= METRICS_MAX_THREADS) {
+		internal->workerBarrier.wait();
+		return;
+	}
+	if (frame % (METRICS_DIVIDER * 64) == 0)
+		internal->threadCpuTimes[threadId].store(system::getThreadTime(), std::memory_order_relaxed);
+	double startTime = system::getTime();
+	internal->workerBarrier.wait();
+	double endTime = system::getTime();
+	internal->barrierWaitHistograms[threadId].add(endTime - startTime);
+}
+
+
 static void Engine_stepFrameCables(Engine* that) {
 	auto finitize = [](float x) {
 		return std::isfinite(x) ? x : 0.f;
@@ -436,7 +570,7 @@ static void Engine_stepFrame(Engine* that) {
 	internal->workerModuleIndex = 0;
 	internal->engineBarrier.wait();
 	Engine_stepWorker(that, 0);
-	internal->workerBarrier.wait();
+	Engine_waitWorkerBarrier(that, 0, internal->frame);
 
 	Engine_stepFrameCables(that);
 
@@ -472,6 +606,8 @@ Engine::Engine() {
 	internal = new Internal;
 
 	internal->context = contextGet();
+	internal->threadConfig.cpus = settings::threadCpus;
+	internal->threadConfig.priority = settings::threadPriority;
 	setSuggestedSampleRate(0.f);
 }
 
@@ -487,7 +623,7 @@ Engine::~Engine() {
 		internal->fallbackThread.join();
 
 	// Shut down workers
-	Engine_relaunchWorkers(this, 0);
+	Engine_relaunchWorkers(this, 0, false);
 
 	// Clear modules, cables, etc
 	clear();
@@ -552,20 +688,41 @@ void Engine::stepBlock(int frames) {
 	}
 
 	// Launch workers
-	Engine_relaunchWorkers(this, settings::threadCount);
+	bool schedulingChanged = false;
+	uint32_t threadConfigVersion = internal->threadConfigVersion.load(std::memory_order_acquire);
+	if (threadConfigVersion != internal->blockThreadConfigVersion) {
+		// Only copy the config when it has changed, which is rare
+		std::lock_guard<std::mutex> lock(internal->threadConfigMutex);
+		internal->blockThreadConfigOverridden = internal->threadConfigOverridden;
+		internal->blockThreadConfig = internal->threadConfig;
+		internal->blockThreadConfigVersion = internal->threadConfigVersion;
+		schedulingChanged = true;
+	}
+	int threadCount = internal->blockThreadConfigOverridden ? internal->blockThreadConfig.threadCount : settings::threadCount;
+	Engine_relaunchWorkers(this, threadCount, schedulingChanged);
 
 	// Step individual frames
 	for (int i = 0; i < frames; i++) {
 		Engine_stepFrame(this);
 	}
 
-	yieldWorkers();
+	// Workers wait on the engine barrier until the next block, so park them immediately and keep that wait out of the barrier's average.
+	internal->engineBarrier.yield();
+
+	// Publish lights to the UI
+	for (Module* module : internal->modules) {
+		module->publishSnapshot();
+	}
 
 	internal->block++;
 
 	// Stop timer
 	double endTime = system::getTime();
-	double meter = (endTime - startTime) / (frames * internal->sampleTime);
+	double duration = endTime - startTime;
+	double meter = duration / (frames * internal->sampleTime);
+	internal->blockDurationHistogram.add(duration);
+	if (meter > 1.0)
+		internal->deadlineMissCount++;
 	internal->meterTotal += meter;
 	internal->meterMax = std::fmax(internal->meterMax, meter);
 	internal->meterCount++;
@@ -662,6 +819,35 @@ float Engine::getSampleTime() {
 }
 
 
+Engine::ThreadConfig Engine::getThreadConfig() {
+	std::lock_guard<std::mutex> lock(internal->threadConfigMutex);
+	if (internal->threadConfigOverridden)
+		return internal->threadConfig;
+	ThreadConfig config = internal->threadConfig;
+	config.threadCount = settings::threadCount;
+	return config;
+}
+
+
+void Engine::setThreadConfig(const ThreadConfig& config) {
+	std::lock_guard<std::mutex> lock(internal->threadConfigMutex);
+	internal->threadConfig = config;
+	internal->threadConfig.threadCount = std::max(config.threadCount, 1);
+	internal->threadConfigOverridden = true;
+	internal->threadConfigVersion++;
+}
+
+
+void Engine::clearThreadConfig() {
+	std::lock_guard<std::mutex> lock(internal->threadConfigMutex);
+	internal->threadConfig = ThreadConfig();
+	internal->threadConfig.cpus = settings::threadCpus;
+	internal->threadConfig.priority = settings::threadPriority;
+	internal->threadConfigOverridden = false;
+	internal->threadConfigVersion++;
+}
+
+
 void Engine::yieldWorkers() {
 	internal->workerBarrier.yield();
 }
@@ -697,6 +883,28 @@ double Engine::getBlockDuration() {
 }
 
 
+std::vector<Engine::ThreadInfo> Engine::getThreadInfos() {
+	std::lock_guard<std::mutex> lock(internal->threadInfosMutex);
+	return internal->threadInfos;
+}
+
+
+void Engine::logThreadInfos() {
+	std::vector<ThreadInfo> infos;
+	{
+		std::lock_guard<std::mutex> lock(internal->threadInfosMutex);
+		for (int threadId : internal->unloggedThreadIds) {
+			if (threadId < (int) internal->threadInfos.size())
+				infos.push_back(internal->threadInfos[threadId]);
+		}
+		internal->unloggedThreadIds.clear();
+	}
+	for (const ThreadInfo& info : infos) {
+		INFO("Engine thread %d scheduling: %s, %d CPUs allowed", info.threadId, info.scheduling.c_str(), (int) info.cpus.size());
+	}
+}
+
+
 double Engine::getMeterAverage() {
 	return internal->meterLastAverage;
 }
@@ -707,6 +915,97 @@ double Engine::getMeterMax() {
 }
 
 
+DurationHistogram* Engine::getBlockDurationHistogram() {
+	return &internal->blockDurationHistogram;
+}
+
+
+DurationHistogram* Engine::getBarrierWaitHistogram(int threadId) {
+	if (!(0 <= threadId && threadId < METRICS_MAX_THREADS))
+		return NULL;
+	return &internal->barrierWaitHistograms[threadId];
+}
+
+
+int64_t Engine::getDeadlineMissCount() {
+	return internal->deadlineMissCount;
+}
+
+
+void Engine::resetMetrics() {
+	SharedLock<SharedMutex> lock(internal->mutex);
+	internal->blockDurationHistogram.reset();
+	internal->deadlineMissCount = 0;
+	for (int i = 0; i < METRICS_MAX_THREADS; i++) {
+		internal->barrierWaitHistograms[i].reset();
+	}
+	for (Module* module : internal->modules) {
+		module->getProcessHistogram()->reset();
+	}
+}
+
+
+json_t* Engine::metricsToJson() {
+	SharedLock<SharedMutex> lock(internal->mutex);
+	json_t* rootJ = json_object();
+
+	json_object_set_new(rootJ, "time", json_real(system::getUnixTime()));
+	json_object_set_new(rootJ, "sampleRate", json_real(internal->sampleRate));
+	json_object_set_new(rootJ, "blockFrames", json_integer(internal->blockFrames));
+	json_object_set_new(rootJ, "threadCount", json_integer(internal->threadCount));
+	json_object_set_new(rootJ, "meterAverage", json_real(internal->meterLastAverage));
+	json_object_set_new(rootJ, "meterMax", json_real(internal->meterLastMax));
+	json_object_set_new(rootJ, "deadlineMisses", json_integer(internal->deadlineMissCount));
+	json_object_set_new(rootJ, "blockDuration", internal->blockDurationHistogram.toJson());
+
+	// barrierWait
+	json_t* barrierWaitJ = json_array();
+	for (int i = 0; i < std::min(internal->threadCount, METRICS_MAX_THREADS); i++) {
+		json_array_append_new(barrierWaitJ, internal->barrierWaitHistograms[i].toJson());
+	}
+	json_object_set_new(rootJ, "barrierWait", barrierWaitJ);
+
+	// threads
+	json_t* threadsJ = json_array();
+	for (const ThreadInfo& info : getThreadInfos()) {
+		json_t* threadJ = json_object();
+		json_object_set_new(threadJ, "id", json_integer(info.threadId));
+		json_object_set_new(threadJ, "scheduling", json_string(info.scheduling.c_str()));
+		json_t* cpusJ = json_array();
+		for (int cpu : info.cpus) {
+			json_array_append_new(cpusJ, json_integer(cpu));
+		}
+		json_object_set_new(threadJ, "cpus", cpusJ);
+		json_object_set_new(threadJ, "affinityApplied", json_boolean(info.affinityApplied));
+		json_object_set_new(threadJ, "priorityApplied", json_boolean(info.priorityApplied));
+		if (info.threadId < METRICS_MAX_THREADS)
+			json_object_set_new(threadJ, "cpuTime", json_real(internal->threadCpuTimes[info.threadId].load(std::memory_order_relaxed)));
+		json_array_append_new(threadsJ, threadJ);
+	}
+	json_object_set_new(rootJ, "threads", threadsJ);
+
+	// modules
+	json_t* modulesJ = json_array();
+	for (Module* module : internal->modules) {
+		DurationHistogram* histogram = module->getProcessHistogram();
+		if (histogram->getCount() == 0)
+			continue;
+		json_t* moduleJ = histogram->toJson();
+		json_object_set_new(moduleJ, "id", json_integer(module->id));
+		if (module->model) {
+			json_object_set_new(moduleJ, "plugin", json_string(module->model->plugin->slug.c_str()));
+			json_object_set_new(moduleJ, "model", json_string(module->model->slug.c_str()));
+		}
+		json_array_append_new(modulesJ, moduleJ);
+	}
+	json_object_set_new(rootJ, "modules", modulesJ);
+
+	json_object_set_new(rootJ, "audioDevices", audio::devicesMetricsToJson());
+
+	return rootJ;
+}
+
+
 size_t Engine::getNumModules() {
 	return internal->modules.size();
 }
@@ -1258,6 +1557,12 @@ json_t* Engine::toJson() {
 
 
 void Engine::fromJson(json_t* rootJ) {
+	std::vector<Module*> modules = modulesFromJson(rootJ);
+	fromJson(rootJ, modules);
+}
+
+
+std::vector<Module*> Engine::modulesFromJson(json_t* rootJ) {
 	clear();
 
 	// modules
@@ -1266,7 +1571,7 @@ void Engine::fromJson(json_t* rootJ) {
 	std::vector<Module*> modules;
 	json_t* modulesJ = json_object_get(rootJ, "modules");
 	if (!modulesJ)
-		return;
+		return modules;
 	size_t moduleIndex;
 	json_t* moduleJ;
 	json_array_foreach(modulesJ, moduleIndex, moduleJ) {
@@ -1301,7 +1606,11 @@ void Engine::fromJson(json_t* rootJ) {
 
 		modules.push_back(module);
 	}
+	return modules;
+}
+
 
+void Engine::fromJson(json_t* rootJ, const std::vector<Module*>& modules) {
 	std::lock_guard<SharedMutex> lock(internal->mutex);
 
 	// Add modules
@@ -1353,13 +1662,15 @@ void EngineWorker::run() {
 	contextSet(engine->internal->context);
 	system::setThreadName(string::f("Worker %d", id));
 	system::resetFpuFlags();
+	Engine_configureThread(engine, id);
 
 	while (true) {
 		engine->internal->engineBarrier.wait();
 		if (!running)
 			return;
+		int64_t frame = engine->internal->frame;
 		Engine_stepWorker(engine, id);
-		engine->internal->workerBarrier.wait();
+		Engine_waitWorkerBarrier(engine, id, frame);
 	}
 }
 
@@ -1401,5 +1712,91 @@ void Engine::startFallbackThread() {
 }
 
 
+struct BarrierBenchmarkResult {
+	double wallTime = 0.0;
+	double cpuTime = 0.0;
+	double maxBlockDuration = 0.0;
+};
+
+
+/** Steps empty frames on `threadCount` threads with the same barrier protocol as stepBlock(), and measures the time spent.
+If `blockPeriod` is positive, blocks start at that interval like an audio driver's callback. Otherwise they run back-to-back.
+*/
+static BarrierBenchmarkResult Engine_benchmarkBarrierRun(int threadCount, int blocks, int blockFrames, double blockPeriod) {
+	AdaptiveBarrier engineBarrier;
+	AdaptiveBarrier workerBarrier;
+	engineBarrier.setThreads(threadCount);
+	workerBarrier.setThreads(threadCount);
+	std::atomic<bool> running{true};
+	std::vector<double> cpuTimes(threadCount, 0.0);
+
+	std::vector<std::thread> workers;
+	for (int id = 1; id < threadCount; id++) {
+		workers.emplace_back([&, id]() {
+			double cpuStartTime = system::getThreadTime();
+			while (true) {
+				engineBarrier.wait();
+				if (!running)
+					break;
+				workerBarrier.wait();
+			}
+			cpuTimes[id] = system::getThreadTime() - cpuStartTime;
+		});
+	}
+
+	BarrierBenchmarkResult result;
+	double cpuStartTime = system::getThreadTime();
+	double startTime = system::getTime();
+	for (int block = 0; block < blocks; block++) {
+		double blockStartTime = system::getTime();
+		for (int frame = 0; frame < blockFrames; frame++) {
+			engineBarrier.wait();
+			workerBarrier.wait();
+		}
+		engineBarrier.yield();
+		double blockDuration = system::getTime() - blockStartTime;
+		result.maxBlockDuration = std::max(result.maxBlockDuration, blockDuration);
+
+		if (blockPeriod > 0.0) {
+			double sleepDuration = startTime + (block + 1) * blockPeriod - system::getTime();
+			if (sleepDuration > 0.0)
+				system::sleep(sleepDuration);
+		}
+	}
+	result.wallTime = system::getTime() - startTime;
+	cpuTimes[0] = system::getThreadTime() - cpuStartTime;
+
+	// Stop workers
+	running = false;
+	engineBarrier.wait();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+
+	for (double cpuTime : cpuTimes) {
+		result.cpuTime += cpuTime;
+	}
+	return result;
+}
+
+
+void Engine::benchmarkBarrier(int maxThreads, int blocks) {
+	if (maxThreads <= 0)
+		maxThreads = system::getLogicalCoreCount();
+	// Typical audio driver block of 256 frames at 48 kHz
+	const int blockFrames = 256;
+	const double blockPeriod = blockFrames / 48000.0;
+
+	for (int threadCount = 1; threadCount <= maxThreads; threadCount++) {
+		// Latency and throughput: frames stepped back-to-back, so each frame costs only its two barrier waits
+		BarrierBenchmarkResult fast = Engine_benchmarkBarrierRun(threadCount, blocks, blockFrames, 0.0);
+		double frameDuration = fast.wallTime / (blocks * blockFrames);
+		// CPU usage: blocks paced like an audio driver, so threads are idle between blocks
+		BarrierBenchmarkResult paced = Engine_benchmarkBarrierRun(threadCount, blocks, blockFrames, blockPeriod);
+		INFO("Barrier with %d threads: %.2f us per frame (%.0f frames/s), paced at %d frames per %.2f ms: max block %.3f ms, %.1f%% CPU total", threadCount, frameDuration * 1e6, 1.0 / frameDuration, blockFrames, blockPeriod * 1e3, paced.maxBlockDuration * 1e3, paced.cpuTime / paced.wallTime * 100.0);
+	}
+}
+
+
 } // namespace engine
 } // namespace rack
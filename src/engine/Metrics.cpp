@@ -0,0 +1,93 @@
+#include <cmath>
+
+#include <engine/Metrics.hpp>
+
+
+namespace rack {
+namespace engine {
+
+
+static const double HISTOGRAM_MIN_DURATION = 100e-9;
+
+
+DurationHistogram::DurationHistogram() {
+	reset();
+}
+
+
+void DurationHistogram::reset() {
+	for (int i = 0; i < BINS; i++) {
+		counts[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+
+void DurationHistogram::add(double duration) {
+	int bin = 0;
+	if (duration > HISTOGRAM_MIN_DURATION)
+		bin = (int) std::ceil(2.0 * std::log2(duration / HISTOGRAM_MIN_DURATION));
+	bin = std::max(0, std::min(bin, BINS - 1));
+	counts[bin].fetch_add(1, std::memory_order_relaxed);
+}
+
+
+uint64_t DurationHistogram::getCount() {
+	uint64_t count = 0;
+	for (int i = 0; i < BINS; i++) {
+		count += counts[i].load(std::memory_order_relaxed);
+	}
+	return count;
+}
+
+
+double DurationHistogram::getQuantile(double quantile) {
+	uint64_t binCounts[BINS];
+	uint64_t count = 0;
+	for (int i = 0; i < BINS; i++) {
+		binCounts[i] = counts[i].load(std::memory_order_relaxed);
+		count += binCounts[i];
+	}
+	if (count == 0)
+		return 0.0;
+
+	uint64_t rank = (uint64_t) std::ceil(quantile * count);
+	uint64_t cumulative = 0;
+	for (int i = 0; i < BINS; i++) {
+		cumulative += binCounts[i];
+		if (cumulative >= rank && cumulative > 0)
+			return getBinEdge(i);
+	}
+	return getBinEdge(BINS - 1);
+}
+
+
+double DurationHistogram::getBinEdge(int bin) {
+	return HISTOGRAM_MIN_DURATION * std::exp2(bin / 2.0);
+}
+
+
+json_t* DurationHistogram::toJson() {
+	json_t* rootJ = json_object();
+	json_object_set_new(rootJ, "count", json_integer(getCount()));
+	json_object_set_new(rootJ, "p50", json_real(getQuantile(0.50)));
+	json_object_set_new(rootJ, "p99", json_real(getQuantile(0.99)));
+	json_object_set_new(rootJ, "max", json_real(getQuantile(1.0)));
+
+	// Sparse list of [binEdge, count] pairs
+	json_t* binsJ = json_array();
+	for (int i = 0; i < BINS; i++) {
+		uint64_t count = counts[i].load(std::memory_order_relaxed);
+		if (count == 0)
+			continue;
+		json_t* binJ = json_array();
+		json_array_append_new(binJ, json_real(getBinEdge(i)));
+		json_array_append_new(binJ, json_integer(count));
+		json_array_append_new(binsJ, binJ);
+	}
+	json_object_set_new(rootJ, "bins", binsJ);
+	return rootJ;
+}
+
+
+} // namespace engine
+} // namespace rack
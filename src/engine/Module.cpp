@@ -1,5 +1,8 @@
+#include <atomic>
+
 #include <engine/Module.hpp>
 #include <engine/Engine.hpp>
+#include <engine/Metrics.hpp>
 #include <plugin.hpp>
 #include <system.hpp>
 #include <settings.hpp>
@@ -19,14 +22,43 @@ static const int METER_BUFFER_LEN = 32;
 static const float METER_TIME = 1.f;
 
 
+/** Light values published by the engine for the UI thread */
+struct ModuleSnapshot {
+	std::vector<float> lights;
+	/** Peak plug light brightness since the previous snapshot, 3 per input followed by 3 per output */
+	std::vector<float> plugLights;
+};
+
+
+/** Set in `middleSnapshot` when the engine has published a snapshot that the UI hasn't acquired. */
+static const int SNAPSHOT_FRESH = 4;
+
+
 struct Module::Internal {
 	bool bypassed = false;
 
+	/** Triple buffer of snapshots.
+	The engine writes `snapshots[backSnapshot]` and swaps it with the middle, and the UI swaps the middle with `snapshots[frontSnapshot]` to read it, so neither thread waits or sees a partial snapshot.
+	*/
+	ModuleSnapshot snapshots[3];
+	int backSnapshot = 0;
+	std::atomic<int> middleSnapshot{1};
+	int frontSnapshot = 2;
+	/** Set by the UI after acquiring a snapshot, so the engine only copies lights as often as the UI draws them. */
+	std::atomic<bool> snapshotRequested{true};
+	/** Peak plug light brightness since the previous snapshot, 3 per input followed by 3 per output.
+	Written by the engine. The UI smooths the published peaks into each Port's `plugLights`.
+	*/
+	std::vector<float> plugLightPeaks;
+	double snapshotTime = NAN;
+
 	int meterSamples = 0;
 	float meterDurationTotal = 0.f;
 
 	float meterBuffer[METER_BUFFER_LEN] = {};
 	int meterIndex = 0;
+
+	DurationHistogram processHistogram;
 };
 
 
@@ -308,24 +340,24 @@ int Module::meterIndex() {
 }
 
 
-static void Port_step(Port* that, float deltaTime) {
-	// Set plug lights
+DurationHistogram* Module::getProcessHistogram() {
+	return &internal->processHistogram;
+}
+
+
+/** Accumulates the peak plug light brightness in `peaks` until the next snapshot. The UI applies light decay. */
+static void Port_step(Port* that, float* peaks) {
 	if (that->channels == 0) {
-		that->plugLights[0].setBrightness(0.f);
-		that->plugLights[1].setBrightness(0.f);
-		that->plugLights[2].setBrightness(0.f);
+		// Leave lights at their peak
 	}
 	else if (that->channels == 1) {
 		float v = that->getVoltage() / 10.f;
-		that->plugLights[0].setSmoothBrightness(-v, deltaTime);
-		that->plugLights[1].setSmoothBrightness(v, deltaTime);
-		that->plugLights[2].setBrightness(0.f);
+		peaks[0] = std::fmax(peaks[0], -v);
+		peaks[1] = std::fmax(peaks[1], v);
 	}
 	else {
 		float v = that->getVoltageRMS() / 10.f;
-		that->plugLights[0].setBrightness(0.f);
-		that->plugLights[1].setBrightness(0.f);
-		that->plugLights[2].setSmoothBrightness(v, deltaTime);
+		peaks[2] = std::fmax(peaks[2], v);
 	}
 }
 
@@ -355,6 +387,7 @@ void Module::doProcess(const ProcessArgs& args) {
 
 		internal->meterSamples++;
 		internal->meterDurationTotal += duration;
+		internal->processHistogram.add(duration);
 
 		// Seconds we've been measuring
 		float meterTime = internal->meterSamples * METER_DIVIDER * args.sampleTime;
@@ -374,17 +407,96 @@ void Module::doProcess(const ProcessArgs& args) {
 
 	// Iterate ports to step plug lights
 	if (args.frame % PORT_DIVIDER == 0) {
-		float portTime = args.sampleTime * PORT_DIVIDER;
+		// Only allocates on the first step after the module is configured
+		internal->plugLightPeaks.resize((inputs.size() + outputs.size()) * 3);
+		float* peaks = internal->plugLightPeaks.data();
 		for (Input& input : inputs) {
-			Port_step(&input, portTime);
+			Port_step(&input, peaks);
+			peaks += 3;
 		}
 		for (Output& output : outputs) {
-			Port_step(&output, portTime);
+			Port_step(&output, peaks);
+			peaks += 3;
 		}
 	}
 }
 
 
+void Module::publishSnapshot() {
+	if (!internal->snapshotRequested.load(std::memory_order_relaxed))
+		return;
+	internal->snapshotRequested.store(false, std::memory_order_relaxed);
+
+	ModuleSnapshot& snapshot = internal->snapshots[internal->backSnapshot];
+	// Only allocates on the first snapshot after the module is configured
+	snapshot.lights.resize(lights.size());
+	for (size_t i = 0; i < lights.size(); i++) {
+		snapshot.lights[i] = lights[i].value;
+	}
+	snapshot.plugLights.resize(internal->plugLightPeaks.size());
+	for (size_t i = 0; i < internal->plugLightPeaks.size(); i++) {
+		snapshot.plugLights[i] = internal->plugLightPeaks[i];
+		internal->plugLightPeaks[i] = 0.f;
+	}
+
+	int oldMiddle = internal->middleSnapshot.exchange(internal->backSnapshot | SNAPSHOT_FRESH, std::memory_order_acq_rel);
+	internal->backSnapshot = oldMiddle & ~SNAPSHOT_FRESH;
+}
+
+
+void Module::updateSnapshot() {
+	if (internal->middleSnapshot.load(std::memory_order_acquire) & SNAPSHOT_FRESH) {
+		int oldMiddle = internal->middleSnapshot.exchange(internal->frontSnapshot, std::memory_order_acq_rel);
+		internal->frontSnapshot = oldMiddle & ~SNAPSHOT_FRESH;
+		internal->snapshotRequested.store(true, std::memory_order_relaxed);
+	}
+
+	// Decay plug lights toward the latest peaks, which are held until the next snapshot
+	double time = system::getTime();
+	float deltaTime = std::isfinite(internal->snapshotTime) ? (time - internal->snapshotTime) : 0.f;
+	// Larger steps would overshoot the target
+	deltaTime = math::clamp(deltaTime, 0.f, 1 / 30.f);
+	internal->snapshotTime = time;
+
+	const ModuleSnapshot& snapshot = internal->snapshots[internal->frontSnapshot];
+	if (snapshot.plugLights.size() != (inputs.size() + outputs.size()) * 3)
+		return;
+	const float* peaks = snapshot.plugLights.data();
+	for (Input& input : inputs) {
+		for (int i = 0; i < 3; i++)
+			input.plugLights[i].setBrightnessSmooth(*peaks++, deltaTime);
+	}
+	for (Output& output : outputs) {
+		for (int i = 0; i < 3; i++)
+			output.plugLights[i].setBrightnessSmooth(*peaks++, deltaTime);
+	}
+}
+
+
+float Module::getSnapshotLightBrightness(int lightId) {
+	const ModuleSnapshot& snapshot = internal->snapshots[internal->frontSnapshot];
+	if (!(0 <= lightId && lightId < (int) snapshot.lights.size()))
+		return 0.f;
+	return snapshot.lights[lightId];
+}
+
+
+float Module::getPlugLightBrightness(Port::Type type, int portId, int colorId) {
+	if (!(0 <= colorId && colorId < 3))
+		return 0.f;
+	if (type == Port::INPUT) {
+		if (!(0 <= portId && portId < (int) inputs.size()))
+			return 0.f;
+		return inputs[portId].plugLights[colorId].getBrightness();
+	}
+	else {
+		if (!(0 <= portId && portId < (int) outputs.size()))
+			return 0.f;
+		return outputs[portId].plugLights[colorId].getBrightness();
+	}
+}
+
+
 void Module::jsonStripIds(json_t* rootJ) {
 	json_object_del(rootJ, "id");
 	json_object_del(rootJ, "leftModuleId");
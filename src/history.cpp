@@ -221,12 +221,22 @@ void CableColorChange::redo() {
 }
 
 
+struct State::Internal {
+	/** Unique IDs of `actions`, so a patch state can be identified after actions are added or removed */
+	std::deque<uint64_t> actionIds;
+	/** ID of the state at action index 0 */
+	uint64_t baseId = 0;
+	uint64_t nextId = 1;
+};
+
 State::State() {
+	internal = new Internal;
 	clear();
 }
 
 State::~State() {
 	clear();
+	delete internal;
 }
 
 void State::clear() {
@@ -236,6 +246,8 @@ void State::clear() {
 	actions.clear();
 	actionIndex = 0;
 	savedIndex = -1;
+	internal->actionIds.clear();
+	internal->baseId = internal->nextId++;
 }
 
 void State::push(Action* action) {
@@ -244,6 +256,7 @@ void State::push(Action* action) {
 		delete actions[i];
 	}
 	actions.resize(actionIndex);
+	internal->actionIds.resize(actionIndex);
 	// Delete actions from beginning if limit is reached
 	static const int limit = 500;
 	int n = (int) actions.size() - limit + 1;
@@ -252,11 +265,14 @@ void State::push(Action* action) {
 			delete actions[i];
 		}
 		actions.erase(actions.begin(), actions.begin() + n);
+		internal->baseId = internal->actionIds[n - 1];
+		internal->actionIds.erase(internal->actionIds.begin(), internal->actionIds.begin() + n);
 		actionIndex -= n;
 		savedIndex -= n;
 	}
 	// Push action
 	actions.push_back(action);
+	internal->actionIds.push_back(internal->nextId++);
 	actionIndex++;
 	// Unset the savedIndex if we just permanently overwrote the saved state
 	if (actionIndex == savedIndex) {
@@ -306,6 +322,26 @@ bool State::isSaved() {
 	return actionIndex == savedIndex;
 }
 
+uint64_t State::getStateId() {
+	if (actionIndex == 0)
+		return internal->baseId;
+	return internal->actionIds[actionIndex - 1];
+}
+
+void State::setSavedStateId(uint64_t stateId) {
+	if (stateId == internal->baseId) {
+		savedIndex = 0;
+		return;
+	}
+	for (size_t i = 0; i < internal->actionIds.size(); i++) {
+		if (internal->actionIds[i] == stateId) {
+			savedIndex = (int) i + 1;
+			return;
+		}
+	}
+	// The state was overwritten or trimmed, so it can't be reached by undo or redo anymore.
+}
+
 
 } // namespace history
 } // namespace rack
@@ -1,7 +1,15 @@
 #include <algorithm>
+#include <deque>
 #include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+#include <set>
+#include <cstring>
 
 #include <osdialog.h>
+#include <openssl/evp.h>
 
 #include <patch.hpp>
 #include <asset.hpp>
@@ -24,9 +32,1690 @@ static const char PATCH_FILTERS[] = "VCV Rack patch (.vcv):vcv";
 
 
 struct Manager::Internal {
+	/** Extracts the patch archive while the patch is loaded. See Manager_startExtraction(). */
+	std::thread extractThread;
+	std::mutex extractMutex;
+	std::condition_variable extractCv;
+	bool patchJsonExtracted = false;
+	bool extractFinished = false;
+	std::string extractError;
+
+	/** A patch snapshot to be written by the save thread. See Manager_enqueueSave(). */
+	struct SaveJob {
+		json_t* rootJ = NULL;
+		/** If not empty, the autosave dir is archived to this path after patch.json is written. */
+		std::string archivePath;
+		/** If not empty, the archive contains this binary patch instead of patch.json, and `rootJ` is NULL. See settings::binaryPatches. */
+		std::vector<uint8_t> binary;
+		/** If set, the history state with ID `historyStateId` is marked saved once the archive is written. */
+		bool markSaved = false;
+		uint64_t historyStateId = 0;
+	};
+	std::thread saveThread;
+	std::mutex saveMutex;
+	std::condition_variable saveCv;
+	bool saveThreadRunning = false;
+	/** Whether the save thread is writing a job */
+	bool saveBusy = false;
+	/** Whether the job being written is an archive, which reads module patch storage */
+	bool saveBusyArchive = false;
+	bool savePending = false;
+	SaveJob pendingSave;
+	/** Errors of archiving jobs, reported on the UI thread by showSaveErrors() */
+	std::vector<std::string> saveErrors;
+	/** History state IDs of archiving jobs that completed, marked saved on the UI thread */
+	std::vector<uint64_t> savedStateIds;
+
+	/** A file to add to the blob store on the save thread. See addBlob(). */
+	struct BlobJob {
+		std::string filePath;
+		int64_t moduleId;
+		engine::Module* module;
+		std::function<void(const std::string& hash)> action;
+		/** Set by the save thread, or "" if the file could not be added */
+		std::string hash;
+	};
+	/** Blob jobs waiting to be written, run by the save thread before save jobs */
+	std::deque<BlobJob> blobJobs;
+	/** Whether the save thread is adding a blob */
+	bool blobBusy = false;
+	/** Blob jobs written by the save thread, whose actions are called on the UI thread */
+	std::vector<BlobJob> finishedBlobJobs;
+
+	/** Saves requested while an archive was being written, started by step() when it finishes.
+	Only accessed by the UI thread.
+	*/
+	struct DeferredSave {
+		std::string path;
+		bool markSaved;
+	};
+	std::vector<DeferredSave> deferredSaves;
+
+	/** The patch state that patch.json plus patch.journal on disk represent, or NULL if unknown.
+	Only accessed by the save thread, or by the UI thread while the save thread is idle.
+	*/
+	json_t* journalBaseJ = NULL;
+	/** SHA-256 of patch.json on disk, recorded in the first line of the journal */
+	std::string snapshotHash;
+	uint64_t snapshotSize = 0;
+	uint64_t journalSize = 0;
+
+	/** Whether the autosave dir is deleted on exit. See useTemporaryAutosave(). */
+	bool temporaryAutosave = false;
 };
 
 
+////////////////////
+// Blob store
+////////////////////
+
+/* Blobs are files in the autosave dir's `blobs` directory, named by the lowercase hex SHA-256 of their contents.
+Modules list the hashes of the blobs they use in a "blobs" array in their data JSON, so the same file is stored once per patch no matter how many modules use it.
+Every blob is also hard-linked (or copied) to the user's blob cache, which lets getBlobPath() restore blobs missing from the patch.
+The cache is pruned to BLOB_CACHE_MAX_SIZE when the save thread starts, removing the least recently used blobs first.
+A blob's modified time is its last use, since it is touched when it is cached again or restored from the cache.
+*/
+
+static const size_t BLOB_HASH_LENGTH = 64;
+static const uint64_t BLOB_CACHE_MAX_SIZE = (uint64_t) 1 << 30;
+
+
+static std::string getBlobCacheDir() {
+	return asset::user("blobs");
+}
+
+
+static std::string Manager_getBlobsDir(Manager* that) {
+	return system::join(that->autosavePath, "blobs");
+}
+
+
+static bool isBlobHash(const std::string& s) {
+	if (s.size() != BLOB_HASH_LENGTH)
+		return false;
+	for (char c : s) {
+		if (!(('0' <= c && c <= '9') || ('a' <= c && c <= 'f')))
+			return false;
+	}
+	return true;
+}
+
+
+static std::string formatBlobHash(const unsigned char* digest, unsigned int len) {
+	std::string hash;
+	for (unsigned int i = 0; i < len; i++) {
+		hash += string::f("%02x", digest[i]);
+	}
+	return hash;
+}
+
+
+static std::string hashBlobData(const uint8_t* data, size_t size) {
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int len = 0;
+	if (!EVP_Digest(data, size, digest, &len, EVP_sha256(), NULL))
+		throw Exception("Could not hash blob");
+	return formatBlobHash(digest, len);
+}
+
+
+static std::string hashBlobFile(const std::string& path) {
+	FILE* f = std::fopen(path.c_str(), "rb");
+	if (!f)
+		throw Exception("Could not open blob %s", path.c_str());
+	DEFER({std::fclose(f);});
+
+	EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+	DEFER({EVP_MD_CTX_free(ctx);});
+	if (!EVP_DigestInit_ex(ctx, EVP_sha256(), NULL))
+		throw Exception("Could not hash blob %s", path.c_str());
+
+	std::vector<uint8_t> buf(1 << 16);
+	size_t len;
+	while ((len = std::fread(buf.data(), 1, buf.size(), f)) > 0) {
+		EVP_DigestUpdate(ctx, buf.data(), len);
+	}
+	if (std::ferror(f))
+		throw Exception("Could not read blob %s", path.c_str());
+
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int digestLen = 0;
+	if (!EVP_DigestFinal_ex(ctx, digest, &digestLen))
+		throw Exception("Could not hash blob %s", path.c_str());
+	return formatBlobHash(digest, digestLen);
+}
+
+
+/** Adds a blob to the user's blob cache if not already cached. */
+static void cacheBlob(const std::string& blobPath, const std::string& hash) {
+	std::string cachePath = system::join(getBlobCacheDir(), hash);
+	if (system::isFile(cachePath)) {
+		system::touchFile(cachePath);
+		return;
+	}
+	system::createDirectories(getBlobCacheDir());
+	std::string tmpPath = cachePath + ".tmp";
+	if (!system::createHardLink(blobPath, tmpPath) && !system::copy(blobPath, tmpPath))
+		return;
+	if (!system::rename(tmpPath, cachePath))
+		system::remove(tmpPath);
+}
+
+
+/** Removes the least recently used blobs from the user's blob cache until it is smaller than BLOB_CACHE_MAX_SIZE. */
+static void pruneBlobCache() {
+	struct CachedBlob {
+		std::string path;
+		double time;
+		uint64_t size;
+	};
+	std::vector<CachedBlob> blobs;
+	uint64_t totalSize = 0;
+	for (const std::string& entry : system::getEntries(getBlobCacheDir())) {
+		std::string filename = system::getFilename(entry);
+		if (!isBlobHash(filename)) {
+			// Remove temporary files left by a crash
+			if (string::endsWith(filename, ".tmp"))
+				system::remove(entry);
+			continue;
+		}
+		CachedBlob blob;
+		blob.path = entry;
+		blob.time = system::getModifiedTime(entry);
+		blob.size = system::getFileSize(entry);
+		totalSize += blob.size;
+		blobs.push_back(blob);
+	}
+	if (totalSize <= BLOB_CACHE_MAX_SIZE)
+		return;
+
+	// Oldest first
+	std::sort(blobs.begin(), blobs.end(), [](const CachedBlob& a, const CachedBlob& b) {
+		return a.time < b.time;
+	});
+	int count = 0;
+	for (const CachedBlob& blob : blobs) {
+		if (totalSize <= BLOB_CACHE_MAX_SIZE)
+			break;
+		if (!system::remove(blob.path))
+			continue;
+		totalSize -= blob.size;
+		count++;
+	}
+	INFO("Pruned %d blobs from blob cache", count);
+}
+
+
+/** Inserts the blob hashes listed in the "blobs" array of module data JSON into `hashes`. */
+static void collectBlobHashes(json_t* dataJ, std::set<std::string>& hashes) {
+	json_t* blobsJ = json_object_get(dataJ, "blobs");
+	size_t i;
+	json_t* hashJ;
+	json_array_foreach(blobsJ, i, hashJ) {
+		if (json_string_length(hashJ) == BLOB_HASH_LENGTH && isBlobHash(json_string_value(hashJ)))
+			hashes.insert(json_string_value(hashJ));
+	}
+}
+
+
+/** Inserts the blob hashes listed by all modules of the patch JSON into `hashes`. */
+static void collectPatchBlobHashes(json_t* rootJ, std::set<std::string>& hashes) {
+	json_t* modulesJ = json_object_get(rootJ, "modules");
+	size_t i;
+	json_t* moduleJ;
+	json_array_foreach(modulesJ, i, moduleJ) {
+		collectBlobHashes(json_object_get(moduleJ, "data"), hashes);
+	}
+}
+
+
+/** Hashes a file and copies it to the blob store.
+Must be called from the save thread, which never archives the blobs dir at the same time.
+*/
+static std::string Manager_addBlobFile(Manager* that, const std::string& filePath) {
+	std::string hash = hashBlobFile(filePath);
+	std::string blobPath = system::join(Manager_getBlobsDir(that), hash);
+	if (!system::isFile(blobPath)) {
+		system::createDirectories(Manager_getBlobsDir(that));
+		// Copy to a temporary path so a partially copied blob never has a valid hash name
+		std::string tmpPath = blobPath + ".tmp";
+		if (!system::copy(filePath, tmpPath) || !system::rename(tmpPath, blobPath)) {
+			system::remove(tmpPath);
+			throw Exception("Could not add blob %s", filePath.c_str());
+		}
+	}
+	cacheBlob(blobPath, hash);
+	return hash;
+}
+
+
+/** Calls the actions of blob jobs written by the save thread, for modules that still exist.
+Must be called from the UI thread.
+*/
+static void Manager_finishBlobJobs(Manager* that) {
+	Manager::Internal* internal = that->internal;
+	std::vector<Manager::Internal::BlobJob> jobs;
+	{
+		std::lock_guard<std::mutex> lock(internal->saveMutex);
+		jobs.swap(internal->finishedBlobJobs);
+	}
+	for (Manager::Internal::BlobJob& job : jobs) {
+		if (APP->engine->getModule(job.moduleId) != job.module)
+			continue;
+		if (job.action)
+			job.action(job.hash);
+	}
+}
+
+
+/** Removes blobs not in `hashes`, the blobs referenced by the patch, so they aren't archived. They remain in the user's blob cache. */
+static void Manager_cleanBlobs(Manager* that, const std::set<std::string>& hashes) {
+	std::string blobsDir = Manager_getBlobsDir(that);
+	if (!system::isDirectory(blobsDir))
+		return;
+
+	for (const std::string& entry : system::getEntries(blobsDir)) {
+		if (hashes.find(system::getFilename(entry)) == hashes.end())
+			system::remove(entry);
+	}
+}
+
+
+////////////////////
+// Autosave journal
+////////////////////
+
+/* Autosaves append only what changed since the previous autosave to patch.journal, rather than rewriting patch.json.
+The first line of the journal is {"snapshot": hash} with the SHA-256 of the patch.json it applies to.
+A journal left behind by a crash between rewriting patch.json and removing the journal therefore doesn't match, and is ignored.
+Each following line is a JSON array of changes written by one autosave, so a line truncated by a crash is simply ignored.
+A change is one of
+	{"set": key, "value": value}, {"unset": key}: top-level patch properties
+	{"module": moduleJ}, {"removeModule": id}
+	{"cable": cableJ}, {"removeCable": id}
+patch.json is rewritten and the journal removed when the journal grows larger than half of patch.json, and on every full save.
+*/
+
+static std::string getJournalPath(const std::string& autosavePath) {
+	return system::join(autosavePath, "patch.journal");
+}
+
+
+/** Appends changes to `changesJ` for elements of the `key` array (modules or cables) that were added, changed, or removed, matched by "id". */
+static void diffJsonArrayById(json_t* oldRootJ, json_t* newRootJ, const char* key, const char* setOp, const char* removeOp, json_t* changesJ) {
+	std::map<int64_t, json_t*> oldElements;
+	size_t i;
+	json_t* elementJ;
+	json_array_foreach(json_object_get(oldRootJ, key), i, elementJ) {
+		oldElements[json_integer_value(json_object_get(elementJ, "id"))] = elementJ;
+	}
+
+	json_array_foreach(json_object_get(newRootJ, key), i, elementJ) {
+		int64_t id = json_integer_value(json_object_get(elementJ, "id"));
+		auto it = oldElements.find(id);
+		if (it == oldElements.end() || !json_equal(it->second, elementJ))
+			json_array_append_new(changesJ, json_pack("{s:O}", setOp, elementJ));
+		if (it != oldElements.end())
+			oldElements.erase(it);
+	}
+
+	for (auto& pair : oldElements) {
+		json_array_append_new(changesJ, json_pack("{s:I}", removeOp, (json_int_t) pair.first));
+	}
+}
+
+
+/** Returns an array of changes that transform `oldRootJ` into `newRootJ`. */
+static json_t* diffPatchJson(json_t* oldRootJ, json_t* newRootJ) {
+	json_t* changesJ = json_array();
+
+	const char* key;
+	json_t* valueJ;
+	json_object_foreach(newRootJ, key, valueJ) {
+		if (!std::strcmp(key, "modules") || !std::strcmp(key, "cables"))
+			continue;
+		json_t* oldValueJ = json_object_get(oldRootJ, key);
+		if (!oldValueJ || !json_equal(oldValueJ, valueJ))
+			json_array_append_new(changesJ, json_pack("{s:s, s:O}", "set", key, "value", valueJ));
+	}
+	json_object_foreach(oldRootJ, key, valueJ) {
+		if (!json_object_get(newRootJ, key))
+			json_array_append_new(changesJ, json_pack("{s:s}", "unset", key));
+	}
+
+	diffJsonArrayById(oldRootJ, newRootJ, "modules", "module", "removeModule", changesJ);
+	diffJsonArrayById(oldRootJ, newRootJ, "cables", "cable", "removeCable", changesJ);
+	return changesJ;
+}
+
+
+static void setJsonArrayElementById(json_t* rootJ, const char* key, json_t* newElementJ) {
+	json_t* arrayJ = json_object_get(rootJ, key);
+	if (!arrayJ) {
+		arrayJ = json_array();
+		json_object_set_new(rootJ, key, arrayJ);
+	}
+	json_int_t id = json_integer_value(json_object_get(newElementJ, "id"));
+	size_t i;
+	json_t* elementJ;
+	json_array_foreach(arrayJ, i, elementJ) {
+		if (json_integer_value(json_object_get(elementJ, "id")) == id) {
+			json_array_set(arrayJ, i, newElementJ);
+			return;
+		}
+	}
+	json_array_append(arrayJ, newElementJ);
+}
+
+
+static void removeJsonArrayElementById(json_t* rootJ, const char* key, json_int_t id) {
+	json_t* arrayJ = json_object_get(rootJ, key);
+	size_t i;
+	json_t* elementJ;
+	json_array_foreach(arrayJ, i, elementJ) {
+		if (json_integer_value(json_object_get(elementJ, "id")) == id) {
+			json_array_remove(arrayJ, i);
+			return;
+		}
+	}
+}
+
+
+static void applyPatchJsonChanges(json_t* rootJ, json_t* changesJ) {
+	size_t i;
+	json_t* changeJ;
+	json_array_foreach(changesJ, i, changeJ) {
+		json_t* opJ;
+		if ((opJ = json_object_get(changeJ, "set"))) {
+			json_t* valueJ = json_object_get(changeJ, "value");
+			if (json_is_string(opJ) && valueJ)
+				json_object_set(rootJ, json_string_value(opJ), valueJ);
+		}
+		else if ((opJ = json_object_get(changeJ, "unset"))) {
+			if (json_is_string(opJ))
+				json_object_del(rootJ, json_string_value(opJ));
+		}
+		else if ((opJ = json_object_get(changeJ, "module"))) {
+			setJsonArrayElementById(rootJ, "modules", opJ);
+		}
+		else if ((opJ = json_object_get(changeJ, "removeModule"))) {
+			removeJsonArrayElementById(rootJ, "modules", json_integer_value(opJ));
+		}
+		else if ((opJ = json_object_get(changeJ, "cable"))) {
+			setJsonArrayElementById(rootJ, "cables", opJ);
+		}
+		else if ((opJ = json_object_get(changeJ, "removeCable"))) {
+			removeJsonArrayElementById(rootJ, "cables", json_integer_value(opJ));
+		}
+	}
+}
+
+
+/** Applies patch.journal in the autosave dir to the patch JSON loaded from patch.json, if the journal was written for that patch.json. */
+static void replayJournal(const std::string& autosavePath, json_t* rootJ, const std::string& snapshotHash) {
+	std::ifstream file(getJournalPath(autosavePath), std::ios::binary);
+	if (!file)
+		return;
+
+	std::string line;
+	if (!std::getline(file, line))
+		return;
+	json_t* headerJ = json_loads(line.c_str(), 0, NULL);
+	DEFER({json_decref(headerJ);});
+	const char* hash = json_string_value(json_object_get(headerJ, "snapshot"));
+	if (!hash || snapshotHash != hash) {
+		// patch.json was rewritten after this journal
+		WARN("Ignoring autosave journal written for a different patch.json");
+		return;
+	}
+
+	int count = 0;
+	while (std::getline(file, line)) {
+		json_error_t error;
+		json_t* changesJ = json_loads(line.c_str(), 0, &error);
+		if (!changesJ) {
+			// The last autosave was probably interrupted
+			WARN("Stopped replaying autosave journal at invalid line %d: %s", count + 1, error.text);
+			break;
+		}
+		DEFER({json_decref(changesJ);});
+		applyPatchJsonChanges(rootJ, changesJ);
+		count++;
+	}
+	INFO("Replayed %d autosave journal entries", count);
+}
+
+
+/** Writes patch JSON to patch.json in the autosave dir, via a temporary file so a crash never leaves a truncated patch.json.
+Returns the SHA-256 of the written file, or "" if it could not be written.
+*/
+static std::string Manager_writePatchJson(const std::string& autosavePath, json_t* rootJ) {
+	std::string patchPath = system::join(autosavePath, "patch.json");
+
+	char* data = json_dumps(rootJ, JSON_INDENT(2));
+	if (!data)
+		return "";
+	DEFER({std::free(data);});
+	size_t len = std::strlen(data);
+
+	// Write to temporary path and then rename it to the correct path
+	system::createDirectories(autosavePath);
+	std::string tmpPath = patchPath + ".tmp";
+	// Binary mode so the file hash matches on Windows
+	FILE* file = std::fopen(tmpPath.c_str(), "wb");
+	if (!file) {
+		// Fail silently
+		return "";
+	}
+
+	bool written = (std::fwrite(data, 1, len, file) == len);
+	written = (std::fclose(file) == 0) && written;
+	if (!written) {
+		system::remove(tmpPath);
+		return "";
+	}
+	system::remove(patchPath);
+	system::rename(tmpPath, patchPath);
+	return hashBlobData((const uint8_t*) data, len);
+}
+
+
+/** Writes patch.bin to the autosave dir, via a temporary file so a crash never leaves a truncated patch.bin. */
+static void Manager_writePatchBin(const std::string& autosavePath, const std::vector<uint8_t>& data) {
+	std::string patchPath = system::join(autosavePath, "patch.bin");
+	system::createDirectories(autosavePath);
+	std::string tmpPath = patchPath + ".tmp";
+	system::writeFile(tmpPath, data);
+	if (!system::rename(tmpPath, patchPath)) {
+		system::remove(patchPath);
+		if (!system::rename(tmpPath, patchPath))
+			throw Exception("Could not move %s to %s", tmpPath.c_str(), patchPath.c_str());
+	}
+}
+
+
+/** Writes a full patch.json and removes the journal.
+Must be called from the save thread, or while the save thread is idle.
+*/
+static void Manager_writeSnapshot(Manager* that, json_t* rootJ) {
+	Manager::Internal* internal = that->internal;
+	std::string hash = Manager_writePatchJson(that->autosavePath, rootJ);
+	// The journal no longer matches patch.json, so it is ignored by replayJournal() even if it isn't removed
+	system::remove(getJournalPath(that->autosavePath));
+	// patch.bin extracted from a binary patch is older than patch.json now
+	system::remove(system::join(that->autosavePath, "patch.bin"));
+	internal->journalSize = 0;
+
+	json_decref(internal->journalBaseJ);
+	if (hash.empty()) {
+		// Write another snapshot on the next autosave
+		internal->journalBaseJ = NULL;
+		return;
+	}
+	internal->journalBaseJ = json_incref(rootJ);
+	internal->snapshotHash = hash;
+	internal->snapshotSize = system::getFileSize(system::join(that->autosavePath, "patch.json"));
+}
+
+
+/** Appends the changes since the last snapshot or journal entry to the journal.
+Returns false if a full snapshot should be written instead.
+*/
+static bool Manager_appendJournal(Manager* that, json_t* rootJ) {
+	Manager::Internal* internal = that->internal;
+	if (!internal->journalBaseJ)
+		return false;
+	if (internal->journalSize > internal->snapshotSize / 2)
+		return false;
+
+	json_t* changesJ = diffPatchJson(internal->journalBaseJ, rootJ);
+	DEFER({json_decref(changesJ);});
+	if (json_array_size(changesJ) > 0) {
+		char* line = json_dumps(changesJ, JSON_COMPACT);
+		if (!line)
+			return false;
+		DEFER({std::free(line);});
+
+		// Start a new journal with the hash of its patch.json
+		std::string header;
+		if (internal->journalSize == 0)
+			header = string::f("{\"snapshot\": \"%s\"}\n", internal->snapshotHash.c_str());
+
+		std::string journalPath = getJournalPath(that->autosavePath);
+		// Binary mode, so journalSize counts the bytes actually written on Windows too.
+		FILE* file = std::fopen(journalPath.c_str(), header.empty() ? "ab" : "wb");
+		if (!file)
+			return false;
+		size_t len = std::strlen(line);
+		bool written = (std::fwrite(header.data(), 1, header.size(), file) == header.size());
+		written = written && (std::fwrite(line, 1, len, file) == len) && (std::fputc('\n', file) != EOF);
+		written = (std::fclose(file) == 0) && written;
+		if (!written)
+			return false;
+		internal->journalSize += header.size() + len + 1;
+	}
+
+	json_decref(internal->journalBaseJ);
+	internal->journalBaseJ = json_incref(rootJ);
+	return true;
+}
+
+
+static void Manager_runSaveJob(Manager* that, const Manager::Internal::SaveJob& job) {
+	if (job.archivePath.empty()) {
+		if (!Manager_appendJournal(that, job.rootJ))
+			Manager_writeSnapshot(that, job.rootJ);
+		return;
+	}
+
+	if (job.binary.empty()) {
+		// Archives must contain a complete patch.json
+		Manager_writeSnapshot(that, job.rootJ);
+	}
+	else {
+		Manager_writePatchBin(that->autosavePath, job.binary);
+	}
+
+	double startTime = system::getTime();
+	uint64_t inputSize = 0;
+	for (const std::string& entry : system::getEntries(that->autosavePath, -1)) {
+		if (system::isFile(entry))
+			inputSize += system::getFileSize(entry);
+	}
+
+	system::ArchiveOptions options;
+	// Set compression level to 1 so that a 500MB/s SSD is almost bottlenecked
+	options.compressionLevel = 1;
+	// Compress in parallel with reading files, leaving cores for the engine
+	options.threads = std::min(std::max(system::getLogicalCoreCount() / 2, 1), 4);
+	// Large patch storage (samples, wavetables) often contains repeated data further apart than the default window
+	options.longDistanceMatching = (inputSize >= (uint64_t(64) << 20));
+	// Let loading start before module patch storage is extracted. See Manager_startExtraction().
+	if (job.binary.empty()) {
+		options.firstPaths = {"patch.json"};
+	}
+	else {
+		options.firstPaths = {"patch.bin"};
+		// patch.json and its journal are the autosave, which patch.bin replaces in the archive
+		options.excludePaths = {"patch.json", "patch.journal"};
+	}
+
+	// Archive to a temporary path and then rename it, so the previous patch file survives a failed save.
+	std::string tmpPath = job.archivePath + ".tmp";
+	system::archiveDirectory(tmpPath, that->autosavePath, options);
+	uint64_t outputSize = system::getFileSize(tmpPath);
+	system::remove(job.archivePath);
+	if (!system::rename(tmpPath, job.archivePath))
+		throw Exception("Could not move %s to %s", tmpPath.c_str(), job.archivePath.c_str());
+	double duration = system::getTime() - startTime;
+	// Keep patch.bin only if it is the autosave, since autosaves write patch.json
+	if (!job.binary.empty() && system::isFile(system::join(that->autosavePath, "patch.json")))
+		system::remove(system::join(that->autosavePath, "patch.bin"));
+	INFO("Archived patch in %lf seconds, %" PRIu64 " to %" PRIu64 " bytes at %lf MB/s", duration, inputSize, outputSize, inputSize / 1e6 / std::fmax(duration, 1e-9));
+}
+
+
+static void Manager_saveThreadRun(Manager* that) {
+	system::setThreadName("Patch saver");
+	Manager::Internal* internal = that->internal;
+	pruneBlobCache();
+	std::unique_lock<std::mutex> lock(internal->saveMutex);
+	while (true) {
+		internal->saveCv.wait(lock, [&]() {
+			return internal->savePending || !internal->blobJobs.empty() || !internal->saveThreadRunning;
+		});
+
+		// Add blobs first, since modules are waiting for their hashes
+		if (!internal->blobJobs.empty()) {
+			Manager::Internal::BlobJob blobJob = std::move(internal->blobJobs.front());
+			internal->blobJobs.pop_front();
+			internal->blobBusy = true;
+			lock.unlock();
+
+			try {
+				blobJob.hash = Manager_addBlobFile(that, blobJob.filePath);
+			}
+			catch (Exception& e) {
+				WARN("Could not add blob: %s", e.what());
+			}
+
+			lock.lock();
+			internal->blobBusy = false;
+			internal->finishedBlobJobs.push_back(std::move(blobJob));
+			internal->saveCv.notify_all();
+			continue;
+		}
+
+		if (!internal->savePending)
+			break;
+
+		Manager::Internal::SaveJob job = std::move(internal->pendingSave);
+		internal->pendingSave = Manager::Internal::SaveJob();
+		internal->savePending = false;
+		internal->saveBusy = true;
+		internal->saveBusyArchive = !job.archivePath.empty();
+		lock.unlock();
+
+		std::string error;
+		try {
+			Manager_runSaveJob(that, job);
+		}
+		catch (Exception& e) {
+			error = e.what();
+			WARN("Could not save patch: %s", e.what());
+		}
+		json_decref(job.rootJ);
+
+		lock.lock();
+		internal->saveBusy = false;
+		internal->saveBusyArchive = false;
+		if (!error.empty() && !job.archivePath.empty())
+			internal->saveErrors.push_back(error);
+		if (error.empty() && job.markSaved)
+			internal->savedStateIds.push_back(job.historyStateId);
+		internal->saveCv.notify_all();
+	}
+}
+
+
+/** Queues a patch snapshot to be written by the save thread. Takes ownership of `job.rootJ`.
+Only one job waits at a time. A newer autosave replaces a waiting autosave, but not a waiting archive.
+A JSON archive writes patch.json anyway, and the autosave after a binary archive writes it.
+*/
+static void Manager_enqueueSave(Manager* that, Manager::Internal::SaveJob job) {
+	Manager::Internal* internal = that->internal;
+	std::lock_guard<std::mutex> lock(internal->saveMutex);
+	if (internal->savePending) {
+		if (job.archivePath.empty() && !internal->pendingSave.archivePath.empty()) {
+			json_decref(job.rootJ);
+			return;
+		}
+		json_decref(internal->pendingSave.rootJ);
+	}
+	internal->pendingSave = std::move(job);
+	internal->savePending = true;
+	internal->saveCv.notify_all();
+}
+
+
+/** Returns whether an archive is waiting to be written or being written by the save thread. */
+static bool Manager_isArchiving(Manager* that) {
+	Manager::Internal* internal = that->internal;
+	std::lock_guard<std::mutex> lock(internal->saveMutex);
+	return (internal->savePending && !internal->pendingSave.archivePath.empty()) || internal->saveBusyArchive;
+}
+
+
+/** Returns whether blobs are waiting to be added, being added, or waiting for their actions to be called. */
+static bool Manager_isAddingBlobs(Manager* that) {
+	Manager::Internal* internal = that->internal;
+	std::lock_guard<std::mutex> lock(internal->saveMutex);
+	return !internal->blobJobs.empty() || internal->blobBusy || !internal->finishedBlobJobs.empty();
+}
+
+
+/** Blocks until the save thread has written all queued jobs and blobs.
+Must be called before modifying the autosave dir on the UI thread.
+*/
+static void Manager_waitForSaves(Manager* that) {
+	Manager::Internal* internal = that->internal;
+	std::unique_lock<std::mutex> lock(internal->saveMutex);
+	internal->saveCv.wait(lock, [&]() {
+		return !internal->savePending && !internal->saveBusy && internal->blobJobs.empty() && !internal->blobBusy;
+	});
+}
+
+
+/** Extracts a patch archive to the autosave dir on a worker thread.
+patch.json (or patch.bin) can be parsed and modules constructed as soon as it is extracted, while module patch storage files are still being extracted.
+*/
+static void Manager_startExtraction(Manager* that, const std::string& path) {
+	Manager::Internal* internal = that->internal;
+	internal->patchJsonExtracted = false;
+	internal->extractFinished = false;
+	internal->extractError = "";
+	std::string autosavePath = that->autosavePath;
+
+	internal->extractThread = std::thread([=]() {
+		system::setThreadName("Patch extractor");
+		double startTime = system::getTime();
+		std::string error;
+		try {
+			system::unarchiveToDirectory(path, autosavePath, [&](const std::string& filePath) {
+				std::string filename = string::startsWith(filePath, "./") ? filePath.substr(2) : filePath;
+				if (filename != "patch.json" && filename != "patch.bin")
+					return;
+				INFO("Extracted %s in %lf seconds", filename.c_str(), system::getTime() - startTime);
+				std::lock_guard<std::mutex> lock(internal->extractMutex);
+				internal->patchJsonExtracted = true;
+				internal->extractCv.notify_all();
+			});
+		}
+		catch (Exception& e) {
+			error = e.what();
+		}
+		INFO("Unarchived patch in %lf seconds", system::getTime() - startTime);
+
+		std::lock_guard<std::mutex> lock(internal->extractMutex);
+		internal->extractFinished = true;
+		internal->extractError = error;
+		internal->extractCv.notify_all();
+	});
+}
+
+
+/** Blocks until patch.json or patch.bin is extracted, or extraction finishes. */
+static void Manager_waitForPatchJson(Manager* that) {
+	Manager::Internal* internal = that->internal;
+	std::unique_lock<std::mutex> lock(internal->extractMutex);
+	internal->extractCv.wait(lock, [&]() {
+		return internal->patchJsonExtracted || internal->extractFinished;
+	});
+}
+
+
+/** Blocks until extraction finishes, if running. */
+static void Manager_joinExtraction(Manager* that) {
+	Manager::Internal* internal = that->internal;
+	if (internal->extractThread.joinable())
+		internal->extractThread.join();
+}
+
+
+/** Blocks until extraction finishes, if running.
+Throws Exception if extraction failed.
+*/
+static void Manager_finishExtraction(Manager* that) {
+	Manager::Internal* internal = that->internal;
+	Manager_joinExtraction(that);
+	if (!internal->extractError.empty()) {
+		std::string error = internal->extractError;
+		internal->extractError = "";
+		throw Exception("%s", error.c_str());
+	}
+}
+
+
+////////////////////
+// Patch properties
+////////////////////
+
+/** Returns the patch properties that are not owned by the Engine or RackWidget. */
+static json_t* Manager_propertiesToJson(Manager* that) {
+	// root
+	json_t* rootJ = json_object();
+
+	// version
+	json_t* versionJ = json_string(APP_VERSION.c_str());
+	json_object_set_new(rootJ, "version", versionJ);
+
+	// path
+	if (that->path != "") {
+		json_t* pathJ = json_string(that->path.c_str());
+		json_object_set_new(rootJ, "path", pathJ);
+	}
+
+	// unsaved
+	if (!APP->history->isSaved())
+		json_object_set_new(rootJ, "unsaved", json_boolean(true));
+
+	if (APP->scene) {
+		// zoom
+		float zoom = APP->scene->rackScroll->getZoom();
+		json_object_set_new(rootJ, "zoom", json_real(zoom));
+
+		// gridOffset
+		math::Vec gridOffset = APP->scene->rackScroll->getGridOffset();
+		json_t* gridOffsetJ = json_pack("[f, f]", gridOffset.x, gridOffset.y);
+		json_object_set_new(rootJ, "gridOffset", gridOffsetJ);
+	}
+
+	return rootJ;
+}
+
+
+static void Manager_propertiesFromJson(Manager* that, json_t* rootJ) {
+	// version
+	std::string version;
+	json_t* versionJ = json_object_get(rootJ, "version");
+	if (versionJ)
+		version = json_string_value(versionJ);
+	if (version != APP_VERSION) {
+		INFO("Patch was made with Rack %s, current Rack version is %s", version.c_str(), APP_VERSION.c_str());
+	}
+
+	// path
+	json_t* pathJ = json_object_get(rootJ, "path");
+	if (pathJ)
+		that->path = json_string_value(pathJ);
+	else
+		that->path = "";
+
+	// unsaved
+	json_t* unsavedJ = json_object_get(rootJ, "unsaved");
+	if (!unsavedJ)
+		APP->history->setSaved();
+
+	if (APP->scene) {
+		// zoom
+		json_t* zoomJ = json_object_get(rootJ, "zoom");
+		if (zoomJ)
+			APP->scene->rackScroll->setZoom(json_number_value(zoomJ));
+
+		// gridOffset
+		json_t* gridOffsetJ = json_object_get(rootJ, "gridOffset");
+		if (gridOffsetJ) {
+			double x, y;
+			json_unpack(gridOffsetJ, "[F, F]", &x, &y);
+			APP->scene->rackScroll->setGridOffset(math::Vec(x, y));
+		}
+	}
+}
+
+
+////////////////////
+// Binary patches
+////////////////////
+
+/* patch.bin stores the same patch as patch.json in a flat layout, so saving and loading skip building a json_t tree for each module, param, and cable.
+Module data is embedded as JSON text, and so are modules whose plugins override Module::toJson() or write params the layout can't represent exactly.
+With settings::binaryPatches enabled, patches are archived with patch.bin instead of patch.json. The autosave dir keeps using patch.json and its journal.
+
+Rack only runs on little-endian CPUs, so numbers are stored in native byte order.
+A string is a u32 byte length followed by its bytes.
+
+	magic "RKPB", u32 version
+	string properties: JSON object of the patch properties other than "modules" and "cables"
+	u32 moduleCount, then for each module:
+		u8 flags
+		if BINARY_JSON: string module JSON
+		else:
+			i64 id
+			string plugin, model, version
+			i64 leftModuleId, rightModuleId, or -1 if none
+			if BINARY_POS: i32 x, y in grid units
+			if BINARY_PARAMS_JSON: string params JSON
+			else if BINARY_PARAMS: u32 paramCount, then (u32 paramId, f32 value) for each param
+			if BINARY_DATA: string data JSON
+	u32 cableCount, then for each cable:
+		u8 flags
+		i64 id, outputModuleId; i32 outputId; i64 inputModuleId; i32 inputId
+		if BINARY_COLOR: string color
+		if BINARY_INPUT_PLUG_ORDER: i32 inputPlugOrder
+		if BINARY_OUTPUT_PLUG_ORDER: i32 outputPlugOrder
+*/
+
+static const char BINARY_MAGIC[4] = {'R', 'K', 'P', 'B'};
+static const uint32_t BINARY_VERSION = 1;
+
+enum BinaryFlags : uint8_t {
+	// Module flags
+	/** The module is JSON text, since the flat layout can't represent it exactly. */
+	BINARY_JSON = 1 << 0,
+	BINARY_BYPASS = 1 << 1,
+	BINARY_POS = 1 << 2,
+	BINARY_PARAMS = 1 << 3,
+	/** The params are JSON text, since they aren't a plain array of {"value", "id"} objects. */
+	BINARY_PARAMS_JSON = 1 << 4,
+	BINARY_DATA = 1 << 5,
+	// Cable flags
+	BINARY_COLOR = 1 << 1,
+	BINARY_INPUT_PLUG_ORDER = 1 << 2,
+	BINARY_OUTPUT_PLUG_ORDER = 1 << 3,
+};
+
+struct BinaryModule {
+	uint8_t flags = 0;
+	/** Module JSON if BINARY_JSON. The remaining fields are unused. */
+	std::string json;
+	int64_t id = -1;
+	std::string plugin;
+	std::string model;
+	std::string version;
+	int64_t leftModuleId = -1;
+	int64_t rightModuleId = -1;
+	int32_t x = 0;
+	int32_t y = 0;
+	std::vector<std::pair<uint32_t, float>> params;
+	std::string paramsJson;
+	std::string data;
+};
+
+struct BinaryCable {
+	uint8_t flags = 0;
+	int64_t id = -1;
+	int64_t outputModuleId = -1;
+	int32_t outputId = -1;
+	int64_t inputModuleId = -1;
+	int32_t inputId = -1;
+	std::string color;
+	int32_t inputPlugOrder = 0;
+	int32_t outputPlugOrder = 0;
+};
+
+struct BinaryPatch {
+	std::string properties;
+	std::vector<BinaryModule> modules;
+	std::vector<BinaryCable> cables;
+};
+
+
+struct BinaryWriter {
+	std::vector<uint8_t> data;
+
+	void write(const void* p, size_t size) {
+		const uint8_t* bytes = (const uint8_t*) p;
+		data.insert(data.end(), bytes, bytes + size);
+	}
+
+	template <typename T>
+	void writeNumber(T x) {
+		write(&x, sizeof(x));
+	}
+
+	void writeString(const std::string& s) {
+		writeNumber<uint32_t>(s.size());
+		write(s.data(), s.size());
+	}
+
+	void writeHeader(const std::string& properties) {
+		write(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+		writeNumber<uint32_t>(BINARY_VERSION);
+		writeString(properties);
+	}
+
+	void writeModule(const BinaryModule& m) {
+		writeNumber<uint8_t>(m.flags);
+		if (m.flags & BINARY_JSON) {
+			writeString(m.json);
+			return;
+		}
+		writeNumber<int64_t>(m.id);
+		writeString(m.plugin);
+		writeString(m.model);
+		writeString(m.version);
+		writeNumber<int64_t>(m.leftModuleId);
+		writeNumber<int64_t>(m.rightModuleId);
+		if (m.flags & BINARY_POS) {
+			writeNumber<int32_t>(m.x);
+			writeNumber<int32_t>(m.y);
+		}
+		if (m.flags & BINARY_PARAMS_JSON) {
+			writeString(m.paramsJson);
+		}
+		else if (m.flags & BINARY_PARAMS) {
+			writeNumber<uint32_t>(m.params.size());
+			for (const std::pair<uint32_t, float>& param : m.params) {
+				writeNumber<uint32_t>(param.first);
+				writeNumber<float>(param.second);
+			}
+		}
+		if (m.flags & BINARY_DATA)
+			writeString(m.data);
+	}
+
+	void writeCable(const BinaryCable& c) {
+		writeNumber<uint8_t>(c.flags);
+		writeNumber<int64_t>(c.id);
+		writeNumber<int64_t>(c.outputModuleId);
+		writeNumber<int32_t>(c.outputId);
+		writeNumber<int64_t>(c.inputModuleId);
+		writeNumber<int32_t>(c.inputId);
+		if (c.flags & BINARY_COLOR)
+			writeString(c.color);
+		if (c.flags & BINARY_INPUT_PLUG_ORDER)
+			writeNumber<int32_t>(c.inputPlugOrder);
+		if (c.flags & BINARY_OUTPUT_PLUG_ORDER)
+			writeNumber<int32_t>(c.outputPlugOrder);
+	}
+};
+
+
+struct BinaryReader {
+	const uint8_t* p;
+	const uint8_t* end;
+
+	size_t getRemaining() {
+		return end - p;
+	}
+
+	void read(void* dest, size_t size) {
+		if (getRemaining() < size)
+			throw Exception("Binary patch is truncated");
+		std::memcpy(dest, p, size);
+		p += size;
+	}
+
+	template <typename T>
+	T readNumber() {
+		T x;
+		read(&x, sizeof(x));
+		return x;
+	}
+
+	std::string readString() {
+		uint32_t size = readNumber<uint32_t>();
+		if (getRemaining() < size)
+			throw Exception("Binary patch is truncated");
+		std::string s((const char*) p, size);
+		p += size;
+		return s;
+	}
+
+	BinaryModule readModule() {
+		BinaryModule m;
+		m.flags = readNumber<uint8_t>();
+		if (m.flags & BINARY_JSON) {
+			m.json = readString();
+			return m;
+		}
+		m.id = readNumber<int64_t>();
+		m.plugin = readString();
+		m.model = readString();
+		m.version = readString();
+		m.leftModuleId = readNumber<int64_t>();
+		m.rightModuleId = readNumber<int64_t>();
+		if (m.flags & BINARY_POS) {
+			m.x = readNumber<int32_t>();
+			m.y = readNumber<int32_t>();
+		}
+		if (m.flags & BINARY_PARAMS_JSON) {
+			m.paramsJson = readString();
+		}
+		else if (m.flags & BINARY_PARAMS) {
+			uint32_t count = readNumber<uint32_t>();
+			// Don't trust the count to reserve memory
+			m.params.reserve(std::min<size_t>(count, getRemaining() / 8));
+			for (uint32_t i = 0; i < count; i++) {
+				uint32_t paramId = readNumber<uint32_t>();
+				float value = readNumber<float>();
+				m.params.push_back(std::make_pair(paramId, value));
+			}
+		}
+		if (m.flags & BINARY_DATA)
+			m.data = readString();
+		return m;
+	}
+
+	BinaryCable readCable() {
+		BinaryCable c;
+		c.flags = readNumber<uint8_t>();
+		c.id = readNumber<int64_t>();
+		c.outputModuleId = readNumber<int64_t>();
+		c.outputId = readNumber<int32_t>();
+		c.inputModuleId = readNumber<int64_t>();
+		c.inputId = readNumber<int32_t>();
+		if (c.flags & BINARY_COLOR)
+			c.color = readString();
+		if (c.flags & BINARY_INPUT_PLUG_ORDER)
+			c.inputPlugOrder = readNumber<int32_t>();
+		if (c.flags & BINARY_OUTPUT_PLUG_ORDER)
+			c.outputPlugOrder = readNumber<int32_t>();
+		return c;
+	}
+};
+
+
+static bool isBinaryPatch(const uint8_t* data, size_t size) {
+	return size >= sizeof(BINARY_MAGIC) && std::memcmp(data, BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0;
+}
+
+
+/** Throws Exception if the data is not a valid binary patch. */
+static BinaryPatch decodeBinaryPatch(const uint8_t* data, size_t size) {
+	if (!isBinaryPatch(data, size))
+		throw Exception("Not a binary patch");
+	BinaryReader reader;
+	reader.p = data + sizeof(BINARY_MAGIC);
+	reader.end = data + size;
+	uint32_t version = reader.readNumber<uint32_t>();
+	if (version != BINARY_VERSION)
+		throw Exception("Binary patch version %u is not supported", (unsigned) version);
+
+	BinaryPatch patch;
+	patch.properties = reader.readString();
+	uint32_t moduleCount = reader.readNumber<uint32_t>();
+	for (uint32_t i = 0; i < moduleCount; i++) {
+		patch.modules.push_back(reader.readModule());
+	}
+	uint32_t cableCount = reader.readNumber<uint32_t>();
+	for (uint32_t i = 0; i < cableCount; i++) {
+		patch.cables.push_back(reader.readCable());
+	}
+	return patch;
+}
+
+
+/** Serializes JSON embedded in a binary patch. */
+static std::string dumpBinaryJson(json_t* valueJ) {
+	char* s = json_dumps(valueJ, JSON_COMPACT | JSON_ENCODE_ANY);
+	if (!s)
+		throw Exception("Could not serialize JSON for binary patch");
+	DEFER({std::free(s);});
+	return s;
+}
+
+
+/** Parses JSON embedded in a binary patch. */
+static json_t* parseBinaryJson(const std::string& s) {
+	json_error_t error;
+	json_t* valueJ = json_loadb(s.data(), s.size(), JSON_DECODE_ANY, &error);
+	if (!valueJ)
+		throw Exception("Binary patch has invalid JSON: %s", error.text);
+	return valueJ;
+}
+
+
+static bool isJsonInt32(json_t* valueJ) {
+	return json_is_integer(valueJ) && json_integer_value(valueJ) >= INT32_MIN && json_integer_value(valueJ) <= INT32_MAX;
+}
+
+
+/** Stores a params array flat if it is what Module::paramsToJson() writes, or as JSON otherwise. */
+static void paramsJsonToBinary(json_t* paramsJ, BinaryModule& m) {
+	m.flags |= BINARY_PARAMS;
+	bool flat = json_is_array(paramsJ);
+	size_t i;
+	json_t* paramJ;
+	json_array_foreach(paramsJ, i, paramJ) {
+		json_t* valueJ = json_object_get(paramJ, "value");
+		json_t* idJ = json_object_get(paramJ, "id");
+		if (json_object_size(paramJ) != 2 || !json_is_real(valueJ) || !json_is_integer(idJ)) {
+			flat = false;
+			break;
+		}
+		double value = json_real_value(valueJ);
+		json_int_t paramId = json_integer_value(idJ);
+		// ParamQuantity::toJson() writes float values, so other values can't be stored exactly
+		if ((double) (float) value != value || paramId < 0 || paramId > (json_int_t) UINT32_MAX) {
+			flat = false;
+			break;
+		}
+		m.params.push_back(std::make_pair((uint32_t) paramId, (float) value));
+	}
+	if (!flat) {
+		m.params.clear();
+		m.flags |= BINARY_PARAMS_JSON;
+		m.paramsJson = dumpBinaryJson(paramsJ);
+	}
+}
+
+
+static json_t* binaryParamsToJson(const BinaryModule& m) {
+	if (m.flags & BINARY_PARAMS_JSON)
+		return parseBinaryJson(m.paramsJson);
+	json_t* paramsJ = json_array();
+	for (const std::pair<uint32_t, float>& param : m.params) {
+		json_t* paramJ = json_object();
+		json_object_set_new(paramJ, "value", json_real(param.second));
+		json_object_set_new(paramJ, "id", json_integer(param.first));
+		json_array_append_new(paramsJ, paramJ);
+	}
+	return paramsJ;
+}
+
+
+/** Stores module JSON flat if it has only the properties written by Module::toJson() and RackWidget::mergeJson(), or as JSON otherwise. */
+static BinaryModule moduleJsonToBinary(json_t* moduleJ) {
+	BinaryModule m;
+	bool flat = json_is_object(moduleJ)
+		&& json_is_integer(json_object_get(moduleJ, "id"))
+		&& json_is_string(json_object_get(moduleJ, "plugin"))
+		&& json_is_string(json_object_get(moduleJ, "model"))
+		&& json_is_string(json_object_get(moduleJ, "version"));
+	const char* key;
+	json_t* valueJ;
+	json_object_foreach(moduleJ, key, valueJ) {
+		if (!flat)
+			break;
+		std::string k = key;
+		if (k == "id") {
+			m.id = json_integer_value(valueJ);
+		}
+		else if (k == "plugin") {
+			m.plugin = json_string_value(valueJ);
+		}
+		else if (k == "model") {
+			m.model = json_string_value(valueJ);
+		}
+		else if (k == "version") {
+			m.version = json_string_value(valueJ);
+		}
+		else if (k == "params") {
+			paramsJsonToBinary(valueJ, m);
+		}
+		else if (k == "bypass" && json_is_true(valueJ)) {
+			m.flags |= BINARY_BYPASS;
+		}
+		else if ((k == "leftModuleId" || k == "rightModuleId") && json_is_integer(valueJ) && json_integer_value(valueJ) >= 0) {
+			(k == "leftModuleId" ? m.leftModuleId : m.rightModuleId) = json_integer_value(valueJ);
+		}
+		else if (k == "pos" && json_array_size(valueJ) == 2 && isJsonInt32(json_array_get(valueJ, 0)) && isJsonInt32(json_array_get(valueJ, 1))) {
+			m.flags |= BINARY_POS;
+			m.x = json_integer_value(json_array_get(valueJ, 0));
+			m.y = json_integer_value(json_array_get(valueJ, 1));
+		}
+		else if (k == "data") {
+			m.flags |= BINARY_DATA;
+			m.data = dumpBinaryJson(valueJ);
+		}
+		else {
+			flat = false;
+		}
+	}
+	if (!flat) {
+		m = BinaryModule();
+		m.flags = BINARY_JSON;
+		m.json = dumpBinaryJson(moduleJ);
+	}
+	return m;
+}
+
+
+static json_t* binaryModuleToJson(const BinaryModule& m) {
+	if (m.flags & BINARY_JSON)
+		return parseBinaryJson(m.json);
+	json_t* moduleJ = json_object();
+	json_object_set_new(moduleJ, "id", json_integer(m.id));
+	json_object_set_new(moduleJ, "plugin", json_stringn(m.plugin.data(), m.plugin.size()));
+	json_object_set_new(moduleJ, "model", json_stringn(m.model.data(), m.model.size()));
+	json_object_set_new(moduleJ, "version", json_stringn(m.version.data(), m.version.size()));
+	if (m.flags & BINARY_PARAMS)
+		json_object_set_new(moduleJ, "params", binaryParamsToJson(m));
+	if (m.flags & BINARY_BYPASS)
+		json_object_set_new(moduleJ, "bypass", json_true());
+	if (m.leftModuleId >= 0)
+		json_object_set_new(moduleJ, "leftModuleId", json_integer(m.leftModuleId));
+	if (m.rightModuleId >= 0)
+		json_object_set_new(moduleJ, "rightModuleId", json_integer(m.rightModuleId));
+	if (m.flags & BINARY_DATA)
+		json_object_set_new(moduleJ, "data", parseBinaryJson(m.data));
+	if (m.flags & BINARY_POS)
+		json_object_set_new(moduleJ, "pos", json_pack("[i, i]", (int) m.x, (int) m.y));
+	return moduleJ;
+}
+
+
+/** Returns whether `object`'s class overrides the virtual method `method` of `Base`.
+Compares vtable slots using the Itanium C++ ABI, which GCC and Clang use on all platforms Rack supports.
+A pointer to a virtual method holds its byte offset in the vtable, plus 1 on x86 or with the virtual flag in the adjustment on ARM.
+Plugins may reach Rack's own methods through import thunks on Windows, which only causes false positives, so the caller takes the slower JSON path.
+*/
+template <class Base, typename Method>
+static bool isOverridden(Base* object, Method method) {
+#if defined __GNUC__
+	struct MethodPointer {
+		uintptr_t ptr;
+		ptrdiff_t adj;
+	};
+	static_assert(sizeof(Method) == sizeof(MethodPointer), "Unexpected pointer to member function size");
+	MethodPointer mp;
+	std::memcpy(&mp, &method, sizeof(mp));
+#if defined ARCH_ARM64
+	if (!(mp.adj & 1))
+		return true;
+	size_t offset = mp.ptr;
+#else
+	if (!(mp.ptr & 1))
+		return true;
+	size_t offset = mp.ptr - 1;
+#endif
+	static Base base;
+	void** vtable = *(void***) object;
+	void** baseVtable = *(void***) &base;
+	return vtable[offset / sizeof(void*)] != baseVtable[offset / sizeof(void*)];
+#else
+	return true;
+#endif
+}
+
+
+/** Returns a module's position in grid units, as saved by RackWidget::mergeJson(). */
+static math::Vec getModuleGridPos(app::ModuleWidget* mw) {
+	return mw->box.pos.minus(app::RACK_OFFSET).div(app::RACK_GRID_SIZE).round();
+}
+
+
+static BinaryModule Manager_moduleToBinary(engine::Module* module, app::ModuleWidget* mw, std::set<std::string>& blobHashes) {
+	// A plugin's toJson() may write anything, so store its JSON
+	if (isOverridden(module, &engine::Module::toJson)) {
+		json_t* moduleJ = module->toJson();
+		DEFER({json_decref(moduleJ);});
+		if (mw) {
+			math::Vec pos = getModuleGridPos(mw);
+			json_object_set_new(moduleJ, "pos", json_pack("[i, i]", (int) pos.x, (int) pos.y));
+		}
+		collectBlobHashes(json_object_get(moduleJ, "data"), blobHashes);
+		return moduleJsonToBinary(moduleJ);
+	}
+
+	// Write what Module::toJson() would, without building its JSON
+	BinaryModule m;
+	m.id = module->id;
+	m.plugin = module->model->plugin->slug;
+	m.model = module->model->slug;
+	m.version = module->model->plugin->version;
+
+	bool paramsOverridden = isOverridden(module, &engine::Module::paramsToJson);
+	for (engine::ParamQuantity* pq : module->paramQuantities) {
+		if (paramsOverridden)
+			break;
+		if (pq && isOverridden(pq, &engine::ParamQuantity::toJson))
+			paramsOverridden = true;
+	}
+	if (paramsOverridden) {
+		json_t* paramsJ = module->paramsToJson();
+		if (paramsJ) {
+			DEFER({json_decref(paramsJ);});
+			paramsJsonToBinary(paramsJ, m);
+		}
+	}
+	else {
+		m.flags |= BINARY_PARAMS;
+		m.params.reserve(module->paramQuantities.size());
+		for (size_t paramId = 0; paramId < module->paramQuantities.size(); paramId++) {
+			engine::ParamQuantity* pq = module->paramQuantities[paramId];
+			// Don't serialize unbounded Params
+			if (!pq->isBounded())
+				continue;
+			m.params.push_back(std::make_pair((uint32_t) paramId, pq->getValue()));
+		}
+	}
+
+	if (module->isBypassed())
+		m.flags |= BINARY_BYPASS;
+	if (module->leftExpander.moduleId >= 0)
+		m.leftModuleId = module->leftExpander.moduleId;
+	if (module->rightExpander.moduleId >= 0)
+		m.rightModuleId = module->rightExpander.moduleId;
+
+	json_t* dataJ = module->dataToJson();
+	if (dataJ) {
+		DEFER({json_decref(dataJ);});
+		collectBlobHashes(dataJ, blobHashes);
+		m.flags |= BINARY_DATA;
+		m.data = dumpBinaryJson(dataJ);
+	}
+
+	if (mw) {
+		math::Vec pos = getModuleGridPos(mw);
+		m.flags |= BINARY_POS;
+		m.x = pos.x;
+		m.y = pos.y;
+	}
+	return m;
+}
+
+
+/** Writes the patch as a binary patch directly from the Engine and RackWidget, and inserts the blob hashes it references into `blobHashes`.
+If `markSaved` is set, the snapshot doesn't say that the patch is unsaved.
+*/
+static std::vector<uint8_t> Manager_toBinary(Manager* that, bool markSaved, std::set<std::string>& blobHashes) {
+	json_t* propertiesJ = Manager_propertiesToJson(that);
+	DEFER({json_decref(propertiesJ);});
+	if (markSaved)
+		json_object_del(propertiesJ, "unsaved");
+	engine::Module* masterModule = APP->engine->getMasterModule();
+	if (masterModule)
+		json_object_set_new(propertiesJ, "masterModuleId", json_integer(masterModule->id));
+
+	BinaryWriter writer;
+	writer.writeHeader(dumpBinaryJson(propertiesJ));
+
+	// modules
+	std::vector<engine::Module*> modules;
+	for (int64_t moduleId : APP->engine->getModuleIds()) {
+		engine::Module* module = APP->engine->getModule(moduleId);
+		if (module)
+			modules.push_back(module);
+	}
+	writer.writeNumber<uint32_t>(modules.size());
+	for (engine::Module* module : modules) {
+		app::ModuleWidget* mw = APP->scene ? APP->scene->rack->getModule(module->id) : NULL;
+		writer.writeModule(Manager_moduleToBinary(module, mw, blobHashes));
+	}
+
+	// cables
+	std::map<widget::Widget*, int> plugOrders;
+	if (APP->scene)
+		plugOrders = APP->scene->rack->getPlugOrders();
+	std::vector<engine::Cable*> cables;
+	for (int64_t cableId : APP->engine->getCableIds()) {
+		engine::Cable* cable = APP->engine->getCable(cableId);
+		if (cable)
+			cables.push_back(cable);
+	}
+	writer.writeNumber<uint32_t>(cables.size());
+	for (engine::Cable* cable : cables) {
+		BinaryCable c;
+		c.id = cable->id;
+		c.outputModuleId = cable->outputModule->id;
+		c.outputId = cable->outputId;
+		c.inputModuleId = cable->inputModule->id;
+		c.inputId = cable->inputId;
+		app::CableWidget* cw = APP->scene ? APP->scene->rack->getCable(cable->id) : NULL;
+		if (cw) {
+			c.flags |= BINARY_COLOR;
+			c.color = color::toHexString(cw->color);
+			auto it = plugOrders.find(cw->inputPlug);
+			if (it != plugOrders.end()) {
+				c.flags |= BINARY_INPUT_PLUG_ORDER;
+				c.inputPlugOrder = it->second;
+			}
+			it = plugOrders.find(cw->outputPlug);
+			if (it != plugOrders.end()) {
+				c.flags |= BINARY_OUTPUT_PLUG_ORDER;
+				c.outputPlugOrder = it->second;
+			}
+		}
+		writer.writeCable(c);
+	}
+	return std::move(writer.data);
+}
+
+
+/** Creates a Module from a binary patch record, like Engine::modulesFromJson(), and sets `pos` to the position of its ModuleWidget box.
+Returns NULL if the module can't be loaded.
+*/
+static engine::Module* moduleFromBinary(const BinaryModule& m, size_t index, math::Vec* pos) {
+	json_t* moduleJ = NULL;
+	DEFER({json_decref(moduleJ);});
+
+	// Get model
+	plugin::Model* model;
+	try {
+		if (m.flags & BINARY_JSON) {
+			moduleJ = parseBinaryJson(m.json);
+			model = plugin::modelFromJson(moduleJ);
+		}
+		else {
+			model = plugin::getModelFallback(plugin::normalizeSlug(m.plugin), plugin::normalizeSlug(m.model));
+			if (!model)
+				throw Exception("Could not find module %s/%s", m.plugin.c_str(), m.model.c_str());
+			model = plugin::loadModel(model);
+		}
+	}
+	catch (Exception& e) {
+		WARN("Cannot load model: %s", e.what());
+		return NULL;
+	}
+
+	// Create module
+	INFO("Creating module %s", model->getFullName().c_str());
+	engine::Module* module = model->createModule();
+	assert(module);
+
+	try {
+		// A plugin's fromJson() may read anything, so give it JSON
+		if (!moduleJ && isOverridden(module, &engine::Module::fromJson))
+			moduleJ = binaryModuleToJson(m);
+
+		if (moduleJ) {
+			module->fromJson(moduleJ);
+		}
+		else {
+			// Read what Module::fromJson() would, without building its JSON
+			if (m.version != model->plugin->version) {
+				INFO("Patch created with %s %s, currently using version %s.", model->plugin->slug.c_str(), m.version.c_str(), model->plugin->version.c_str());
+			}
+			// Only set ID if unset
+			if (module->id < 0)
+				module->id = m.id;
+
+			if ((m.flags & BINARY_PARAMS_JSON) || ((m.flags & BINARY_PARAMS) && isOverridden(module, &engine::Module::paramsFromJson))) {
+				json_t* paramsJ = binaryParamsToJson(m);
+				DEFER({json_decref(paramsJ);});
+				module->paramsFromJson(paramsJ);
+			}
+			else {
+				for (const std::pair<uint32_t, float>& param : m.params) {
+					// Check ID bounds
+					if (param.first >= module->paramQuantities.size())
+						continue;
+					engine::ParamQuantity* pq = module->paramQuantities[param.first];
+					// Check that the Param is bounded
+					if (!pq->isBounded())
+						continue;
+					pq->setImmediateValue(param.second);
+				}
+			}
+
+			if (m.flags & BINARY_BYPASS)
+				module->setBypassed(true);
+			if (m.leftModuleId >= 0)
+				module->leftExpander.moduleId = m.leftModuleId;
+			if (m.rightModuleId >= 0)
+				module->rightExpander.moduleId = m.rightModuleId;
+
+			if (m.flags & BINARY_DATA) {
+				json_t* dataJ = parseBinaryJson(m.data);
+				DEFER({json_decref(dataJ);});
+				module->dataFromJson(dataJ);
+			}
+		}
+
+		if (module->id < 0)
+			module->id = index;
+	}
+	catch (Exception& e) {
+		WARN("Cannot load module: %s", e.what());
+		delete module;
+		return NULL;
+	}
+
+	// pos
+	math::Vec gridPos;
+	if (m.flags & BINARY_JSON) {
+		double x = 0.0, y = 0.0;
+		json_unpack(json_object_get(moduleJ, "pos"), "[F, F]", &x, &y);
+		gridPos = math::Vec(x, y);
+	}
+	else {
+		gridPos = math::Vec(m.x, m.y);
+	}
+	*pos = gridPos.mult(app::RACK_GRID_SIZE).plus(app::RACK_OFFSET);
+	return module;
+}
+
+
+/** Creates a Cable from a binary patch record and adds it to the Engine, like Engine::fromJson().
+Returns NULL if the cable can't be loaded.
+*/
+static engine::Cable* cableFromBinary(const BinaryCable& c, size_t index) {
+	engine::Cable* cable = new engine::Cable;
+	try {
+		cable->id = c.id;
+		cable->inputModule = APP->engine->getModule(c.inputModuleId);
+		if (!cable->inputModule)
+			throw Exception("Input module %lld not found for cable %lld", (long long) c.inputModuleId, (long long) c.id);
+		cable->inputId = c.inputId;
+		cable->outputModule = APP->engine->getModule(c.outputModuleId);
+		if (!cable->outputModule)
+			throw Exception("Output module %lld not found for cable %lld", (long long) c.outputModuleId, (long long) c.id);
+		cable->outputId = c.outputId;
+		if (cable->id < 0)
+			cable->id = index;
+		APP->engine->addCable(cable);
+	}
+	catch (Exception& e) {
+		WARN("Cannot load cable: %s", e.what());
+		delete cable;
+		return NULL;
+	}
+	return cable;
+}
+
+
+/** Loads a decoded binary patch directly into the Engine and RackWidget, like fromJson(). */
+static void Manager_fromBinary(Manager* that, const BinaryPatch& patch) {
+	json_t* propertiesJ = parseBinaryJson(patch.properties);
+	DEFER({json_decref(propertiesJ);});
+
+	that->clear();
+	Manager_propertiesFromJson(that, propertiesJ);
+
+	try {
+		// Construct modules while patch storage files may still be extracting
+		std::vector<engine::Module*> modules;
+		std::vector<math::Vec> positions;
+		for (size_t i = 0; i < patch.modules.size(); i++) {
+			math::Vec pos;
+			engine::Module* module = moduleFromBinary(patch.modules[i], i, &pos);
+			if (!module)
+				continue;
+			modules.push_back(module);
+			positions.push_back(pos);
+		}
+		// Modules load patch storage in onAdd(), so extraction must finish before they are added.
+		Manager_joinExtraction(that);
+		if (!that->internal->extractError.empty()) {
+			// load() reports the error
+			for (engine::Module* module : modules) {
+				delete module;
+			}
+			return;
+		}
+
+		std::vector<app::RackWidget::ModuleLayout> moduleLayouts;
+		for (size_t i = 0; i < modules.size(); i++) {
+			APP->engine->addModule(modules[i]);
+			app::RackWidget::ModuleLayout ml;
+			ml.id = modules[i]->id;
+			ml.pos = positions[i];
+			moduleLayouts.push_back(ml);
+		}
+
+		std::vector<app::RackWidget::CableLayout> cableLayouts;
+		for (size_t i = 0; i < patch.cables.size(); i++) {
+			const BinaryCable& c = patch.cables[i];
+			engine::Cable* cable = cableFromBinary(c, i);
+			if (!cable)
+				continue;
+			app::RackWidget::CableLayout cl;
+			cl.id = cable->id;
+			cl.color = c.color;
+			cl.inputPlugOrder = c.inputPlugOrder;
+			cl.outputPlugOrder = c.outputPlugOrder;
+			cableLayouts.push_back(cl);
+		}
+
+		// masterModule
+		json_t* masterModuleIdJ = json_object_get(propertiesJ, "masterModuleId");
+		if (masterModuleIdJ) {
+			engine::Module* masterModule = APP->engine->getModule(json_integer_value(masterModuleIdJ));
+			APP->engine->setMasterModule(masterModule);
+		}
+
+		if (APP->scene) {
+			APP->scene->rack->fromLayout(moduleLayouts, cableLayouts);
+		}
+	}
+	catch (Exception& e) {
+		WARN("Cannot load patch: %s", e.what());
+	}
+}
+
+
 Manager::Manager() {
 	internal = new Internal;
 
@@ -40,12 +1729,25 @@ Manager::Manager() {
 
 	templatePath = asset::user("template.vcv");
 	factoryTemplatePath = asset::system("template.vcv");
+
+	internal->saveThreadRunning = true;
+	internal->saveThread = std::thread(Manager_saveThreadRun, this);
 }
 
 
 Manager::~Manager() {
-	// In safe mode, delete autosave dir.
-	if (settings::safeMode) {
+	// Finish writing queued and deferred saves and stop the save thread
+	waitForSaves();
+	{
+		std::lock_guard<std::mutex> lock(internal->saveMutex);
+		internal->saveThreadRunning = false;
+		internal->saveCv.notify_all();
+	}
+	if (internal->saveThread.joinable())
+		internal->saveThread.join();
+
+	// In safe mode or with a temporary autosave, delete autosave dir.
+	if (settings::safeMode || internal->temporaryAutosave) {
 		clearAutosave();
 	}
 	else {
@@ -58,10 +1760,23 @@ Manager::~Manager() {
 		cleanAutosave();
 	}
 
+	Manager_joinExtraction(this);
+	json_decref(internal->journalBaseJ);
 	delete internal;
 }
 
 
+void Manager::useTemporaryAutosave() {
+	std::string userAutosavePath = autosavePath;
+	autosavePath = asset::user("autosave-temporary");
+	clearAutosave();
+	internal->temporaryAutosave = true;
+	// Copy rather than hard-link, since the journal and module patch storage are modified in place
+	if (system::isDirectory(userAutosavePath))
+		system::copy(userAutosavePath, autosavePath);
+}
+
+
 void Manager::launch(std::string pathArg) {
 	// Don't load any patches if safe mode is enabled
 	if (settings::safeMode)
@@ -104,6 +1819,9 @@ void Manager::clear() {
 
 
 static bool promptClear(std::string text) {
+	// A save still being written marks the patch saved only when it completes, so finish it before asking.
+	if (!APP->history->isSaved())
+		APP->patch->waitForSaves();
 	if (APP->history->isSaved())
 		return true;
 	if (APP->scene->rack->hasModules())
@@ -112,23 +1830,128 @@ static bool promptClear(std::string text) {
 }
 
 
-void Manager::save(std::string path) {
+/** Snapshots the patch and queues it to be archived to `path`.
+If `markSaved` is set, the current history state is marked saved once the archive is written.
+*/
+static void Manager_save(Manager* that, const std::string& path, bool markSaved) {
+	Manager::Internal* internal = that->internal;
+	// Modules write patch storage in onSave(), so a previous archive must not be reading it.
+	// Rather than blocking the UI until it finishes, save again afterward, coalescing repeated saves to the same path.
+	if (Manager_isArchiving(that)) {
+		for (Manager::Internal::DeferredSave& deferredSave : internal->deferredSaves) {
+			if (deferredSave.path == path) {
+				deferredSave.markSaved = deferredSave.markSaved || markSaved;
+				return;
+			}
+		}
+		INFO("Deferring save of patch %s until the previous save is written", path.c_str());
+		internal->deferredSaves.push_back({path, markSaved});
+		return;
+	}
+
 	INFO("Saving patch %s", path.c_str());
 	// Dispatch SaveEvent to modules
 	APP->engine->prepareSave();
-	// Save patch.json
-	saveAutosave();
 	// Clean up autosave directory (e.g. removed modules)
-	cleanAutosave();
+	that->cleanAutosave();
 
 	// Take screenshot (disabled because there is currently no way to quickly view them on any OS or website.)
 	// APP->window->screenshot(system::join(autosavePath, "screenshot.png"));
 
-	double startTime = system::getTime();
-	// Set compression level to 1 so that a 500MB/s SSD is almost bottlenecked
-	system::archiveDirectory(path, autosavePath, 1);
-	double endTime = system::getTime();
-	INFO("Archived patch in %lf seconds", (endTime - startTime));
+	// Snapshot the patch, and write patch.json or patch.bin and the archive on the save thread
+	Manager::Internal::SaveJob job;
+	std::set<std::string> blobHashes;
+	if (settings::binaryPatches) {
+		try {
+			job.binary = Manager_toBinary(that, markSaved, blobHashes);
+		}
+		catch (Exception& e) {
+			WARN("Could not write binary patch: %s", e.what());
+			return;
+		}
+	}
+	else {
+		json_t* rootJ = that->toJson();
+		if (!rootJ)
+			return;
+		// The patch is saved once this snapshot is written, so the snapshot must not say otherwise.
+		if (markSaved)
+			json_object_del(rootJ, "unsaved");
+		collectPatchBlobHashes(rootJ, blobHashes);
+		job.rootJ = rootJ;
+	}
+	// A blob being added isn't listed by its module yet, so clean blobs on a later save.
+	if (!Manager_isAddingBlobs(that))
+		Manager_cleanBlobs(that, blobHashes);
+
+	job.archivePath = path;
+	job.markSaved = markSaved;
+	job.historyStateId = APP->history->getStateId();
+	Manager_enqueueSave(that, std::move(job));
+}
+
+
+/** Starts the oldest deferred save if no archive is being written.
+Returns whether a save was started.
+*/
+static bool Manager_startDeferredSave(Manager* that) {
+	Manager::Internal* internal = that->internal;
+	if (internal->deferredSaves.empty() || Manager_isArchiving(that))
+		return false;
+	Manager::Internal::DeferredSave deferredSave = internal->deferredSaves.front();
+	internal->deferredSaves.erase(internal->deferredSaves.begin());
+	Manager_save(that, deferredSave.path, deferredSave.markSaved);
+	return true;
+}
+
+
+/** Marks the history states of completed saves as saved. */
+static void Manager_markSavedStates(Manager* that) {
+	Manager::Internal* internal = that->internal;
+	std::vector<uint64_t> stateIds;
+	{
+		std::lock_guard<std::mutex> lock(internal->saveMutex);
+		stateIds.swap(internal->savedStateIds);
+	}
+	for (uint64_t stateId : stateIds) {
+		APP->history->setSavedStateId(stateId);
+	}
+}
+
+
+void Manager::save(std::string path) {
+	Manager_save(this, path, false);
+}
+
+
+void Manager::waitForSaves() {
+	do {
+		Manager_waitForSaves(this);
+	} while (Manager_startDeferredSave(this));
+	Manager_markSavedStates(this);
+	Manager_finishBlobJobs(this);
+}
+
+
+void Manager::step() {
+	Manager_startDeferredSave(this);
+	Manager_markSavedStates(this);
+	Manager_finishBlobJobs(this);
+}
+
+
+void Manager::showSaveErrors() {
+	std::vector<std::string> errors;
+	{
+		std::lock_guard<std::mutex> lock(internal->saveMutex);
+		if (internal->saveErrors.empty())
+			return;
+		errors.swap(internal->saveErrors);
+	}
+	for (const std::string& error : errors) {
+		std::string message = string::f("Could not save patch: %s", error.c_str());
+		osdialog_message(OSDIALOG_WARNING, OSDIALOG_OK, message.c_str());
+	}
 }
 
 
@@ -138,11 +1961,8 @@ void Manager::saveDialog() {
 		return;
 	}
 
-	// Note: If save() fails below, this should probably be reset. But we need it so toJson() doesn't set the "unsaved" property.
-	APP->history->setSaved();
-
 	try {
-		save(path);
+		Manager_save(this, path, true);
 	}
 	catch (Exception& e) {
 		std::string message = string::f("Could not save patch: %s", e.what());
@@ -186,13 +2006,13 @@ void Manager::saveAsDialog(bool setPath) {
 		path += ".vcv";
 	}
 
-	APP->history->setSaved();
 	if (setPath) {
 		this->path = path;
 	}
 
 	try {
-		save(path);
+		// A copy doesn't save the patch at its current path
+		Manager_save(this, path, setPath);
 	}
 	catch (Exception& e) {
 		std::string message = string::f("Could not save patch: %s", e.what());
@@ -221,31 +2041,33 @@ void Manager::saveTemplateDialog() {
 
 
 void Manager::saveAutosave() {
-	std::string patchPath = system::join(autosavePath, "patch.json");
-	INFO("Saving autosave %s", patchPath.c_str());
+	INFO("Saving autosave %s", autosavePath.c_str());
 	json_t* rootJ = toJson();
 	if (!rootJ)
 		return;
 	DEFER({json_decref(rootJ);});
 
-	// Write to temporary path and then rename it to the correct path
-	system::createDirectories(autosavePath);
-	std::string tmpPath = patchPath + ".tmp";
-	FILE* file = std::fopen(tmpPath.c_str(), "w");
-	if (!file) {
-		// Fail silently
-		return;
-	}
+	Manager_waitForSaves(this);
+	Manager_writeSnapshot(this, rootJ);
+}
 
-	json_dumpf(rootJ, file, JSON_INDENT(2));
-	std::fclose(file);
-	system::remove(patchPath);
-	system::rename(tmpPath, patchPath);
+
+void Manager::saveAutosaveAsync() {
+	json_t* rootJ = toJson();
+	if (!rootJ)
+		return;
+	Manager::Internal::SaveJob job;
+	job.rootJ = rootJ;
+	Manager_enqueueSave(this, std::move(job));
 }
 
 
 void Manager::clearAutosave() {
+	Manager_waitForSaves(this);
 	system::removeRecursively(autosavePath);
+	// The journal base no longer matches what's on disk
+	json_decref(internal->journalBaseJ);
+	internal->journalBaseJ = NULL;
 }
 
 
@@ -269,6 +2091,75 @@ void Manager::cleanAutosave() {
 }
 
 
+void Manager::addBlob(engine::Module* module, const std::string& filePath, std::function<void(const std::string& hash)> action) {
+	Manager::Internal::BlobJob job;
+	job.filePath = filePath;
+	job.moduleId = module->id;
+	job.module = module;
+	job.action = action;
+	std::lock_guard<std::mutex> lock(internal->saveMutex);
+	internal->blobJobs.push_back(std::move(job));
+	internal->saveCv.notify_all();
+}
+
+
+std::string Manager::addBlob(const std::vector<uint8_t>& data) {
+	std::string hash = hashBlobData(data.data(), data.size());
+	std::string blobPath = system::join(Manager_getBlobsDir(this), hash);
+	if (!system::isFile(blobPath)) {
+		system::createDirectories(Manager_getBlobsDir(this));
+		std::string tmpPath = blobPath + ".tmp";
+		system::writeFile(tmpPath, data);
+		if (!system::rename(tmpPath, blobPath)) {
+			system::remove(tmpPath);
+			throw Exception("Could not add blob %s", hash.c_str());
+		}
+	}
+	cacheBlob(blobPath, hash);
+	return hash;
+}
+
+
+std::string Manager::getBlobPath(const std::string& hash) {
+	// Don't allow arbitrary paths
+	if (!isBlobHash(hash))
+		return "";
+
+	std::string blobPath = system::join(Manager_getBlobsDir(this), hash);
+	if (system::isFile(blobPath))
+		return blobPath;
+
+	// Restore blob from user cache, e.g. for a module pasted from another patch
+	std::string cachePath = system::join(getBlobCacheDir(), hash);
+	if (!system::isFile(cachePath))
+		return "";
+	system::touchFile(cachePath);
+	system::createDirectories(Manager_getBlobsDir(this));
+	std::string tmpPath = blobPath + ".tmp";
+	if (!system::createHardLink(cachePath, tmpPath) && !system::copy(cachePath, tmpPath))
+		return "";
+	if (!system::rename(tmpPath, blobPath)) {
+		system::remove(tmpPath);
+		return "";
+	}
+	return blobPath;
+}
+
+
+std::shared_ptr<system::MappedFile> Manager::mapBlob(const std::string& hash) {
+	std::string blobPath = getBlobPath(hash);
+	if (blobPath.empty())
+		return NULL;
+	try {
+		return system::mapFile(blobPath);
+	}
+	catch (Exception& e) {
+		WARN("Could not map blob %s: %s", hash.c_str(), e.what());
+		return NULL;
+	}
+}
+
+
 static bool isPatchLegacyV1(std::string path) {
 	FILE* f = std::fopen(path.c_str(), "rb");
 	if (!f)
@@ -286,6 +2177,8 @@ static bool isPatchLegacyV1(std::string path) {
 void Manager::load(std::string path) {
 	INFO("Loading patch %s", path.c_str());
 
+	// The save thread must not write to the autosave dir while it is replaced, and deferred saves must save the previous patch
+	waitForSaves();
 	clear();
 	clearAutosave();
 	system::createDirectories(autosavePath);
@@ -295,14 +2188,20 @@ void Manager::load(std::string path) {
 		system::copy(path, system::join(autosavePath, "patch.json"));
 	}
 	else {
-		// Extract the .vcv file as a .tar.zst archive.
-		double startTime = system::getTime();
-		system::unarchiveToDirectory(path, autosavePath);
-		double endTime = system::getTime();
-		INFO("Unarchived patch in %lf seconds", (endTime - startTime));
+		// Extract the .vcv file as a .tar.zst archive, and start loading as soon as patch.json is available.
+		Manager_startExtraction(this, path);
+		Manager_waitForPatchJson(this);
 	}
 
-	loadAutosave();
+	// Extraction must finish even if loading fails, and its error takes precedence since it's the likely cause.
+	try {
+		loadAutosave();
+	}
+	catch (Exception& e) {
+		Manager_finishExtraction(this);
+		throw;
+	}
+	Manager_finishExtraction(this);
 }
 
 
@@ -342,26 +2241,72 @@ bool Manager::hasAutosave() {
 	std::string patchPath = system::join(autosavePath, "patch.json");
 	FILE* file = std::fopen(patchPath.c_str(), "r");
 	if (!file)
-		return false;
+		return system::isFile(system::join(autosavePath, "patch.bin"));
 	std::fclose(file);
 	return true;
 }
 
 
+/** Loads patch.bin from the autosave dir. */
+static void Manager_loadPatchBin(Manager* that, const std::string& patchPath) {
+	INFO("Loading autosave %s", patchPath.c_str());
+	std::shared_ptr<system::MappedFile> file;
+	try {
+		file = system::mapFile(patchPath);
+	}
+	catch (Exception& e) {
+		throw Exception("Could not open autosave patch %s", patchPath.c_str());
+	}
+	// Decode straight from the mapping, reading the whole file ahead
+	file->prefetch();
+	BinaryPatch patch = decodeBinaryPatch(file->getData(), file->getSize());
+	file.reset();
+
+	// Check only the modules that would fail to load
+	json_t* rootJ = json_object();
+	DEFER({json_decref(rootJ);});
+	json_t* modulesJ = json_array();
+	json_object_set_new(rootJ, "modules", modulesJ);
+	for (const BinaryModule& m : patch.modules) {
+		if (m.flags & BINARY_JSON) {
+			json_array_append_new(modulesJ, parseBinaryJson(m.json));
+		}
+		else if (!plugin::getModelFallback(plugin::normalizeSlug(m.plugin), plugin::normalizeSlug(m.model))) {
+			json_array_append_new(modulesJ, json_pack("{s:s#, s:s#}", "plugin", m.plugin.data(), (int) m.plugin.size(), "model", m.model.data(), (int) m.model.size()));
+		}
+	}
+	that->checkUnavailableModulesJson(rootJ);
+
+	Manager_fromBinary(that, patch);
+}
+
+
 void Manager::loadAutosave() {
 	std::string patchPath = system::join(autosavePath, "patch.json");
+	// Patches saved with settings::binaryPatches extract patch.bin, which is the autosave until an autosave writes patch.json.
+	std::string binPath = system::join(autosavePath, "patch.bin");
+	if (!system::isFile(patchPath) && system::isFile(binPath)) {
+		Manager_loadPatchBin(this, binPath);
+		return;
+	}
 	INFO("Loading autosave %s", patchPath.c_str());
-	FILE* file = std::fopen(patchPath.c_str(), "r");
-	if (!file)
+	std::vector<uint8_t> data;
+	try {
+		data = system::readFile(patchPath);
+	}
+	catch (Exception& e) {
 		throw Exception("Could not open autosave patch %s", patchPath.c_str());
-	DEFER({std::fclose(file);});
+	}
 
 	json_error_t error;
-	json_t* rootJ = json_loadf(file, 0, &error);
+	json_t* rootJ = json_loadb((const char*) data.data(), data.size(), 0, &error);
 	if (!rootJ)
 		throw Exception("Failed to load patch. JSON parsing error at %s %d:%d %s", error.source, error.line, error.column, error.text);
 	DEFER({json_decref(rootJ);});
 
+	// Recover changes autosaved since patch.json was written
+	replayJournal(autosavePath, rootJ, hashBlobData(data.data(), data.size()));
+
 	checkUnavailableModulesJson(rootJ);
 
 	fromJson(rootJ);
@@ -449,33 +2394,7 @@ void Manager::disconnectDialog() {
 
 
 json_t* Manager::toJson() {
-	// root
-	json_t* rootJ = json_object();
-
-	// version
-	json_t* versionJ = json_string(APP_VERSION.c_str());
-	json_object_set_new(rootJ, "version", versionJ);
-
-	// path
-	if (path != "") {
-		json_t* pathJ = json_string(path.c_str());
-		json_object_set_new(rootJ, "path", pathJ);
-	}
-
-	// unsaved
-	if (!APP->history->isSaved())
-		json_object_set_new(rootJ, "unsaved", json_boolean(true));
-
-	if (APP->scene) {
-		// zoom
-		float zoom = APP->scene->rackScroll->getZoom();
-		json_object_set_new(rootJ, "zoom", json_real(zoom));
-
-		// gridOffset
-		math::Vec gridOffset = APP->scene->rackScroll->getGridOffset();
-		json_t* gridOffsetJ = json_pack("[f, f]", gridOffset.x, gridOffset.y);
-		json_object_set_new(rootJ, "gridOffset", gridOffsetJ);
-	}
+	json_t* rootJ = Manager_propertiesToJson(this);
 
 	// Merge with Engine JSON
 	json_t* engineJ = APP->engine->toJson();
@@ -493,46 +2412,22 @@ json_t* Manager::toJson() {
 
 void Manager::fromJson(json_t* rootJ) {
 	clear();
-
-	// version
-	std::string version;
-	json_t* versionJ = json_object_get(rootJ, "version");
-	if (versionJ)
-		version = json_string_value(versionJ);
-	if (version != APP_VERSION) {
-		INFO("Patch was made with Rack %s, current Rack version is %s", version.c_str(), APP_VERSION.c_str());
-	}
-
-	// path
-	json_t* pathJ = json_object_get(rootJ, "path");
-	if (pathJ)
-		path = json_string_value(pathJ);
-	else
-		path = "";
-
-	// unsaved
-	json_t* unsavedJ = json_object_get(rootJ, "unsaved");
-	if (!unsavedJ)
-		APP->history->setSaved();
-
-	if (APP->scene) {
-		// zoom
-		json_t* zoomJ = json_object_get(rootJ, "zoom");
-		if (zoomJ)
-			APP->scene->rackScroll->setZoom(json_number_value(zoomJ));
-
-		// gridOffset
-		json_t* gridOffsetJ = json_object_get(rootJ, "gridOffset");
-		if (gridOffsetJ) {
-			double x, y;
-			json_unpack(gridOffsetJ, "[F, F]", &x, &y);
-			APP->scene->rackScroll->setGridOffset(math::Vec(x, y));
-		}
-	}
+	Manager_propertiesFromJson(this, rootJ);
 
 	// Pass JSON to Engine and RackWidget
 	try {
-		APP->engine->fromJson(rootJ);
+		// Construct modules while patch storage files may still be extracting
+		std::vector<engine::Module*> modules = APP->engine->modulesFromJson(rootJ);
+		// Modules load patch storage in onAdd(), so extraction must finish before they are added.
+		Manager_joinExtraction(this);
+		if (!internal->extractError.empty()) {
+			// load() reports the error
+			for (engine::Module* module : modules) {
+				delete module;
+			}
+			return;
+		}
+		APP->engine->fromJson(rootJ, modules);
 		if (APP->scene) {
 			APP->scene->rack->fromJson(rootJ);
 		}
@@ -593,5 +2488,68 @@ bool Manager::checkUnavailableModulesJson(json_t* rootJ) {
 }
 
 
+void Manager::benchmarkSerialization(int iterations) {
+	double toJsonTime = 0.0;
+	double dumpTime = 0.0;
+	double loadTime = 0.0;
+	double fromJsonTime = 0.0;
+	double toBinaryTime = 0.0;
+	double fromBinaryTime = 0.0;
+	size_t size = 0;
+	size_t binarySize = 0;
+	std::string savedPath = path;
+	try {
+		for (int i = 0; i < iterations; i++) {
+			// Binary patch, written and read directly from the Engine and RackWidget
+			double startTime = system::getTime();
+			std::set<std::string> blobHashes;
+			std::vector<uint8_t> binary = Manager_toBinary(this, false, blobHashes);
+			binarySize = binary.size();
+			toBinaryTime += system::getTime() - startTime;
+
+			startTime = system::getTime();
+			Manager_fromBinary(this, decodeBinaryPatch(binary.data(), binary.size()));
+			fromBinaryTime += system::getTime() - startTime;
+		}
+	}
+	catch (Exception& e) {
+		WARN("Could not benchmark binary patch: %s", e.what());
+		return;
+	}
+	for (int i = 0; i < iterations; i++) {
+		// patch.json
+		double startTime = system::getTime();
+		json_t* rootJ = toJson();
+		if (!rootJ)
+			return;
+		toJsonTime += system::getTime() - startTime;
+
+		startTime = system::getTime();
+		char* str = json_dumps(rootJ, JSON_INDENT(2));
+		json_decref(rootJ);
+		if (!str)
+			return;
+		DEFER({std::free(str);});
+		size = std::strlen(str);
+		dumpTime += system::getTime() - startTime;
+
+		startTime = system::getTime();
+		json_error_t error;
+		rootJ = json_loadb(str, size, 0, &error);
+		if (!rootJ)
+			return;
+		DEFER({json_decref(rootJ);});
+		loadTime += system::getTime() - startTime;
+
+		startTime = system::getTime();
+		fromJson(rootJ);
+		fromJsonTime += system::getTime() - startTime;
+	}
+	path = savedPath;
+	INFO("Patch with %d modules, %" PRIuPTR " bytes of JSON: mean toJson() %.3f ms, json_dumps() %.3f ms, json_loads() %.3f ms, fromJson() %.3f ms", (int) APP->engine->getNumModules(), (uintptr_t) size, toJsonTime / iterations * 1e3, dumpTime / iterations * 1e3, loadTime / iterations * 1e3, fromJsonTime / iterations * 1e3);
+	INFO("%" PRIuPTR " bytes of binary patch: mean write %.3f ms, read %.3f ms", (uintptr_t) binarySize, toBinaryTime / iterations * 1e3, fromBinaryTime / iterations * 1e3);
+}
+
+
 } // namespace patch
 } // namespace rack
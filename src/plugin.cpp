@@ -1,6 +1,10 @@
 #include <arch.hpp>
 
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <algorithm>
 #include <map>
 #include <stdexcept>
 #include <tuple>
@@ -125,74 +129,416 @@ static InitCallback loadPluginCallback(Plugin* plugin) {
 }
 
 
-/** If path is blank, loads Core */
-static Plugin* loadPlugin(std::string path) {
-	if (path == "")
-		INFO("Loading Core plugin");
-	else
-		INFO("Loading plugin from %s", path.c_str());
+/** Calls `f(i)` for each `i` in [0, n) on up to getLogicalCoreCount() threads.
+`f` must not throw.
+*/
+static void parallelFor(size_t n, const std::function<void(size_t)>& f) {
+	size_t threadCount = std::min(n, (size_t) std::max(system::getLogicalCoreCount(), 1));
+	if (threadCount <= 1) {
+		for (size_t i = 0; i < n; i++)
+			f(i);
+		return;
+	}
 
-	Plugin* plugin = new Plugin;
-	try {
-		// Set plugin path
-		plugin->path = (path == "") ? asset::systemDir : path;
+	std::atomic<size_t> index{0};
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < threadCount; t++) {
+		threads.emplace_back([&]() {
+			size_t i;
+			while ((i = index++) < n)
+				f(i);
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+}
 
-		// Get modified timestamp
-		if (path != "") {
-			struct stat statbuf;
-			if (!stat(path.c_str(), &statbuf)) {
+
+/** Time spent in each plugin loading phase, logged at the end of init(). */
+struct LoadTimes {
+	double extract = 0.0;
+	double manifests = 0.0;
+	double libraries = 0.0;
+	double initCallbacks = 0.0;
+	double modules = 0.0;
+};
+static LoadTimes loadTimes;
+
+
+/** Returns the modification time of a file or directory in seconds, or -INFINITY if it does not exist. */
+static double getModifiedTimestamp(const std::string& path) {
+	struct stat statbuf;
+	if (stat(path.c_str(), &statbuf))
+		return -INFINITY;
 #if defined ARCH_MAC
-				plugin->modifiedTimestamp = (double) statbuf.st_mtimespec.tv_sec + statbuf.st_mtimespec.tv_nsec * 1e-9;
+	return (double) statbuf.st_mtimespec.tv_sec + statbuf.st_mtimespec.tv_nsec * 1e-9;
 #elif defined ARCH_WIN
-				plugin->modifiedTimestamp = (double) statbuf.st_mtime;
+	return (double) statbuf.st_mtime;
 #elif defined ARCH_LIN
-				plugin->modifiedTimestamp = (double) statbuf.st_mtim.tv_sec + statbuf.st_mtim.tv_nsec * 1e-9;
+	return (double) statbuf.st_mtim.tv_sec + statbuf.st_mtim.tv_nsec * 1e-9;
 #endif
-			}
+}
+
+
+/** A plugin whose manifest has been parsed but whose library has not been loaded. */
+struct PendingPlugin {
+	/** Blank for Core */
+	std::string path;
+	Plugin* plugin = NULL;
+	json_t* rootJ = NULL;
+	/** Compact JSON of the manifest in the manifest cache buffer, set if plugin.json is unchanged since it was cached.
+	Parsed by readPluginManifest() so cache hits are parsed in parallel too.
+	*/
+	const char* cachedManifest = NULL;
+	size_t cachedManifestSize = 0;
+	/** Modification time and size of plugin.json, used to validate the manifest cache */
+	double manifestTimestamp = -INFINITY;
+	uint64_t manifestSize = 0;
+};
+
+
+////////////////////
+// Manifest cache
+////////////////////
+
+/** Manifests of all plugins in `pluginsPath`, stored in a single file so warm starts read one file instead of one per plugin.
+The first line identifies the Rack version, since manifest parsing may change between versions.
+Each entry is a line "<timestamp> <size> <length> <plugin path>" followed by `length` bytes of compact manifest JSON and a newline.
+Entries are invalidated when the modification time or size of plugin.json changes.
+Manifests are stored as opaque JSON text rather than one JSON document, so reading the file only indexes it, and entries are parsed in parallel like plugin.json files.
+*/
+static std::string getManifestCachePath() {
+	return pluginsPath + "-manifests.cache";
+}
+
+
+static std::string getManifestCacheHeader() {
+	return "Rack plugin manifest cache " + APP_VERSION + "\n";
+}
+
+
+struct ManifestCacheEntry {
+	double timestamp;
+	uint64_t size;
+	size_t offset;
+	size_t length;
+};
+
+
+struct ManifestCache {
+	std::vector<uint8_t> data;
+	std::map<std::string, ManifestCacheEntry> entries;
+};
+
+
+/** Reads and indexes the manifest cache.
+Leaves `cache` empty if the cache does not exist, is truncated, or was written by a different Rack version.
+*/
+static void loadManifestCache(ManifestCache& cache) {
+	std::string cachePath = getManifestCachePath();
+	if (!system::isFile(cachePath))
+		return;
+	try {
+		cache.data = system::readFile(cachePath);
+	}
+	catch (Exception& e) {
+		WARN("Could not read plugin manifest cache %s: %s", cachePath.c_str(), e.what());
+		return;
+	}
+
+	const char* data = (const char*) cache.data.data();
+	size_t size = cache.data.size();
+	std::string header = getManifestCacheHeader();
+	if (size < header.size() || std::memcmp(data, header.data(), header.size()) != 0)
+		return;
+
+	size_t pos = header.size();
+	while (pos < size) {
+		const char* lineEnd = (const char*) std::memchr(data + pos, '\n', size - pos);
+		if (!lineEnd)
+			break;
+		std::string line(data + pos, lineEnd);
+		pos = lineEnd - data + 1;
+
+		ManifestCacheEntry entry;
+		unsigned long long fileSize;
+		unsigned long long length;
+		int pathOffset = -1;
+		if (std::sscanf(line.c_str(), "%lf %llu %llu %n", &entry.timestamp, &fileSize, &length, &pathOffset) < 3 || pathOffset < 0)
+			break;
+		if (length + 1 > size - pos)
+			break;
+		entry.size = fileSize;
+		entry.offset = pos;
+		entry.length = length;
+		cache.entries[line.substr(pathOffset)] = entry;
+		pos += length + 1;
+	}
+	if (pos != size) {
+		WARN("Plugin manifest cache %s is corrupted, ignoring", cachePath.c_str());
+		cache.entries.clear();
+	}
+}
+
+
+/** Sets `pending.cachedManifest` if plugin.json is unchanged since it was cached. */
+static void lookUpManifestCache(const ManifestCache& cache, PendingPlugin& pending) {
+	std::string manifestFilename = system::join(pending.path, "plugin.json");
+	pending.manifestTimestamp = getModifiedTimestamp(manifestFilename);
+	pending.manifestSize = system::getFileSize(manifestFilename);
+
+	auto it = cache.entries.find(pending.path);
+	if (it == cache.entries.end())
+		return;
+	const ManifestCacheEntry& entry = it->second;
+	if (entry.timestamp != pending.manifestTimestamp)
+		return;
+	if (entry.size != pending.manifestSize)
+		return;
+	pending.cachedManifest = (const char*) cache.data.data() + entry.offset;
+	pending.cachedManifestSize = entry.length;
+}
+
+
+static void saveManifestCache(const std::vector<PendingPlugin>& pendings) {
+	std::string cachePath = getManifestCachePath();
+	INFO("Saving plugin manifest cache %s", cachePath.c_str());
+
+	std::string tmpPath = cachePath + ".tmp";
+	FILE* file = std::fopen(tmpPath.c_str(), "wb");
+	if (!file) {
+		WARN("Could not open plugin manifest cache %s for writing", tmpPath.c_str());
+		return;
+	}
+	std::string header = getManifestCacheHeader();
+	bool ok = (std::fwrite(header.data(), 1, header.size(), file) == header.size());
+	for (const PendingPlugin& pending : pendings) {
+		if (!ok)
+			break;
+		if (!pending.rootJ)
+			continue;
+		char* manifest = json_dumps(pending.rootJ, JSON_COMPACT);
+		if (!manifest)
+			continue;
+		DEFER({std::free(manifest);});
+		size_t length = std::strlen(manifest);
+		// %.17g round-trips doubles exactly, so timestamps compare equal when reloaded
+		ok = ok && std::fprintf(file, "%.17g %llu %llu %s\n", pending.manifestTimestamp, (unsigned long long) pending.manifestSize, (unsigned long long) length, pending.path.c_str()) >= 0;
+		ok = ok && std::fwrite(manifest, 1, length, file) == length;
+		ok = ok && std::fputc('\n', file) != EOF;
+	}
+	// fclose() flushes the buffer, so a full disk may only be reported here.
+	if (std::fclose(file) != 0)
+		ok = false;
+	if (!ok) {
+		// A truncated cache would only be rejected as corrupted on next launch, so keep the previous one instead.
+		WARN("Could not write plugin manifest cache %s", tmpPath.c_str());
+		system::remove(tmpPath);
+		return;
+	}
+	// Renaming over the previous cache is atomic on POSIX. Some Windows runtimes refuse to replace an existing file.
+	if (!system::rename(tmpPath, cachePath)) {
+		system::remove(cachePath);
+		if (!system::rename(tmpPath, cachePath)) {
+			WARN("Could not move plugin manifest cache to %s", cachePath.c_str());
+			system::remove(tmpPath);
 		}
+	}
+}
 
-		// Load plugin.json
-		std::string manifestFilename = (path == "") ? asset::system("Core.json") : system::join(path, "plugin.json");
-		FILE* file = std::fopen(manifestFilename.c_str(), "r");
-		if (!file)
-			throw Exception("Manifest file %s does not exist", manifestFilename.c_str());
-		DEFER({std::fclose(file);});
 
+/** Reads the timestamp and manifest of a plugin.
+Does not touch global state, so manifests of different plugins can be read in parallel.
+Throws Exception on failure.
+*/
+static void readPluginManifest(PendingPlugin& pending) {
+	const std::string& path = pending.path;
+	Plugin* plugin = pending.plugin;
+
+	// Set plugin path
+	plugin->path = (path == "") ? asset::systemDir : path;
+
+	// Get modified timestamp
+	if (path != "") {
+		plugin->modifiedTimestamp = getModifiedTimestamp(path);
+	}
+
+	// Load manifest from cache
+	if (pending.cachedManifest) {
 		json_error_t error;
-		json_t* rootJ = json_loadf(file, 0, &error);
-		if (!rootJ)
-			throw Exception("JSON parsing error at %s %d:%d %s", manifestFilename.c_str(), error.line, error.column, error.text);
-		DEFER({json_decref(rootJ);});
+		pending.rootJ = json_loadb(pending.cachedManifest, pending.cachedManifestSize, 0, &error);
+		if (pending.rootJ) {
+			plugin->fromJson(pending.rootJ);
+			return;
+		}
+		WARN("Cached manifest of %s has invalid JSON at %d:%d %s, reading plugin.json", path.c_str(), error.line, error.column, error.text);
+		pending.cachedManifest = NULL;
+	}
+
+	// Load plugin.json
+	std::string manifestFilename = (path == "") ? asset::system("Core.json") : system::join(path, "plugin.json");
+	FILE* file = std::fopen(manifestFilename.c_str(), "r");
+	if (!file)
+		throw Exception("Manifest file %s does not exist", manifestFilename.c_str());
+	DEFER({std::fclose(file);});
+
+	json_error_t error;
+	json_t* rootJ = json_loadf(file, 0, &error);
+	if (!rootJ)
+		throw Exception("JSON parsing error at %s %d:%d %s", manifestFilename.c_str(), error.line, error.column, error.text);
+	pending.rootJ = rootJ;
+
+	// Load manifest
+	plugin->fromJson(rootJ);
+}
+
+
+/** Calls the plugin's settingsFromJson() if exists.
+Does nothing for Core.
+*/
+static void loadPluginSettings(Plugin* plugin) {
+	auto settingsFromJson = (decltype(&::settingsFromJson)) getSymbol(plugin->handle, "settingsFromJson");
+	if (settingsFromJson) {
+		json_t* settingsJ = json_object_get(settings::pluginSettingsJ, plugin->slug.c_str());
+		if (settingsJ)
+			settingsFromJson(settingsJ);
+	}
+}
+
+
+////////////////////
+// Lazy loading
+////////////////////
+
+/** Stands in for a Model of a plugin whose library is not loaded yet.
+Metadata is read from the manifest. Creating a Module or ModuleWidget loads the library and forwards to the Model it defines.
+*/
+struct DeferredModel : Model {
+	/** The Model defined by the plugin library, once loaded */
+	Model* loadedModel = NULL;
+
+	engine::Module* createModule() override {
+		return loadModel(this)->createModule();
+	}
+	app::ModuleWidget* createModuleWidget(engine::Module* m) override {
+		return loadModel(this)->createModuleWidget(m);
+	}
+};
+
+
+struct DeferredPlugin {
+	json_t* modulesJ = NULL;
+	/** Owned, since they are not referenced by the plugin library. */
+	std::vector<DeferredModel*> models;
+	bool loaded = false;
+	/** Set if loading the library failed, so it is not attempted again. */
+	std::string error;
+};
+
+
+static std::map<Plugin*, DeferredPlugin> deferredPlugins;
+static std::mutex deferredPluginsMutex;
+
+
+/** Creates DeferredModels from the modules manifest instead of loading the plugin library. */
+static void deferPluginLibrary(Plugin* plugin, json_t* modulesJ) {
+	size_t moduleId;
+	json_t* moduleJ;
+	json_array_foreach(modulesJ, moduleId, moduleJ) {
+		// Invalid entries are reported by modulesFromJson()
+		json_t* modelSlugJ = json_object_get(moduleJ, "slug");
+		if (!modelSlugJ)
+			continue;
+		DeferredModel* model = new DeferredModel;
+		model->slug = json_string_value(modelSlugJ);
+		plugin->addModel(model);
+	}
+	plugin->modulesFromJson(modulesJ);
+
+	std::lock_guard<std::mutex> lock(deferredPluginsMutex);
+	DeferredPlugin& deferred = deferredPlugins[plugin];
+	deferred.modulesJ = json_incref(modulesJ);
+	for (Model* model : plugin->models) {
+		deferred.models.push_back(static_cast<DeferredModel*>(model));
+	}
+}
+
+
+/** Loads the library of a deferred plugin and replaces its DeferredModels with the Models defined by the library.
+`deferredPluginsMutex` must be locked.
+*/
+static void loadDeferredPlugin_NoLock(Plugin* plugin, DeferredPlugin& deferred) {
+	if (deferred.loaded)
+		return;
+	if (!deferred.error.empty())
+		throw Exception("%s", deferred.error.c_str());
 
-		// Load manifest
-		plugin->fromJson(rootJ);
+	INFO("Loading deferred plugin library %s", plugin->slug.c_str());
+	plugin->models.clear();
+	try {
+		InitCallback initCallback = loadPluginCallback(plugin);
+		initCallback(plugin);
+		plugin->modulesFromJson(deferred.modulesJ);
+		loadPluginSettings(plugin);
+	}
+	catch (Exception& e) {
+		deferred.error = string::f("Could not load plugin %s: %s", plugin->slug.c_str(), e.what());
+		WARN("%s", deferred.error.c_str());
+		// Keep the manifest metadata available for browsing
+		plugin->models.assign(deferred.models.begin(), deferred.models.end());
+		throw Exception("%s", deferred.error.c_str());
+	}
 
+	deferred.loaded = true;
+	for (DeferredModel* model : deferred.models) {
+		model->loadedModel = plugin->getModel(model->slug);
+	}
+	INFO("Loaded deferred plugin library %s %s", plugin->slug.c_str(), plugin->version.c_str());
+}
+
+
+/** Loads the library of a plugin with a parsed manifest, calls its init callback, and adds it to the plugin list.
+Must be called from the main thread. Plugins are initialized in the order this is called.
+Takes ownership of `pending.plugin` and `pending.rootJ`.
+*/
+static Plugin* initPlugin(PendingPlugin& pending) {
+	const std::string& path = pending.path;
+	Plugin* plugin = pending.plugin;
+	DEFER({json_decref(pending.rootJ);});
+	try {
 		// Reject plugin if slug already exists
 		Plugin* existingPlugin = getPlugin(plugin->slug);
 		if (existingPlugin)
 			throw Exception("Plugin %s is already loaded, not attempting to load it again", plugin->slug.c_str());
 
-		// Call init callback
-		InitCallback initCallback;
-		if (path == "") {
-			initCallback = core::init;
+		json_t* modulesJ = json_object_get(pending.rootJ, "modules");
+		if (path != "" && settings::lazyPluginLoading) {
+			// Create models from the manifest and load the library when one is first used
+			double startTime = system::getTime();
+			deferPluginLibrary(plugin, modulesJ);
+			loadTimes.modules += system::getTime() - startTime;
 		}
 		else {
-			initCallback = loadPluginCallback(plugin);
-		}
-		initCallback(plugin);
+			// Call init callback
+			double startTime = system::getTime();
+			InitCallback initCallback;
+			if (path == "") {
+				initCallback = core::init;
+			}
+			else {
+				initCallback = loadPluginCallback(plugin);
+			}
+			double libraryTime = system::getTime();
+			loadTimes.libraries += libraryTime - startTime;
+			initCallback(plugin);
+			double initTime = system::getTime();
+			loadTimes.initCallbacks += initTime - libraryTime;
+
+			// Load modules manifest
+			plugin->modulesFromJson(modulesJ);
+			loadTimes.modules += system::getTime() - initTime;
 
-		// Load modules manifest
-		json_t* modulesJ = json_object_get(rootJ, "modules");
-		plugin->modulesFromJson(modulesJ);
-
-		// Call settingsFromJson() if exists
-		// Returns NULL for Core.
-		auto settingsFromJson = (decltype(&::settingsFromJson)) getSymbol(plugin->handle, "settingsFromJson");
-		if (settingsFromJson) {
-			json_t* settingsJ = json_object_get(settings::pluginSettingsJ, plugin->slug.c_str());
-			if (settingsJ)
-				settingsFromJson(settingsJ);
+			loadPluginSettings(plugin);
 		}
 	}
 	catch (Exception& e) {
@@ -207,39 +553,136 @@ static Plugin* loadPlugin(std::string path) {
 }
 
 
+/** If path is blank, loads Core */
+static Plugin* loadPlugin(std::string path) {
+	if (path == "")
+		INFO("Loading Core plugin");
+	else
+		INFO("Loading plugin from %s", path.c_str());
+
+	PendingPlugin pending;
+	pending.path = path;
+	pending.plugin = new Plugin;
+	double startTime = system::getTime();
+	try {
+		readPluginManifest(pending);
+	}
+	catch (Exception& e) {
+		WARN("Could not load plugin %s: %s", path.c_str(), e.what());
+		json_decref(pending.rootJ);
+		delete pending.plugin;
+		return NULL;
+	}
+	loadTimes.manifests += system::getTime() - startTime;
+	return initPlugin(pending);
+}
+
+
+/** Reads all plugin manifests in parallel, then loads plugin libraries serially in path order. */
 static void loadPlugins(std::string path) {
+	std::vector<PendingPlugin> pendings;
 	for (std::string pluginPath : system::getEntries(path)) {
 		if (!system::isDirectory(pluginPath))
 			continue;
-		if (!loadPlugin(pluginPath)) {
+		PendingPlugin pending;
+		pending.path = pluginPath;
+		pendings.push_back(pending);
+	}
+	// Directory iteration order is unspecified, so sort to initialize plugins deterministically.
+	std::sort(pendings.begin(), pendings.end(), [](const PendingPlugin& a, const PendingPlugin& b) {
+		return a.path < b.path;
+	});
+
+	// Read manifests, using the manifest cache for unchanged plugins
+	double startTime = system::getTime();
+	ManifestCache cache;
+	loadManifestCache(cache);
+	for (PendingPlugin& pending : pendings) {
+		lookUpManifestCache(cache, pending);
+	}
+
+	std::vector<std::string> errors(pendings.size());
+	parallelFor(pendings.size(), [&](size_t i) {
+		PendingPlugin& pending = pendings[i];
+		pending.plugin = new Plugin;
+		try {
+			readPluginManifest(pending);
+		}
+		catch (Exception& e) {
+			errors[i] = e.what();
+		}
+	});
+	// Don't cache invalid manifests
+	size_t validCount = 0;
+	size_t cacheHits = 0;
+	for (size_t i = 0; i < pendings.size(); i++) {
+		if (errors[i].empty()) {
+			validCount++;
+			if (pendings[i].cachedManifest)
+				cacheHits++;
+			continue;
+		}
+		json_decref(pendings[i].rootJ);
+		pendings[i].rootJ = NULL;
+	}
+	INFO("Found %d of %d plugin manifests in cache", (int) cacheHits, (int) pendings.size());
+	// Rewrite cache if any manifest was added, changed, or removed
+	if (cacheHits != validCount || cache.entries.size() != validCount)
+		saveManifestCache(pendings);
+	loadTimes.manifests += system::getTime() - startTime;
+
+	// Load libraries
+	for (size_t i = 0; i < pendings.size(); i++) {
+		PendingPlugin& pending = pendings[i];
+		INFO("Loading plugin from %s", pending.path.c_str());
+		if (!errors[i].empty()) {
 			// Ignore bad plugins. They are reported in the log.
+			WARN("Could not load plugin %s: %s", pending.path.c_str(), errors[i].c_str());
+			delete pending.plugin;
+			continue;
 		}
+		initPlugin(pending);
 	}
 }
 
 
+/** Extracts .vcvplugin packages in parallel, since each package extracts to its own directory. */
 static void extractPackages(std::string path) {
-	std::string message;
-
+	double startTime = system::getTime();
+	std::vector<std::string> packagePaths;
 	for (std::string packagePath : system::getEntries(path)) {
 		if (!system::isFile(packagePath))
 			continue;
 		if (system::getExtension(packagePath) != ".vcvplugin")
 			continue;
+		packagePaths.push_back(packagePath);
+	}
+	std::sort(packagePaths.begin(), packagePaths.end());
 
+	std::vector<std::string> errors(packagePaths.size());
+	parallelFor(packagePaths.size(), [&](size_t i) {
+		const std::string& packagePath = packagePaths[i];
 		// Extract package
 		INFO("Extracting package %s", packagePath.c_str());
 		try {
 			system::unarchiveToDirectory(packagePath, path);
 		}
 		catch (Exception& e) {
-			WARN("Plugin package %s failed to extract: %s", packagePath.c_str(), e.what());
-			message += string::f("Could not extract plugin package %s\n", packagePath.c_str());
-			continue;
+			errors[i] = e.what();
+			return;
 		}
 		// Remove package
 		system::remove(packagePath.c_str());
+	});
+
+	std::string message;
+	for (size_t i = 0; i < packagePaths.size(); i++) {
+		if (errors[i].empty())
+			continue;
+		WARN("Plugin package %s failed to extract: %s", packagePaths[i].c_str(), errors[i].c_str());
+		message += string::f("Could not extract plugin package %s\n", packagePaths[i].c_str());
 	}
+	loadTimes.extract += system::getTime() - startTime;
 	if (!message.empty()) {
 		osdialog_message(OSDIALOG_WARNING, OSDIALOG_OK, message.c_str());
 	}
@@ -258,9 +701,16 @@ static std::string getFundamentalPackagePath() {
 // public API
 ////////////////////
 
+static void logLoadTimes(double startTime) {
+	INFO("Plugin startup took %.3f s: extracting packages %.3f s, reading manifests %.3f s, loading libraries %.3f s, init callbacks %.3f s, loading modules %.3f s", system::getTime() - startTime, loadTimes.extract, loadTimes.manifests, loadTimes.libraries, loadTimes.initCallbacks, loadTimes.modules);
+}
+
+
 void init() {
 	// Don't re-initialize
 	assert(plugins.empty());
+	double startTime = system::getTime();
+	loadTimes = LoadTimes();
 
 	// Load Core
 	loadPlugin("");
@@ -285,8 +735,10 @@ void init() {
 	system::createDirectory(pluginsPath);
 
 	// Don't load plugins if safe mode is enabled
-	if (settings::safeMode)
+	if (settings::safeMode) {
+		logLoadTimes(startTime);
 		return;
+	}
 
 	// Extract packages and load plugins
 	extractPackages(pluginsPath);
@@ -307,12 +759,31 @@ void init() {
 			}
 		}
 	}
+
+	logLoadTimes(startTime);
 }
 
 
 static void destroyPlugin(Plugin* plugin) {
 	void* handle = plugin->handle;
 
+	// Delete DeferredModels after the Plugin, since it references its models
+	std::vector<DeferredModel*> deferredModels;
+	{
+		std::lock_guard<std::mutex> lock(deferredPluginsMutex);
+		auto it = deferredPlugins.find(plugin);
+		if (it != deferredPlugins.end()) {
+			json_decref(it->second.modulesJ);
+			deferredModels = it->second.models;
+			deferredPlugins.erase(it);
+		}
+	}
+	DEFER({
+		for (DeferredModel* model : deferredModels) {
+			delete model;
+		}
+	});
+
 	// Call destroy() if defined in the plugin library
 	typedef void (*DestroyCallback)();
 	DestroyCallback destroyCallback = NULL;
@@ -355,6 +826,9 @@ void destroy() {
 
 void settingsMergeJson(json_t* rootJ) {
 	for (Plugin* plugin : plugins) {
+		// Preserve settings of plugins whose library was never loaded
+		if (!isPluginLibraryLoaded(plugin))
+			continue;
 		auto settingsToJson = (decltype(&::settingsToJson)) getSymbol(plugin->handle, "settingsToJson");
 		if (settingsToJson) {
 			json_t* settingsJ = settingsToJson();
@@ -484,7 +958,43 @@ Model* modelFromJson(json_t* moduleJ) {
 	Model* model = getModelFallback(pluginSlug, modelSlug);
 	if (!model)
 		throw Exception("Could not find module %s/%s", pluginSlug.c_str(), modelSlug.c_str());
-	return model;
+	return loadModel(model);
+}
+
+
+Model* loadModel(Model* model) {
+	DeferredModel* deferredModel = dynamic_cast<DeferredModel*>(model);
+	if (!deferredModel)
+		return model;
+
+	std::lock_guard<std::mutex> lock(deferredPluginsMutex);
+	if (!deferredModel->loadedModel) {
+		Plugin* plugin = deferredModel->plugin;
+		auto it = deferredPlugins.find(plugin);
+		assert(it != deferredPlugins.end());
+		loadDeferredPlugin_NoLock(plugin, it->second);
+		if (!deferredModel->loadedModel)
+			throw Exception("Plugin %s does not define module %s", plugin->slug.c_str(), deferredModel->slug.c_str());
+	}
+	return deferredModel->loadedModel;
+}
+
+
+void loadPluginLibrary(Plugin* plugin) {
+	std::lock_guard<std::mutex> lock(deferredPluginsMutex);
+	auto it = deferredPlugins.find(plugin);
+	if (it == deferredPlugins.end())
+		return;
+	loadDeferredPlugin_NoLock(plugin, it->second);
+}
+
+
+bool isPluginLibraryLoaded(Plugin* plugin) {
+	std::lock_guard<std::mutex> lock(deferredPluginsMutex);
+	auto it = deferredPlugins.find(plugin);
+	if (it == deferredPlugins.end())
+		return true;
+	return it->second.loaded;
 }
 
 
@@ -207,6 +207,9 @@ struct RtAudioDevice : audio::Device {
 
 		system::setThreadName("RtAudio");
 
+		if (status & (RTAUDIO_INPUT_OVERFLOW | RTAUDIO_OUTPUT_UNDERFLOW))
+			that->onXrun();
+
 		int inputStride = that->getNumInputs();
 		int outputStride = that->getNumOutputs();
 		try {
@@ -40,6 +40,8 @@ float knobLinearSensitivity = 0.001f;
 float knobScrollSensitivity = 0.001f;
 float sampleRate = 0;
 int threadCount = 1;
+std::vector<int> threadCpus;
+int threadPriority = 0;
 bool tooltips = true;
 bool cpuMeter = false;
 bool lockModules = false;
@@ -51,14 +53,18 @@ bool preferDarkPanels = false;
 #else
 	float frameRateLimit = 60.f;
 #endif
+bool skipIdleFrames = true;
+float framebufferBudget = 64.f;
 float autosaveInterval = 15.0;
 bool skipLoadOnLaunch = false;
+bool binaryPatches = false;
 std::list<std::string> recentPatchPaths;
 bool cableAutoRotate = true;
 std::vector<NVGcolor> cableColors;
 std::vector<std::string> cableLabels;
 bool autoCheckUpdates = true;
 bool verifyHttpsCerts = true;
+bool lazyPluginLoading = false;
 bool showTipsOnLaunch = true;
 int tipIndex = -1;
 BrowserSort browserSort = BROWSER_SORT_UPDATED;
@@ -169,6 +175,14 @@ json_t* toJson() {
 
 	json_object_set_new(rootJ, "threadCount", json_integer(threadCount));
 
+	json_t* threadCpusJ = json_array();
+	for (int cpu : threadCpus) {
+		json_array_append_new(threadCpusJ, json_integer(cpu));
+	}
+	json_object_set_new(rootJ, "threadCpus", threadCpusJ);
+
+	json_object_set_new(rootJ, "threadPriority", json_integer(threadPriority));
+
 	json_object_set_new(rootJ, "tooltips", json_boolean(tooltips));
 
 	json_object_set_new(rootJ, "cpuMeter", json_boolean(cpuMeter));
@@ -181,11 +195,17 @@ json_t* toJson() {
 
 	json_object_set_new(rootJ, "frameRateLimit", json_real(frameRateLimit));
 
+	json_object_set_new(rootJ, "skipIdleFrames", json_boolean(skipIdleFrames));
+
+	json_object_set_new(rootJ, "framebufferBudget", json_real(framebufferBudget));
+
 	json_object_set_new(rootJ, "autosaveInterval", json_real(autosaveInterval));
 
 	if (skipLoadOnLaunch)
 		json_object_set_new(rootJ, "skipLoadOnLaunch", json_boolean(true));
 
+	json_object_set_new(rootJ, "binaryPatches", json_boolean(binaryPatches));
+
 	json_t* recentPatchPathsJ = json_array();
 	for (const std::string& path : recentPatchPaths) {
 		json_array_append_new(recentPatchPathsJ, json_string(path.c_str()));
@@ -211,6 +231,8 @@ json_t* toJson() {
 
 	json_object_set_new(rootJ, "verifyHttpsCerts", json_boolean(verifyHttpsCerts));
 
+	json_object_set_new(rootJ, "lazyPluginLoading", json_boolean(lazyPluginLoading));
+
 	json_object_set_new(rootJ, "showTipsOnLaunch", json_boolean(showTipsOnLaunch));
 
 	json_object_set_new(rootJ, "tipIndex", json_integer(tipIndex));
@@ -370,6 +392,20 @@ void fromJson(json_t* rootJ) {
 	if (threadCountJ)
 		threadCount = json_integer_value(threadCountJ);
 
+	threadCpus.clear();
+	json_t* threadCpusJ = json_object_get(rootJ, "threadCpus");
+	if (threadCpusJ) {
+		size_t i;
+		json_t* cpuJ;
+		json_array_foreach(threadCpusJ, i, cpuJ) {
+			threadCpus.push_back(json_integer_value(cpuJ));
+		}
+	}
+
+	json_t* threadPriorityJ = json_object_get(rootJ, "threadPriority");
+	if (threadPriorityJ)
+		threadPriority = json_integer_value(threadPriorityJ);
+
 	json_t* tooltipsJ = json_object_get(rootJ, "tooltips");
 	if (tooltipsJ)
 		tooltips = json_boolean_value(tooltipsJ);
@@ -405,6 +441,14 @@ void fromJson(json_t* rootJ) {
 	if (frameRateLimitJ)
 		frameRateLimit = json_number_value(frameRateLimitJ);
 
+	json_t* skipIdleFramesJ = json_object_get(rootJ, "skipIdleFrames");
+	if (skipIdleFramesJ)
+		skipIdleFrames = json_boolean_value(skipIdleFramesJ);
+
+	json_t* framebufferBudgetJ = json_object_get(rootJ, "framebufferBudget");
+	if (framebufferBudgetJ)
+		framebufferBudget = json_number_value(framebufferBudgetJ);
+
 	json_t* autosaveIntervalJ = json_object_get(rootJ, "autosaveInterval");
 	if (autosaveIntervalJ)
 		autosaveInterval = json_number_value(autosaveIntervalJ);
@@ -413,6 +457,10 @@ void fromJson(json_t* rootJ) {
 	if (skipLoadOnLaunchJ)
 		skipLoadOnLaunch = json_boolean_value(skipLoadOnLaunchJ);
 
+	json_t* binaryPatchesJ = json_object_get(rootJ, "binaryPatches");
+	if (binaryPatchesJ)
+		binaryPatches = json_boolean_value(binaryPatchesJ);
+
 	recentPatchPaths.clear();
 	json_t* recentPatchPathsJ = json_object_get(rootJ, "recentPatchPaths");
 	if (recentPatchPathsJ) {
@@ -465,6 +513,10 @@ void fromJson(json_t* rootJ) {
 	if (verifyHttpsCertsJ)
 		verifyHttpsCerts = json_boolean_value(verifyHttpsCertsJ);
 
+	json_t* lazyPluginLoadingJ = json_object_get(rootJ, "lazyPluginLoading");
+	if (lazyPluginLoadingJ)
+		lazyPluginLoading = json_boolean_value(lazyPluginLoadingJ);
+
 	json_t* showTipsOnLaunchJ = json_object_get(rootJ, "showTipsOnLaunch");
 	if (showTipsOnLaunchJ)
 		showTipsOnLaunch = json_boolean_value(showTipsOnLaunchJ);
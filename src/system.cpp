@@ -1,6 +1,7 @@
 #include <arch.hpp>
 
 #include <thread>
+#include <set>
 #include <regex>
 #include <chrono>
 #include <cfenv> // for std::fesetround
@@ -17,6 +18,8 @@
 	#include <execinfo.h> // for backtrace and backtrace_symbols
 	#include <unistd.h> // for execl
 	#include <sys/utsname.h>
+	#include <sys/mman.h> // for mmap
+	#include <fcntl.h> // for open
 #endif
 
 #if defined ARCH_MAC
@@ -37,6 +40,7 @@
 
 #include <archive.h>
 #include <archive_entry.h>
+#include <zstd.h>
 #if defined ARCH_MAC
 	#include <locale.h>
 #endif
@@ -128,6 +132,28 @@ uint64_t getFileSize(const std::string& path) {
 }
 
 
+double getModifiedTime(const std::string& path) {
+	try {
+		fs::file_time_type time = fs::last_write_time(fs::u8path(path));
+		return std::chrono::duration<double>(time.time_since_epoch()).count();
+	}
+	catch (fs::filesystem_error& e) {
+		return 0.0;
+	}
+}
+
+
+bool touchFile(const std::string& path) {
+	try {
+		fs::last_write_time(fs::u8path(path), fs::file_time_type::clock::now());
+		return true;
+	}
+	catch (fs::filesystem_error& e) {
+		return false;
+	}
+}
+
+
 bool rename(const std::string& srcPath, const std::string& destPath) {
 	try {
 		fs::rename(fs::u8path(srcPath), fs::u8path(destPath));
@@ -150,6 +176,17 @@ bool copy(const std::string& srcPath, const std::string& destPath) {
 }
 
 
+bool createHardLink(const std::string& srcPath, const std::string& destPath) {
+	try {
+		fs::create_hard_link(fs::u8path(srcPath), fs::u8path(destPath));
+		return true;
+	}
+	catch (fs::filesystem_error& e) {
+		return false;
+	}
+}
+
+
 bool createDirectory(const std::string& path) {
 	try {
 		return fs::create_directory(fs::u8path(path));
@@ -338,6 +375,110 @@ uint8_t* readFile(const std::string& path, size_t* size) {
 }
 
 
+struct MappedFile::Internal {
+	const uint8_t* data = NULL;
+	size_t size = 0;
+#if defined ARCH_WIN
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#endif
+};
+
+
+MappedFile::MappedFile(const std::string& path) {
+	internal = new Internal;
+#if defined ARCH_WIN
+	internal->file = CreateFileW(string::UTF8toUTF16(path).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (internal->file == INVALID_HANDLE_VALUE) {
+		delete internal;
+		throw Exception("Cannot map file %s", path.c_str());
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(internal->file, &size)) {
+		CloseHandle(internal->file);
+		delete internal;
+		throw Exception("Cannot map file %s", path.c_str());
+	}
+	internal->size = size.QuadPart;
+	// Empty files can't be mapped
+	if (internal->size > 0) {
+		internal->mapping = CreateFileMappingW(internal->file, NULL, PAGE_READONLY, 0, 0, NULL);
+		void* data = internal->mapping ? MapViewOfFile(internal->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+		if (!data) {
+			if (internal->mapping)
+				CloseHandle(internal->mapping);
+			CloseHandle(internal->file);
+			delete internal;
+			throw Exception("Cannot map file %s", path.c_str());
+		}
+		internal->data = (const uint8_t*) data;
+	}
+#else
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		delete internal;
+		throw Exception("Cannot map file %s", path.c_str());
+	}
+	// The mapping stays valid after the descriptor is closed
+	DEFER({close(fd);});
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		delete internal;
+		throw Exception("Cannot map file %s", path.c_str());
+	}
+	internal->size = st.st_size;
+	// Empty files can't be mapped
+	if (internal->size > 0) {
+		void* data = mmap(NULL, internal->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			delete internal;
+			throw Exception("Cannot map file %s", path.c_str());
+		}
+		internal->data = (const uint8_t*) data;
+	}
+#endif
+}
+
+
+MappedFile::~MappedFile() {
+#if defined ARCH_WIN
+	if (internal->data)
+		UnmapViewOfFile(internal->data);
+	if (internal->mapping)
+		CloseHandle(internal->mapping);
+	CloseHandle(internal->file);
+#else
+	if (internal->data)
+		munmap((void*) internal->data, internal->size);
+#endif
+	delete internal;
+}
+
+
+const uint8_t* MappedFile::getData() {
+	return internal->data;
+}
+
+
+size_t MappedFile::getSize() {
+	return internal->size;
+}
+
+
+void MappedFile::prefetch() {
+	if (!internal->data)
+		return;
+#if defined ARCH_LIN || defined ARCH_MAC
+	madvise((void*) internal->data, internal->size, MADV_WILLNEED);
+#endif
+}
+
+
+std::shared_ptr<MappedFile> mapFile(const std::string& path) {
+	return std::make_shared<MappedFile>(path);
+}
+
+
 void writeFile(const std::string& path, const std::vector<uint8_t>& data) {
 	FILE* f = std::fopen(path.c_str(), "wb");
 	if (!f)
@@ -371,6 +512,98 @@ static std::string getRelativePath(std::string path, std::string base) {
 }
 
 
+/** Compresses the tar stream written by libarchive with libzstd directly, since libarchive's zstd filter doesn't support worker threads or long-distance matching. */
+struct ArchiveZstdWriter {
+	ZSTD_CCtx* cctx = NULL;
+	FILE* file = NULL;
+	std::vector<uint8_t>* data = NULL;
+	std::vector<uint8_t> outBuffer;
+	int level = 0;
+	std::string error;
+
+	~ArchiveZstdWriter() {
+		if (file)
+			std::fclose(file);
+		ZSTD_freeCCtx(cctx);
+	}
+};
+
+
+static bool ArchiveZstdWriter_output(ArchiveZstdWriter* that, const void* buffer, size_t length) {
+	if (length == 0)
+		return true;
+	if (that->data) {
+		const uint8_t* buf = (const uint8_t*) buffer;
+		that->data->insert(that->data->end(), buf, buf + length);
+		return true;
+	}
+	if (std::fwrite(buffer, 1, length, that->file) != length) {
+		that->error = "Could not write to archive file";
+		return false;
+	}
+	return true;
+}
+
+
+static bool ArchiveZstdWriter_compress(ArchiveZstdWriter* that, const void* buffer, size_t length, ZSTD_EndDirective endOp) {
+	ZSTD_inBuffer input = {buffer, length, 0};
+	for (;;) {
+		ZSTD_outBuffer output = {that->outBuffer.data(), that->outBuffer.size(), 0};
+		size_t remaining = ZSTD_compressStream2(that->cctx, &output, &input, endOp);
+		if (ZSTD_isError(remaining)) {
+			that->error = ZSTD_getErrorName(remaining);
+			return false;
+		}
+		if (!ArchiveZstdWriter_output(that, output.dst, output.pos))
+			return false;
+		bool done = (endOp == ZSTD_e_continue) ? (input.pos == input.size) : (remaining == 0);
+		if (done)
+			return true;
+	}
+}
+
+
+/** Ends the current zstd frame if the compression level changes, since the level can only be set at the start of a frame.
+Concatenated frames decompress to the same tar stream, so this only affects how each part of it is compressed.
+*/
+static void ArchiveZstdWriter_setLevel(ArchiveZstdWriter* that, int level) {
+	if (level == that->level)
+		return;
+	if (!ArchiveZstdWriter_compress(that, NULL, 0, ZSTD_e_end))
+		throw Exception("Archiver could not compress archive: %s", that->error.c_str());
+	ZSTD_CCtx_setParameter(that->cctx, ZSTD_c_compressionLevel, level);
+	that->level = level;
+}
+
+
+static la_ssize_t archiveWriteZstdCallback(struct archive* a, void* client_data, const void* buffer, size_t length) {
+	assert(client_data);
+	ArchiveZstdWriter* writer = (ArchiveZstdWriter*) client_data;
+	if (!ArchiveZstdWriter_compress(writer, buffer, length, ZSTD_e_continue)) {
+		archive_set_error(a, -1, "%s", writer->error.c_str());
+		return -1;
+	}
+	return length;
+}
+
+
+/** Returns whether a file is probably already compressed, judging by its extension. */
+static bool isCompressedFile(const std::string& path) {
+	static const std::set<std::string> compressedExtensions = {
+		// Archives
+		"zst", "gz", "tgz", "xz", "bz2", "lz4", "zip", "7z", "rar", "vcvplugin",
+		// Audio
+		"flac", "mp3", "ogg", "opus", "m4a", "aac", "wv",
+		// Images and video
+		"png", "jpg", "jpeg", "webp", "gif", "mp4", "webm",
+	};
+	std::string ext = string::lowercase(getExtension(path));
+	if (!ext.empty() && ext[0] == '.')
+		ext = ext.substr(1);
+	return compressedExtensions.find(ext) != compressedExtensions.end();
+}
+
+
 static la_ssize_t archiveWriteVectorCallback(struct archive* a, void* client_data, const void* buffer, size_t length) {
 	assert(client_data);
 	std::vector<uint8_t>& data = *((std::vector<uint8_t>*) client_data);
@@ -380,38 +613,164 @@ static la_ssize_t archiveWriteVectorCallback(struct archive* a, void* client_dat
 }
 
 
-static void archiveDirectory(const std::string& archivePath, std::vector<uint8_t>* archiveData, const std::string& dirPath, int compressionLevel) {
+static void archiveDirectory(const std::string& archivePath, std::vector<uint8_t>* archiveData, const std::string& dirPath, const ArchiveOptions& options) {
 	// Based on minitar.c create() in libarchive examples
 	int r;
 
-	// Open archive for writing
+	// Options that libarchive's zstd filter supports are compressed by it, so archives are identical to those written by previous Rack versions.
+	bool useFilter = (options.threads <= 0 && !options.longDistanceMatching && !options.skipCompressedFiles);
+
 	struct archive* a = archive_write_new();
 	DEFER({archive_write_free(a);});
 	// For some reason libarchive adds 10k of padding to archive_write_open() (but not archive_write_open_filename()) unless this is set to 0.
 	archive_write_set_bytes_per_block(a, 0);
 	archive_write_set_format_pax_restricted(a);
-	archive_write_add_filter_zstd(a);
-	if (!(0 <= compressionLevel && compressionLevel <= 19))
-		throw Exception("Invalid Zstandard compression level");
-	r = archive_write_set_filter_option(a, NULL, "compression-level", std::to_string(compressionLevel).c_str());
-	if (r < ARCHIVE_OK)
-		throw Exception("Archiver could not set filter option: %s", archive_error_string(a));
 
-	if (archiveData) {
-		// Open vector
-		archive_write_open(a, (void*) archiveData, NULL, archiveWriteVectorCallback, NULL);
+	ArchiveZstdWriter writer;
+	if (useFilter) {
+		// Open archive for writing
+		archive_write_add_filter_zstd(a);
+		if (!(0 <= options.compressionLevel && options.compressionLevel <= 19))
+			throw Exception("Invalid Zstandard compression level");
+		r = archive_write_set_filter_option(a, NULL, "compression-level", std::to_string(options.compressionLevel).c_str());
+		if (r < ARCHIVE_OK)
+			throw Exception("Archiver could not set filter option: %s", archive_error_string(a));
+
+		if (archiveData) {
+			// Open vector
+			archive_write_open(a, (void*) archiveData, NULL, archiveWriteVectorCallback, NULL);
+		}
+		else {
+			// Open file
+#if defined ARCH_WIN
+			r = archive_write_open_filename_w(a, string::UTF8toUTF16(archivePath).c_str());
+#else
+			r = archive_write_open_filename(a, archivePath.c_str());
+#endif
+			if (r < ARCHIVE_OK)
+				throw Exception("Archiver could not open archive %s for writing: %s", archivePath.c_str(), archive_error_string(a));
+		}
 	}
 	else {
-		// Open file
+		if (!(ZSTD_minCLevel() <= options.compressionLevel && options.compressionLevel <= ZSTD_maxCLevel()))
+			throw Exception("Invalid Zstandard compression level");
+
+		// Set up Zstandard compressor
+		writer.cctx = ZSTD_createCCtx();
+		if (!writer.cctx)
+			throw Exception("Archiver could not create Zstandard context");
+		writer.outBuffer.resize(ZSTD_CStreamOutSize());
+		writer.level = options.compressionLevel;
+		ZSTD_CCtx_setParameter(writer.cctx, ZSTD_c_compressionLevel, writer.level);
+		if (options.threads > 0) {
+			// Fails if libzstd was built without ZSTD_MULTITHREAD, in which case compression stays on this thread.
+			size_t err = ZSTD_CCtx_setParameter(writer.cctx, ZSTD_c_nbWorkers, options.threads);
+			if (ZSTD_isError(err))
+				WARN("Archiver could not use %d Zstandard worker threads: %s", options.threads, ZSTD_getErrorName(err));
+		}
+		if (options.longDistanceMatching) {
+			ZSTD_CCtx_setParameter(writer.cctx, ZSTD_c_enableLongDistanceMatching, 1);
+			// 128 MiB window, the largest that decoders accept by default
+			ZSTD_CCtx_setParameter(writer.cctx, ZSTD_c_windowLog, 27);
+		}
+
+		if (archiveData) {
+			writer.data = archiveData;
+		}
+		else {
 #if defined ARCH_WIN
-		r = archive_write_open_filename_w(a, string::UTF8toUTF16(archivePath).c_str());
+			writer.file = _wfopen(string::UTF8toUTF16(archivePath).c_str(), L"wb");
 #else
-		r = archive_write_open_filename(a, archivePath.c_str());
+			writer.file = std::fopen(archivePath.c_str(), "wb");
 #endif
-	if (r < ARCHIVE_OK)
-		throw Exception("Archiver could not open archive %s for writing: %s", archivePath.c_str(), archive_error_string(a));
+			if (!writer.file)
+				throw Exception("Archiver could not open archive %s for writing", archivePath.c_str());
+		}
+
+		// Open uncompressed archive for writing
+		r = archive_write_open(a, (void*) &writer, NULL, archiveWriteZstdCallback, NULL);
+		if (r < ARCHIVE_OK)
+			throw Exception("Archiver could not open archive %s for writing: %s", archivePath.c_str(), archive_error_string(a));
+	}
+
+	// Writes an entry read from disk and its file data to the archive
+	auto writeEntry = [&](struct archive_entry* entry, const std::string& entryPath) {
+#if defined ARCH_WIN
+		// FIXME This doesn't seem to set UTF-8 paths on Windows.
+		archive_entry_copy_pathname_w(entry, string::UTF8toUTF16(entryPath).c_str());
+#else
+		archive_entry_set_pathname(entry, entryPath.c_str());
+#endif
+
+		// Set uid and gid to 0 because we don't need to store these.
+		archive_entry_set_uid(entry, 0);
+		archive_entry_set_uname(entry, NULL);
+		archive_entry_set_gid(entry, 0);
+		archive_entry_set_gname(entry, NULL);
+
+		// Don't spend time recompressing large files that are already compressed.
+		// Small files aren't worth ending the frame for.
+		bool skip = options.skipCompressedFiles
+			&& archive_entry_filetype(entry) == AE_IFREG
+			&& archive_entry_size(entry) >= (1 << 16)
+			&& isCompressedFile(entryPath);
+		if (!useFilter)
+			ArchiveZstdWriter_setLevel(&writer, skip ? ZSTD_minCLevel() : options.compressionLevel);
+
+		// Write file to archive
+		r = archive_write_header(a, entry);
+		if (r < ARCHIVE_OK)
+			throw Exception("Archiver could not write entry to archive: %s", archive_error_string(a));
+
+		// Manually copy data
+#if defined ARCH_WIN
+		std::string entrySourcePath = string::UTF16toUTF8(archive_entry_sourcepath_w(entry));
+#else
+		std::string entrySourcePath = archive_entry_sourcepath(entry);
+#endif
+		FILE* f = std::fopen(entrySourcePath.c_str(), "rb");
+		DEFER({std::fclose(f);});
+		char buf[1 << 16];
+		ssize_t len;
+		while ((len = std::fread(buf, 1, sizeof(buf), f)) > 0) {
+			archive_write_data(a, buf, len);
+		}
+	};
+
+	// Excluded files are skipped like files that were already written
+	std::set<std::string> writtenEntryPaths;
+	for (const std::string& excludePath : options.excludePaths) {
+		writtenEntryPaths.insert(getRelativePath(join(dirPath, excludePath), dirPath));
+	}
+
+	// Write first files
+	for (const std::string& firstPath : options.firstPaths) {
+		std::string filePath = join(dirPath, firstPath);
+		if (!isFile(filePath))
+			continue;
+		struct archive* disk = archive_read_disk_new();
+		DEFER({archive_read_free(disk);});
+#if defined ARCH_WIN
+		r = archive_read_disk_open_w(disk, string::UTF8toUTF16(filePath).c_str());
+#else
+		r = archive_read_disk_open(disk, filePath.c_str());
+#endif
+		if (r < ARCHIVE_OK)
+			throw Exception("Archiver could not open file %s for reading: %s", filePath.c_str(), archive_error_string(disk));
+		DEFER({archive_read_close(disk);});
+
+		struct archive_entry* entry = archive_entry_new();
+		DEFER({archive_entry_free(entry);});
+		r = archive_read_next_header2(disk, entry);
+		if (r < ARCHIVE_OK)
+			throw Exception("Archiver could not get entry %s: %s", filePath.c_str(), archive_error_string(disk));
+
+		std::string entryPath = getRelativePath(filePath, dirPath);
+		if (writtenEntryPaths.find(entryPath) != writtenEntryPaths.end())
+			continue;
+		writeEntry(entry, entryPath);
+		writtenEntryPaths.insert(entryPath);
 	}
-	DEFER({archive_write_close(a);});
 
 	// Open dir for reading
 	struct archive* disk = archive_read_disk_new();
@@ -449,47 +808,52 @@ static void archiveDirectory(const std::string& archivePath, std::vector<uint8_t
 
 		entryPath = getRelativePath(entryPath, dirPath);
 
-#if defined ARCH_WIN
-		// FIXME This doesn't seem to set UTF-8 paths on Windows.
-		archive_entry_copy_pathname_w(entry, string::UTF8toUTF16(entryPath).c_str());
-#else
-		archive_entry_set_pathname(entry, entryPath.c_str());
-#endif
-
-		// Set uid and gid to 0 because we don't need to store these.
-		archive_entry_set_uid(entry, 0);
-		archive_entry_set_uname(entry, NULL);
-		archive_entry_set_gid(entry, 0);
-		archive_entry_set_gname(entry, NULL);
+		// Already written or excluded
+		if (writtenEntryPaths.find(entryPath) != writtenEntryPaths.end())
+			continue;
 
-		// Write file to archive
-		r = archive_write_header(a, entry);
-		if (r < ARCHIVE_OK)
-			throw Exception("Archiver could not write entry to archive: %s", archive_error_string(a));
+		writeEntry(entry, entryPath);
+	}
 
-		// Manually copy data
-#if defined ARCH_WIN
-		std::string entrySourcePath = string::UTF16toUTF8(archive_entry_sourcepath_w(entry));
-#else
-		std::string entrySourcePath = archive_entry_sourcepath(entry);
-#endif
-		FILE* f = std::fopen(entrySourcePath.c_str(), "rb");
-		DEFER({std::fclose(f);});
-		char buf[1 << 16];
-		ssize_t len;
-		while ((len = std::fread(buf, 1, sizeof(buf), f)) > 0) {
-			archive_write_data(a, buf, len);
-		}
+	// Write tar trailer and end the last zstd frame
+	r = archive_write_close(a);
+	if (r < ARCHIVE_OK)
+		throw Exception("Archiver could not close archive: %s", archive_error_string(a));
+	if (useFilter)
+		return;
+	if (!ArchiveZstdWriter_compress(&writer, NULL, 0, ZSTD_e_end))
+		throw Exception("Archiver could not compress archive: %s", writer.error.c_str());
+	if (writer.file) {
+		int err = std::fclose(writer.file);
+		writer.file = NULL;
+		if (err)
+			throw Exception("Archiver could not write archive %s", archivePath.c_str());
 	}
 }
 
 void archiveDirectory(const std::string& archivePath, const std::string& dirPath, int compressionLevel) {
-	archiveDirectory(archivePath, NULL, dirPath, compressionLevel);
+	ArchiveOptions options;
+	options.compressionLevel = compressionLevel;
+	options.skipCompressedFiles = false;
+	archiveDirectory(archivePath, NULL, dirPath, options);
 }
 
 std::vector<uint8_t> archiveDirectory(const std::string& dirPath, int compressionLevel) {
+	ArchiveOptions options;
+	options.compressionLevel = compressionLevel;
+	options.skipCompressedFiles = false;
 	std::vector<uint8_t> archiveData;
-	archiveDirectory("", &archiveData, dirPath, compressionLevel);
+	archiveDirectory("", &archiveData, dirPath, options);
+	return archiveData;
+}
+
+void archiveDirectory(const std::string& archivePath, const std::string& dirPath, const ArchiveOptions& options) {
+	archiveDirectory(archivePath, NULL, dirPath, options);
+}
+
+std::vector<uint8_t> archiveDirectory(const std::string& dirPath, const ArchiveOptions& options) {
+	std::vector<uint8_t> archiveData;
+	archiveDirectory("", &archiveData, dirPath, options);
 	return archiveData;
 }
 
@@ -511,7 +875,7 @@ static la_ssize_t archiveReadVectorCallback(struct archive *a, void* client_data
 	return len;
 }
 
-static void unarchiveToDirectory(const std::string& archivePath, const std::vector<uint8_t>* archiveData, const std::string& dirPathStr) {
+static void unarchiveToDirectory(const std::string& archivePath, const std::vector<uint8_t>* archiveData, const std::string& dirPathStr, const std::function<void(const std::string& path)>& onFile) {
 #if defined ARCH_MAC
 	// libarchive depends on locale so set thread locale
 	// If locale is not found, returns NULL which resets thread to global locale
@@ -578,7 +942,8 @@ static void unarchiveToDirectory(const std::string& archivePath, const std::vect
 			throw Exception("Unarchiver could not read entry from archive: %s", archive_error_string(a));
 
 		// Convert relative pathname to absolute based on dirPath
-		fs::path entryPath = fs::u8path(archive_entry_pathname(entry));
+		std::string relativePath = archive_entry_pathname(entry);
+		fs::path entryPath = fs::u8path(relativePath);
 		// DEBUG("entryPath: %s", entryPath.generic_u8string().c_str());
 		if (!entryPath.is_relative())
 			throw Exception("Unarchiver does not support absolute tar paths: %s", entryPath.u8string().c_str());
@@ -636,15 +1001,22 @@ static void unarchiveToDirectory(const std::string& archivePath, const std::vect
 		r = archive_write_finish_entry(disk);
 		if (r < ARCHIVE_OK)
 			throw Exception("Unarchiver could not close file: %s", archive_error_string(disk));
+
+		if (onFile && filetype == AE_IFREG)
+			onFile(relativePath);
 	}
 }
 
 void unarchiveToDirectory(const std::string& archivePath, const std::string& dirPath) {
-	unarchiveToDirectory(archivePath, NULL, dirPath);
+	unarchiveToDirectory(archivePath, NULL, dirPath, NULL);
 }
 
 void unarchiveToDirectory(const std::vector<uint8_t>& archiveData, const std::string& dirPath) {
-	unarchiveToDirectory("", &archiveData, dirPath);
+	unarchiveToDirectory("", &archiveData, dirPath, NULL);
+}
+
+void unarchiveToDirectory(const std::string& archivePath, const std::string& dirPath, const std::function<void(const std::string& path)>& onFile) {
+	unarchiveToDirectory(archivePath, NULL, dirPath, onFile);
 }
 
 
@@ -664,6 +1036,82 @@ void setThreadName(const std::string& name) {
 }
 
 
+bool setThreadAffinity(const std::vector<int>& cpus) {
+#if defined ARCH_LIN
+	if (cpus.empty())
+		return false;
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	for (int cpu : cpus) {
+		if (0 <= cpu && cpu < CPU_SETSIZE)
+			CPU_SET(cpu, &cpuSet);
+	}
+	int err = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+	if (err) {
+		WARN("Could not set thread affinity: %s", strerror(err));
+		return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+std::vector<int> getThreadAffinity() {
+	std::vector<int> cpus;
+#if defined ARCH_LIN
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	if (pthread_getaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet))
+		return cpus;
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &cpuSet))
+			cpus.push_back(cpu);
+	}
+#endif
+	return cpus;
+}
+
+
+bool setThreadRealTimePriority(int priority) {
+#if defined ARCH_LIN || defined ARCH_MAC
+	int minPriority = sched_get_priority_min(SCHED_FIFO);
+	int maxPriority = sched_get_priority_max(SCHED_FIFO);
+	sched_param param;
+	param.sched_priority = std::max(minPriority, std::min(priority, maxPriority));
+	int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (err) {
+		WARN("Could not set thread to SCHED_FIFO priority %d: %s", param.sched_priority, strerror(err));
+		return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+std::string getThreadScheduling() {
+#if defined ARCH_LIN || defined ARCH_MAC
+	int policy;
+	sched_param param;
+	if (pthread_getschedparam(pthread_self(), &policy, &param))
+		return "";
+	std::string policyName;
+	switch (policy) {
+		case SCHED_OTHER: policyName = "SCHED_OTHER"; break;
+		case SCHED_FIFO: policyName = "SCHED_FIFO"; break;
+		case SCHED_RR: policyName = "SCHED_RR"; break;
+		default: policyName = string::f("policy %d", policy); break;
+	}
+	return string::f("%s %d", policyName.c_str(), param.sched_priority);
+#else
+	return "";
+#endif
+}
+
+
 std::string getStackTrace() {
 	void* stack[128];
 	int stackLen = LENGTHOF(stack);
@@ -1,5 +1,11 @@
+#include <algorithm>
+#include <map>
+#include <set>
+
 #include <widget/FramebufferWidget.hpp>
 #include <context.hpp>
+#include <app/Scene.hpp>
+#include <settings.hpp>
 #include <random.hpp>
 
 
@@ -7,7 +13,43 @@ namespace rack {
 namespace widget {
 
 
-static int FramebufferWidget_totalPixels = 0;
+/** Pixels of all allocated framebuffers, including atlases */
+static int64_t FramebufferWidget_totalPixels = 0;
+/** Dirty framebuffers that ran out of frame time, rendered by renderQueue() before the next frame is drawn */
+static std::vector<FramebufferWidget*> FramebufferWidget_queue;
+/** FramebufferWidgets with an allocated framebuffer or atlas slot */
+static std::set<FramebufferWidget*> FramebufferWidget_allocated;
+
+
+/** Width and height in pixels of each atlas framebuffer */
+static const int ATLAS_SIZE = 1024;
+/** Slot sizes are powers of 2 from this size to ATLAS_SLOT_MAX */
+static const int ATLAS_SLOT_MIN = 16;
+/** Larger framebuffers get their own NVGLUframebuffer */
+static const int ATLAS_SLOT_MAX = 128;
+/** Transparent pixels around each slot's contents, so that filtering doesn't sample neighboring slots */
+static const int ATLAS_PADDING = 1;
+
+
+/** A shared framebuffer divided into equal square slots, for packing small framebuffers such as knobs and switches. */
+struct FramebufferAtlas {
+	NVGLUframebuffer* fb = NULL;
+	int slotSize = 0;
+	std::vector<int> freeSlots;
+
+	int getSlotCount() {
+		int n = ATLAS_SIZE / slotSize;
+		return n * n;
+	}
+	/** Returns the position of a slot's contents in image coordinates, with the origin at the top left. */
+	math::Vec getSlotPos(int slot) {
+		int n = ATLAS_SIZE / slotSize;
+		return math::Vec(slot % n, slot / n).mult(slotSize).plus(math::Vec(ATLAS_PADDING, ATLAS_PADDING));
+	}
+};
+
+
+static std::vector<FramebufferAtlas*> FramebufferWidget_atlases;
 
 
 struct FramebufferWidget::Internal {
@@ -26,15 +68,139 @@ struct FramebufferWidget::Internal {
 	/** Local box where framebuffer content is valid.
 	*/
 	math::Rect fbClipBox = math::Rect::inf();
+
+	/** Whether the framebuffer is waiting in `FramebufferWidget_queue` to be rendered */
+	bool queued = false;
+	/** Distance from the center of the viewport, in pixels. Lower renders first. */
+	float queuePriority = 0.f;
+	math::Vec queueScale;
+	math::Vec queueOffsetF;
+	math::Rect queueClipBox;
+
+	bool packable = false;
+	/** The atlas containing the framebuffer, if `fb` is an atlas */
+	FramebufferAtlas* atlas = NULL;
+	int atlasSlot = -1;
+	/** Frame time when the framebuffer was last drawn, for evicting least recently used framebuffers */
+	double drawTime = -INFINITY;
 };
 
 
+/** Allocates an atlas slot for a framebuffer of the given pixel size.
+Returns false if the size is too large or the atlas can't be created.
+*/
+static bool FramebufferWidget_allocateAtlasSlot(FramebufferWidget* that, math::Vec size) {
+	int slotSize = ATLAS_SLOT_MIN;
+	while (slotSize < size.x + 2 * ATLAS_PADDING || slotSize < size.y + 2 * ATLAS_PADDING) {
+		slotSize *= 2;
+		if (slotSize > ATLAS_SLOT_MAX)
+			return false;
+	}
+
+	FramebufferAtlas* atlas = NULL;
+	for (FramebufferAtlas* a : FramebufferWidget_atlases) {
+		if (a->slotSize == slotSize && !a->freeSlots.empty()) {
+			atlas = a;
+			break;
+		}
+	}
+	if (!atlas) {
+		NVGLUframebuffer* fb = nvgluCreateFramebuffer(APP->window->vg, ATLAS_SIZE, ATLAS_SIZE, 0);
+		if (!fb)
+			return false;
+		// Clear the whole atlas, since slot padding is never rendered
+		nvgluBindFramebuffer(fb);
+		glViewport(0, 0, ATLAS_SIZE, ATLAS_SIZE);
+		glClearColor(0.0, 0.0, 0.0, 0.0);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+		nvgluBindFramebuffer(NULL);
+
+		atlas = new FramebufferAtlas;
+		atlas->fb = fb;
+		atlas->slotSize = slotSize;
+		// Allocate low slots first
+		for (int slot = atlas->getSlotCount() - 1; slot >= 0; slot--) {
+			atlas->freeSlots.push_back(slot);
+		}
+		FramebufferWidget_atlases.push_back(atlas);
+		FramebufferWidget_totalPixels += ATLAS_SIZE * ATLAS_SIZE;
+	}
+
+	that->internal->atlas = atlas;
+	that->internal->atlasSlot = atlas->freeSlots.back();
+	atlas->freeSlots.pop_back();
+	that->internal->fb = atlas->fb;
+	return true;
+}
+
+
+static void FramebufferWidget_freeAtlasSlot(FramebufferWidget* that) {
+	FramebufferAtlas* atlas = that->internal->atlas;
+	atlas->freeSlots.push_back(that->internal->atlasSlot);
+	that->internal->atlas = NULL;
+	that->internal->atlasSlot = -1;
+
+	// Delete atlas when empty
+	if ((int) atlas->freeSlots.size() == atlas->getSlotCount()) {
+		nvgluDeleteFramebuffer(atlas->fb);
+		FramebufferWidget_totalPixels -= ATLAS_SIZE * ATLAS_SIZE;
+		auto& atlases = FramebufferWidget_atlases;
+		atlases.erase(std::remove(atlases.begin(), atlases.end(), atlas), atlases.end());
+		delete atlas;
+	}
+}
+
+
+/** Returns whether the framebuffer being rendered to is an atlas slot, rather than a dedicated or temporary oversampled framebuffer. */
+static bool FramebufferWidget_isRenderingToAtlas(FramebufferWidget* that) {
+	return that->internal->atlas && that->internal->fb == that->internal->atlas->fb;
+}
+
+
+/** Sets the GL viewport to the region of the bound framebuffer being rendered to, and clears it. */
+static void FramebufferWidget_clearViewport(FramebufferWidget* that, math::Vec size) {
+	if (!FramebufferWidget_isRenderingToAtlas(that)) {
+		glViewport(0.0, 0.0, size.x, size.y);
+		glClearColor(0.0, 0.0, 0.0, 0.0);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+		return;
+	}
+
+	// GL coordinates have the origin at the bottom left
+	FramebufferAtlas* atlas = that->internal->atlas;
+	math::Vec slotPos = atlas->getSlotPos(that->internal->atlasSlot);
+	glViewport(slotPos.x, ATLAS_SIZE - slotPos.y - size.y, size.x, size.y);
+	// Clear the whole slot including padding, which may contain a previous occupant, but not other slots
+	math::Vec slotCorner = slotPos.minus(math::Vec(ATLAS_PADDING, ATLAS_PADDING));
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(slotCorner.x, ATLAS_SIZE - slotCorner.y - atlas->slotSize, atlas->slotSize, atlas->slotSize);
+	glClearColor(0.0, 0.0, 0.0, 0.0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+}
+
+
+/** Returns whether there is frame time remaining for rendering another framebuffer.
+Always allows the first framebuffers of each frame, to avoid framebuffers never rendering.
+*/
+static bool FramebufferWidget_hasTimeRemaining() {
+	const int minCount = 1;
+	const double minRemaining = -1 / 60.0;
+	int count = ++APP->window->fbCount();
+	double remaining = APP->window->getFrameDurationRemaining();
+	return count <= minCount || remaining > minRemaining;
+}
+
+
 FramebufferWidget::FramebufferWidget() {
 	internal = new Internal;
 }
 
 
 FramebufferWidget::~FramebufferWidget() {
+	// The queue may still contain this framebuffer after it was rendered by draw()
+	auto& queue = FramebufferWidget_queue;
+	queue.erase(std::remove(queue.begin(), queue.end(), this), queue.end());
 	deleteFramebuffer();
 	delete internal;
 }
@@ -57,6 +223,11 @@ NVGLUframebuffer* FramebufferWidget::getFramebuffer() {
 }
 
 
+void FramebufferWidget::setPackable(bool packable) {
+	internal->packable = packable;
+}
+
+
 math::Vec FramebufferWidget::getFramebufferSize() {
 	return internal->fbSize;
 }
@@ -69,15 +240,23 @@ void FramebufferWidget::deleteFramebuffer() {
 	// If the framebuffer exists, the Window should exist.
 	assert(APP->window);
 
-	nvgluDeleteFramebuffer(internal->fb);
+	if (internal->atlas) {
+		FramebufferWidget_freeAtlasSlot(this);
+	}
+	else {
+		nvgluDeleteFramebuffer(internal->fb);
+		FramebufferWidget_totalPixels -= internal->fbSize.area();
+	}
 	internal->fb = NULL;
-
-	FramebufferWidget_totalPixels -= internal->fbSize.area();
+	FramebufferWidget_allocated.erase(this);
 }
 
 
 void FramebufferWidget::step() {
 	Widget::step();
+	// The framebuffer is re-rendered the next time it's drawn
+	if (dirty)
+		APP->window->setDirtyRect(this, box.zeroPos());
 }
 
 
@@ -121,18 +300,28 @@ void FramebufferWidget::draw(const DrawArgs& args) {
 	}
 
 	if (dirty) {
-		// Render only if there is frame time remaining (to avoid lagging frames significantly), or if it's one of the first framebuffers this frame (to avoid framebuffers from never rendering).
-		const int minCount = 1;
-		const double minRemaining = -1 / 60.0;
-		int count = ++APP->window->fbCount();
-		double remaining = APP->window->getFrameDurationRemaining();
-		if (count <= minCount || remaining > minRemaining) {
+		// Render only if there is frame time remaining (to avoid lagging frames significantly).
+		if (FramebufferWidget_hasTimeRemaining()) {
 			render(scale, offsetF, args.clipBox);
 		}
+		else {
+			// Otherwise render before the next frame, framebuffers nearest the center of the viewport first
+			math::Vec center = offset.plus(box.size.mult(scale).div(2));
+			math::Vec viewportCenter = APP->scene->box.size.mult(APP->window->pixelRatio).div(2);
+			internal->queuePriority = center.minus(viewportCenter).norm();
+			internal->queueScale = scale;
+			internal->queueOffsetF = offsetF;
+			internal->queueClipBox = args.clipBox;
+			if (!internal->queued) {
+				internal->queued = true;
+				FramebufferWidget_queue.push_back(this);
+			}
+		}
 	}
 
 	if (!internal->fb)
 		return;
+	internal->drawTime = APP->window->getFrameTime();
 
 	// Draw framebuffer image, using world coordinates
 	nvgSave(args.vg);
@@ -143,17 +332,27 @@ void FramebufferWidget::draw(const DrawArgs& args) {
 
 	// DEBUG("%f %f %f %f, %f %f", RECT_ARGS(internal->fbBox), VEC_ARGS(internal->fbSize));
 	// DEBUG("offsetI (%f, %f) fbBox (%f, %f; %f, %f)", VEC_ARGS(offsetI), RECT_ARGS(internal->fbBox));
+	math::Rect drawBox;
+	drawBox.pos = offsetI.plus(internal->fbBox.pos.mult(scaleRatio));
+	drawBox.size = internal->fbBox.size.mult(scaleRatio);
+
+	// Position and size of the framebuffer's image, which may be an atlas containing this framebuffer
+	math::Vec imagePos;
+	math::Vec imageSize = internal->fbSize;
+	if (internal->atlas) {
+		imagePos = internal->atlas->getSlotPos(internal->atlasSlot);
+		imageSize = math::Vec(ATLAS_SIZE, ATLAS_SIZE);
+	}
+	// World units per framebuffer pixel
+	math::Vec pixelScale = drawBox.size.div(internal->fbSize);
+
 	nvgBeginPath(args.vg);
-	nvgRect(args.vg,
-		offsetI.x + internal->fbBox.pos.x * scaleRatio.x,
-		offsetI.y + internal->fbBox.pos.y * scaleRatio.y,
-		internal->fbBox.size.x * scaleRatio.x,
-		internal->fbBox.size.y * scaleRatio.y);
+	nvgRect(args.vg, RECT_ARGS(drawBox));
 	NVGpaint paint = nvgImagePattern(args.vg,
-		offsetI.x + internal->fbBox.pos.x * scaleRatio.x,
-		offsetI.y + internal->fbBox.pos.y * scaleRatio.y,
-		internal->fbBox.size.x * scaleRatio.x,
-		internal->fbBox.size.y * scaleRatio.y,
+		drawBox.pos.x - imagePos.x * pixelScale.x,
+		drawBox.pos.y - imagePos.y * pixelScale.y,
+		imageSize.x * pixelScale.x,
+		imageSize.y * pixelScale.y,
 		0.0, internal->fb->image, 1.0);
 	nvgFillPaint(args.vg, paint);
 	nvgFill(args.vg);
@@ -167,9 +366,86 @@ void FramebufferWidget::draw(const DrawArgs& args) {
 }
 
 
+void FramebufferWidget::renderQueue() {
+	std::vector<FramebufferWidget*> queue;
+	queue.swap(FramebufferWidget_queue);
+	std::stable_sort(queue.begin(), queue.end(), [](FramebufferWidget* a, FramebufferWidget* b) {
+		return a->internal->queuePriority < b->internal->queuePriority;
+	});
+
+	for (FramebufferWidget* fbw : queue) {
+		// Already rendered or no longer dirty
+		if (!fbw->internal->queued || !fbw->dirty) {
+			fbw->internal->queued = false;
+			continue;
+		}
+		if (!FramebufferWidget_hasTimeRemaining()) {
+			// Keep the remaining framebuffers queued for draw() and the next frame
+			FramebufferWidget_queue.push_back(fbw);
+			continue;
+		}
+		fbw->render(fbw->internal->queueScale, fbw->internal->queueOffsetF, fbw->internal->queueClipBox);
+	}
+}
+
+
+int64_t FramebufferWidget::getTotalPixels() {
+	return FramebufferWidget_totalPixels;
+}
+
+
+void FramebufferWidget::evictUnused() {
+	int64_t budget = settings::framebufferBudget * 1e6;
+	if (budget <= 0 || FramebufferWidget_totalPixels <= budget)
+		return;
+
+	// An atlas is only freed when all of its slots are, so evict whole atlases rather than slots, as recently used as their most recently drawn slot.
+	struct Candidate {
+		double drawTime = -INFINITY;
+		std::vector<FramebufferWidget*> fbws;
+	};
+	std::map<FramebufferAtlas*, Candidate> atlasCandidates;
+	std::vector<Candidate> candidates;
+	for (FramebufferWidget* fbw : FramebufferWidget_allocated) {
+		if (fbw->internal->atlas) {
+			Candidate& candidate = atlasCandidates[fbw->internal->atlas];
+			candidate.drawTime = std::max(candidate.drawTime, fbw->internal->drawTime);
+			candidate.fbws.push_back(fbw);
+		}
+		else {
+			Candidate candidate;
+			candidate.drawTime = fbw->internal->drawTime;
+			candidate.fbws.push_back(fbw);
+			candidates.push_back(candidate);
+		}
+	}
+	for (auto& pair : atlasCandidates) {
+		candidates.push_back(pair.second);
+	}
+
+	// Evict framebuffers and atlases not drawn this frame, least recently drawn first
+	double frameTime = APP->window->getFrameTime();
+	std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+		return a.drawTime < b.drawTime;
+	});
+	for (const Candidate& candidate : candidates) {
+		if (FramebufferWidget_totalPixels <= budget)
+			break;
+		if (candidate.drawTime >= frameTime)
+			break;
+		for (FramebufferWidget* fbw : candidate.fbws) {
+			fbw->deleteFramebuffer();
+			// Re-render when drawn again
+			fbw->setDirty();
+		}
+	}
+}
+
+
 void FramebufferWidget::render(math::Vec scale, math::Vec offsetF, math::Rect clipBox) {
 	// In case we fail drawing the framebuffer, don't try again the next frame, so reset `dirty` here.
 	dirty = false;
+	internal->queued = false;
 	NVGcontext* vg = APP->window->vg;
 	NVGcontext* fbVg = APP->window->fbVg;
 
@@ -208,8 +484,14 @@ void FramebufferWidget::render(math::Vec scale, math::Vec offsetF, math::Rect cl
 		// Create a framebuffer
 		if (newFbSize.isFinite() && !newFbSize.isZero()) {
 			// DEBUG("Creating framebuffer of size (%f, %f)", VEC_ARGS(newFbSize));
-			internal->fb = nvgluCreateFramebuffer(vg, newFbSize.x, newFbSize.y, 0);
-			FramebufferWidget_totalPixels += newFbSize.area();
+			// Pack small framebuffers into an atlas
+			if (!(internal->packable && FramebufferWidget_allocateAtlasSlot(this, newFbSize))) {
+				internal->fb = nvgluCreateFramebuffer(vg, newFbSize.x, newFbSize.y, 0);
+				if (internal->fb)
+					FramebufferWidget_totalPixels += newFbSize.area();
+			}
+			if (internal->fb)
+				FramebufferWidget_allocated.insert(this);
 		}
 
 		// DEBUG("Framebuffer total pixels: %.1f Mpx", FramebufferWidget_totalPixels / 1e6);
@@ -261,9 +543,7 @@ void FramebufferWidget::render(math::Vec scale, math::Vec offsetF, math::Rect cl
 		nvgFillPaint(fbVg, paint);
 		nvgFill(fbVg);
 
-		glViewport(0.0, 0.0, internal->fbSize.x, internal->fbSize.y);
-		glClearColor(0.0, 0.0, 0.0, 0.0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+		FramebufferWidget_clearViewport(this, internal->fbSize);
 		nvgEndFrame(fbVg);
 		nvgReset(fbVg);
 
@@ -292,10 +572,7 @@ void FramebufferWidget::drawFramebuffer() {
 	args.fb = internal->fb;
 	Widget::draw(args);
 
-	glViewport(0.0, 0.0, internal->fbSize.x * oversample, internal->fbSize.y * oversample);
-	glClearColor(0.0, 0.0, 0.0, 0.0);
-	// glClearColor(0.0, 1.0, 1.0, 0.5);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	FramebufferWidget_clearViewport(this, internal->fbSize.mult(oversample));
 	nvgEndFrame(vg);
 
 	// Clean up the NanoVG state so that calls to nvgTextBounds() etc during step() don't use a dirty state.
@@ -1,7 +1,14 @@
 #include <window/Svg.hpp>
 #include <map>
+#include <set>
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <math.hpp>
 #include <string.hpp>
+#include <system.hpp>
 
 
 // #define DEBUG_ONLY(x) x
@@ -12,13 +19,74 @@ namespace rack {
 namespace window {
 
 
+/** Draw-ready form of an NSVGimage.
+Shape visibility, path windings, colors, and gradient transforms are computed once so that re-rendering only issues NanoVG calls.
+*/
+struct SvgDrawList {
+	struct Path {
+		/** Index of the first coordinate in `points`.
+		Points are laid out like NSVGpath::pts, a start point followed by cubic Bézier control points.
+		*/
+		size_t pointIndex;
+		int npts;
+		bool closed;
+		/** NVG_SOLID or NVG_HOLE */
+		int winding;
+	};
+
+	struct Paint {
+		/** NSVG_PAINT_* type */
+		int type;
+		/** Color, or first gradient stop color */
+		NVGcolor color;
+		/** Last gradient stop color */
+		NVGcolor outerColor;
+		float innerOffset;
+		float outerOffset;
+		/** Inverse of the gradient transform */
+		float xform[6];
+	};
+
+	struct Shape {
+		float opacity;
+		size_t pathIndex;
+		size_t pathCount;
+		Paint fill;
+		Paint stroke;
+		float strokeWidth;
+		int strokeLineCap;
+		int strokeLineJoin;
+	};
+
+	/** The NSVGimage this was built from */
+	NSVGimage* handle = NULL;
+	std::vector<float> points;
+	std::vector<Path> paths;
+	std::vector<Shape> shapes;
+};
+
+
+/** Draw lists of loaded Svgs, built on first draw.
+Stored here rather than in Svg, since plugins may allocate Svg themselves.
+*/
+static std::map<const Svg*, SvgDrawList> svgDrawLists;
+static bool svgDrawListsEnabled = true;
+
+
+static void Svg_clearDrawList(const Svg* svg) {
+	svgDrawLists.erase(svg);
+}
+
+
 Svg::~Svg() {
+	Svg_clearDrawList(this);
 	if (handle)
 		nsvgDelete(handle);
 }
 
 
 void Svg::loadFile(const std::string& filename) {
+	Svg_clearDrawList(this);
 	if (handle)
 		nsvgDelete(handle);
 
@@ -30,6 +98,7 @@ void Svg::loadFile(const std::string& filename) {
 
 
 void Svg::loadString(const std::string& str) {
+	Svg_clearDrawList(this);
 	if (handle)
 		nsvgDelete(handle);
 
@@ -87,21 +156,107 @@ int Svg::getNumPoints() {
 }
 
 
-void Svg::draw(NVGcontext* vg) {
-	if (!handle)
-		return;
-	svgDraw(vg, handle);
-}
+static std::map<std::string, std::shared_ptr<Svg>> svgCache;
 
 
-static std::map<std::string, std::shared_ptr<Svg>> svgCache;
+/** Parses SVGs requested by Svg::preload() on background threads.
+Parsed SVGs are moved into `svgCache` by Svg::load() on the UI thread.
+*/
+struct SvgLoader {
+	std::mutex mutex;
+	/** Notifies workers of queued filenames */
+	std::condition_variable queueCv;
+	/** Notifies Svg::load() of finished parses */
+	std::condition_variable resultCv;
+	std::deque<std::string> queue;
+	/** Filenames being parsed by a worker */
+	std::set<std::string> parsing;
+	/** Finished parses, or NULL if parsing failed */
+	std::map<std::string, std::shared_ptr<Svg>> results;
+	std::vector<std::thread> workers;
+	bool running = true;
+
+	~SvgLoader() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+			queue.clear();
+		}
+		queueCv.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	void run() {
+		system::setThreadName("SVG loader");
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			queueCv.wait(lock, [&]() {
+				return !running || !queue.empty();
+			});
+			if (!running)
+				break;
+			std::string filename = queue.front();
+			queue.pop_front();
+			parsing.insert(filename);
+			lock.unlock();
+
+			NSVGimage* handle = nsvgParseFromFile(filename.c_str(), "px", SVG_DPI);
+			// Only create an Svg on success, since destroying one isn't thread-safe
+			std::shared_ptr<Svg> svg;
+			if (handle) {
+				svg = std::make_shared<Svg>();
+				svg->handle = handle;
+			}
+
+			lock.lock();
+			parsing.erase(filename);
+			results[filename] = svg;
+			resultCv.notify_all();
+		}
+	}
+};
+
+
+static SvgLoader svgLoader;
+static std::vector<std::string>* svgRecording = NULL;
 
 
 std::shared_ptr<Svg> Svg::load(const std::string& filename) {
+	if (svgRecording)
+		svgRecording->push_back(filename);
+
 	const auto& pair = svgCache.find(filename);
 	if (pair != svgCache.end())
 		return pair->second;
 
+	// Use or wait for a background parse from preload()
+	{
+		std::unique_lock<std::mutex> lock(svgLoader.mutex);
+		auto queueIt = std::find(svgLoader.queue.begin(), svgLoader.queue.end(), filename);
+		if (queueIt != svgLoader.queue.end()) {
+			// Not started, so parse it below instead of waiting for a worker
+			svgLoader.queue.erase(queueIt);
+		}
+		else {
+			svgLoader.resultCv.wait(lock, [&]() {
+				return svgLoader.parsing.find(filename) == svgLoader.parsing.end();
+			});
+			auto resultIt = svgLoader.results.find(filename);
+			if (resultIt != svgLoader.results.end()) {
+				std::shared_ptr<Svg> svg = resultIt->second;
+				svgLoader.results.erase(resultIt);
+				lock.unlock();
+				if (svg)
+					INFO("Loaded SVG %s", filename.c_str());
+				else
+					WARN("Failed to load SVG %s", filename.c_str());
+				svgCache[filename] = svg;
+				return svg;
+			}
+		}
+	}
+
 	// Load svg
 	std::shared_ptr<Svg> svg;
 	try {
@@ -117,6 +272,65 @@ std::shared_ptr<Svg> Svg::load(const std::string& filename) {
 }
 
 
+void Svg::preload(const std::vector<std::string>& filenames) {
+	std::lock_guard<std::mutex> lock(svgLoader.mutex);
+	size_t queued = 0;
+	for (const std::string& filename : filenames) {
+		if (svgCache.find(filename) != svgCache.end())
+			continue;
+		if (svgLoader.results.find(filename) != svgLoader.results.end())
+			continue;
+		if (svgLoader.parsing.find(filename) != svgLoader.parsing.end())
+			continue;
+		if (std::find(svgLoader.queue.begin(), svgLoader.queue.end(), filename) != svgLoader.queue.end())
+			continue;
+		svgLoader.queue.push_back(filename);
+		queued++;
+	}
+	if (queued == 0)
+		return;
+
+	// Start workers on first use
+	if (svgLoader.workers.empty()) {
+		int threads = math::clamp(system::getLogicalCoreCount() / 2, 1, 4);
+		for (int i = 0; i < threads; i++) {
+			svgLoader.workers.emplace_back([]() {
+				svgLoader.run();
+			});
+		}
+	}
+	svgLoader.queueCv.notify_all();
+}
+
+
+void Svg::cancelPreload() {
+	std::map<std::string, std::shared_ptr<Svg>> results;
+	{
+		std::unique_lock<std::mutex> lock(svgLoader.mutex);
+		svgLoader.queue.clear();
+		// Wait for parses in progress, so their results aren't added after clearing
+		svgLoader.resultCv.wait(lock, [&]() {
+			return svgLoader.parsing.empty();
+		});
+		results = std::move(svgLoader.results);
+		svgLoader.results.clear();
+	}
+	// Destroy unclaimed Svgs outside the lock
+	if (!results.empty())
+		INFO("Freed %d preloaded SVGs that weren't loaded", (int) results.size());
+}
+
+
+void Svg::beginRecording(std::vector<std::string>* filenames) {
+	svgRecording = filenames;
+}
+
+
+void Svg::endRecording() {
+	svgRecording = NULL;
+}
+
+
 static NVGcolor getNVGColor(uint32_t color) {
 	return nvgRGBA(
 		(color >> 0) & 0xff,
@@ -138,7 +352,35 @@ static float getLineCrossing(math::Vec p0, math::Vec p1, math::Vec p2, math::Vec
 	return -(d.x * b.y - d.y * b.x) / m;
 }
 
-void svgDraw(NVGcontext* vg, NSVGimage* svg) {
+static void SvgDrawList_setPaint(SvgDrawList::Paint& paint, const NSVGpaint& svgPaint) {
+	paint.type = svgPaint.type;
+	if (svgPaint.type == NSVG_PAINT_COLOR) {
+		paint.color = getNVGColor(svgPaint.color);
+	}
+	else if (svgPaint.type == NSVG_PAINT_LINEAR_GRADIENT || svgPaint.type == NSVG_PAINT_RADIAL_GRADIENT) {
+		const NSVGgradient* g = svgPaint.gradient;
+		DEBUG_ONLY(printf("		gradient: type: %s xform: %f %f %f %f %f %f spread: %d fx: %f fy: %f nstops: %d\n", svgPaint.type == NSVG_PAINT_LINEAR_GRADIENT ? "linear" : "radial", g->xform[0], g->xform[1], g->xform[2], g->xform[3], g->xform[4], g->xform[5], g->spread, g->fx, g->fy, g->nstops);)
+		for (int i = 0; i < g->nstops; i++) {
+			DEBUG_ONLY(printf("			stop: #%08x\t%f\n", g->stops[i].color, g->stops[i].offset);)
+		}
+
+		assert(g->nstops >= 1);
+		paint.color = getNVGColor(g->stops[0].color);
+		paint.outerColor = getNVGColor(g->stops[g->nstops - 1].color);
+		paint.innerOffset = g->stops[0].offset;
+		paint.outerOffset = g->stops[g->nstops - 1].offset;
+		nvgTransformInverse(paint.xform, g->xform);
+		DEBUG_ONLY(printf("			inverse: %f %f %f %f %f %f\n", paint.xform[0], paint.xform[1], paint.xform[2], paint.xform[3], paint.xform[4], paint.xform[5]);)
+	}
+}
+
+
+static void SvgDrawList_build(SvgDrawList& list, NSVGimage* svg) {
+	list.handle = svg;
+	list.points.clear();
+	list.paths.clear();
+	list.shapes.clear();
+
 	DEBUG_ONLY(printf("new image: %g x %g px\n", svg->width, svg->height);)
 	int shapeIndex = 0;
 	// Iterate shape linked list
@@ -149,30 +391,19 @@ void svgDraw(NVGcontext* vg, NSVGimage* svg) {
 		if (!(shape->flags & NSVG_FLAGS_VISIBLE))
 			continue;
 
-		nvgSave(vg);
-
-		// Opacity
-		if (shape->opacity < 1.0)
-			nvgAlpha(vg, shape->opacity);
-
-		// Build path
-		nvgBeginPath(vg);
+		SvgDrawList::Shape s;
+		s.opacity = shape->opacity;
+		s.pathIndex = list.paths.size();
 
 		// Iterate path linked list
 		for (NSVGpath* path = shape->paths; path; path = path->next) {
 			DEBUG_ONLY(printf("		new path: %d points, %s, from (%f, %f) to (%f, %f)\n", path->npts, path->closed ? "closed" : "open", path->bounds[0], path->bounds[1], path->bounds[2], path->bounds[3]);)
 
-			nvgMoveTo(vg, path->pts[0], path->pts[1]);
-			for (int i = 1; i < path->npts; i += 3) {
-				float* p = &path->pts[2 * i];
-				nvgBezierTo(vg, p[0], p[1], p[2], p[3], p[4], p[5]);
-				// nvgLineTo(vg, p[4], p[5]);
-				DEBUG_ONLY(printf("			bezier (%f, %f) to (%f, %f)\n", p[-2], p[-1], p[4], p[5]);)
-			}
-
-			// Close path
-			if (path->closed)
-				nvgClosePath(vg);
+			SvgDrawList::Path p;
+			p.pointIndex = list.points.size();
+			p.npts = path->npts;
+			p.closed = path->closed;
+			list.points.insert(list.points.end(), path->pts, path->pts + 2 * path->npts);
 
 			// Compute whether this is a hole or a solid.
 			// Assume that no paths are crossing (usually true for normal SVG graphics).
@@ -202,66 +433,68 @@ void svgDraw(NVGcontext* vg, NSVGimage* svg) {
 					}
 				}
 			}
+			p.winding = (crossings % 2 == 0) ? NVG_SOLID : NVG_HOLE;
+			list.paths.push_back(p);
+		}
+		s.pathCount = list.paths.size() - s.pathIndex;
+
+		SvgDrawList_setPaint(s.fill, shape->fill);
+		SvgDrawList_setPaint(s.stroke, shape->stroke);
+		s.strokeWidth = shape->strokeWidth;
+		s.strokeLineCap = shape->strokeLineCap;
+		s.strokeLineJoin = shape->strokeLineJoin;
+		list.shapes.push_back(s);
+	}
 
-			if (crossings % 2 == 0)
-				nvgPathWinding(vg, NVG_SOLID);
-			else
-				nvgPathWinding(vg, NVG_HOLE);
+	DEBUG_ONLY(printf("\n");)
+}
 
-			/*
-			// Shoelace algorithm for computing the area, and thus the winding direction
-			float area = 0.0;
-			math::Vec p0 = math::Vec(path->pts[0], path->pts[1]);
-			for (int i = 1; i < path->npts; i += 3) {
-				float *p = &path->pts[2*i];
-				math::Vec p1 = (i < path->npts) ? math::Vec(p[4], p[5]) : math::Vec(path->pts[0], path->pts[1]);
-				area += 0.5 * (p1.x - p0.x) * (p1.y + p0.y);
-				printf("%f %f, %f %f\n", p0.x, p0.y, p1.x, p1.y);
-				p0 = p1;
+
+static void SvgDrawList_draw(const SvgDrawList& list, NVGcontext* vg) {
+	for (const SvgDrawList::Shape& shape : list.shapes) {
+		nvgSave(vg);
+
+		// Opacity
+		if (shape.opacity < 1.0)
+			nvgAlpha(vg, shape.opacity);
+
+		// Build path
+		nvgBeginPath(vg);
+		for (size_t pathIndex = shape.pathIndex; pathIndex < shape.pathIndex + shape.pathCount; pathIndex++) {
+			const SvgDrawList::Path& path = list.paths[pathIndex];
+			const float* pts = &list.points[path.pointIndex];
+			nvgMoveTo(vg, pts[0], pts[1]);
+			for (int i = 1; i < path.npts; i += 3) {
+				const float* p = &pts[2 * i];
+				nvgBezierTo(vg, p[0], p[1], p[2], p[3], p[4], p[5]);
 			}
-			printf("%f\n", area);
 
-			if (area < 0.0)
-				nvgPathWinding(vg, NVG_CCW);
-			else
-				nvgPathWinding(vg, NVG_CW);
-			*/
+			// Close path
+			if (path.closed)
+				nvgClosePath(vg);
+
+			nvgPathWinding(vg, path.winding);
 		}
 
 		// Fill shape
-		if (shape->fill.type == NSVG_PAINT_COLOR) {
-			NVGcolor color = getNVGColor(shape->fill.color);
-			DEBUG_ONLY(printf("		fill color (%g, %g, %g, %g)\n", color.r, color.g, color.b, color.a);)
-			nvgFillColor(vg, color);
+		const SvgDrawList::Paint& fill = shape.fill;
+		if (fill.type == NSVG_PAINT_COLOR) {
+			nvgFillColor(vg, fill.color);
 			nvgFill(vg);
 		}
-		else if (shape->fill.type == NSVG_PAINT_LINEAR_GRADIENT || shape->fill.type == NSVG_PAINT_RADIAL_GRADIENT) {
+		else if (fill.type == NSVG_PAINT_LINEAR_GRADIENT || fill.type == NSVG_PAINT_RADIAL_GRADIENT) {
 			nvgSave(vg);
-			const NSVGgradient* g = shape->fill.gradient;
-			DEBUG_ONLY(printf("		gradient: type: %s xform: %f %f %f %f %f %f spread: %d fx: %f fy: %f nstops: %d\n", shape->fill.type == NSVG_PAINT_LINEAR_GRADIENT ? "linear" : "radial", g->xform[0], g->xform[1], g->xform[2], g->xform[3], g->xform[4], g->xform[5], g->spread, g->fx, g->fy, g->nstops);)
-			for (int i = 0; i < g->nstops; i++) {
-				DEBUG_ONLY(printf("			stop: #%08x\t%f\n", g->stops[i].color, g->stops[i].offset);)
-			}
-
-			assert(g->nstops >= 1);
-			NVGcolor icol = getNVGColor(g->stops[0].color);
-			NVGcolor ocol = getNVGColor(g->stops[g->nstops - 1].color);
-			float iOffset = g->stops[0].offset;
-			float oOffset = g->stops[g->nstops - 1].offset;
-
-			float t[6];
-			nvgTransformInverse(t, g->xform);
-			DEBUG_ONLY(printf("			inverse: %f %f %f %f %f %f\n", t[0], t[1], t[2], t[3], t[4], t[5]);)
+			const float* t = fill.xform;
 			nvgTransform(vg, t[0], t[1], t[2], t[3], t[4], t[5]);
 			// Because nvgLinearGradient() and nvgRadialGradient() arbitrarily limit a minimum of 1.0 feather, rescale and use (0, 100) coordinates.
 			nvgScale(vg, 1/100.0, 1/100.0);
 
 			NVGpaint paint;
-			if (shape->fill.type == NSVG_PAINT_LINEAR_GRADIENT) {
-				paint = nvgLinearGradient(vg, 0.0, 100 * iOffset, 0.0, 100 * oOffset, icol, ocol);
+			if (fill.type == NSVG_PAINT_LINEAR_GRADIENT) {
+				paint = nvgLinearGradient(vg, 0.0, 100 * fill.innerOffset, 0.0, 100 * fill.outerOffset, fill.color, fill.outerColor);
 			}
-			else if (shape->fill.type == NSVG_PAINT_RADIAL_GRADIENT) {
-				paint = nvgRadialGradient(vg, 0.0, 0.0, 100 * iOffset, 100 * oOffset, icol, ocol);
+			else {
+				paint = nvgRadialGradient(vg, 0.0, 0.0, 100 * fill.innerOffset, 100 * fill.outerOffset, fill.color, fill.outerColor);
 			}
 			nvgFillPaint(vg, paint);
 			nvgFill(vg);
@@ -269,30 +502,49 @@ void svgDraw(NVGcontext* vg, NSVGimage* svg) {
 		}
 
 		// Stroke shape
-		if (shape->stroke.type) {
-			nvgStrokeWidth(vg, shape->strokeWidth);
+		if (shape.stroke.type) {
+			nvgStrokeWidth(vg, shape.strokeWidth);
 			// strokeDashOffset, strokeDashArray, strokeDashCount not yet supported
-			nvgLineCap(vg, (NVGlineCap) shape->strokeLineCap);
-			nvgLineJoin(vg, (int) shape->strokeLineJoin);
-
-			switch (shape->stroke.type) {
-				case NSVG_PAINT_COLOR: {
-					NVGcolor color = getNVGColor(shape->stroke.color);
-					nvgStrokeColor(vg, color);
-					DEBUG_ONLY(printf("		stroke color (%g, %g, %g, %g)\n", color.r, color.g, color.b, color.a);)
-				} break;
-				case NSVG_PAINT_LINEAR_GRADIENT: {
-					// NSVGgradient *g = shape->stroke.gradient;
-					// printf("		lin grad: %f\t%f\n", g->fx, g->fy);
-				} break;
-			}
+			nvgLineCap(vg, (NVGlineCap) shape.strokeLineCap);
+			nvgLineJoin(vg, shape.strokeLineJoin);
+			// Gradient strokes not yet supported
+			if (shape.stroke.type == NSVG_PAINT_COLOR)
+				nvgStrokeColor(vg, shape.stroke.color);
 			nvgStroke(vg);
 		}
 
 		nvgRestore(vg);
 	}
+}
 
-	DEBUG_ONLY(printf("\n");)
+
+void Svg::draw(NVGcontext* vg) {
+	if (!handle)
+		return;
+	if (!svgDrawListsEnabled) {
+		svgDraw(vg, handle);
+		return;
+	}
+
+	SvgDrawList& list = svgDrawLists[this];
+	// Rebuild if the handle was replaced
+	if (list.handle != handle)
+		SvgDrawList_build(list, handle);
+	SvgDrawList_draw(list, vg);
+}
+
+
+void Svg::setDrawListsEnabled(bool enabled) {
+	svgDrawListsEnabled = enabled;
+	if (!enabled)
+		svgDrawLists.clear();
+}
+
+
+void svgDraw(NVGcontext* vg, NSVGimage* svg) {
+	SvgDrawList list;
+	SvgDrawList_build(list, svg);
+	SvgDrawList_draw(list, vg);
 }
 
 
@@ -15,7 +15,11 @@
 #include <window/Window.hpp>
 #include <asset.hpp>
 #include <widget/Widget.hpp>
+#include <widget/FramebufferWidget.hpp>
 #include <app/Scene.hpp>
+#include <app/RackScrollWidget.hpp>
+#include <app/LightWidget.hpp>
+#include <engine/Engine.hpp>
 #include <keyboard.hpp>
 #include <gamepad.hpp>
 #include <context.hpp>
@@ -110,9 +114,38 @@ struct Window::Internal {
 
 	bool fbDirtyOnSubpixelChange = true;
 	int fbCount = 0;
+
+	/** Window contents kept between frames, so frames with few changes only redraw the dirty rectangles */
+	NVGLUframebuffer* sceneFb = NULL;
+	/** Dirty rectangles are drawn here and then copied to `sceneFb`, because widgets may reset the scissor and draw outside them */
+	NVGLUframebuffer* dirtyFb = NULL;
+	int sceneFbWidth = 0;
+	int sceneFbHeight = 0;
+	/** Whether the whole window must be redrawn */
+	bool dirty = true;
+	/** Rectangles to redraw, in scene coordinates */
+	std::vector<math::Rect> dirtyRects;
+	/** Frame time of the last full redraw. Partial redraws don't count, since they don't redraw unreported changes. */
+	double lastFullRenderTime = NAN;
+	math::Vec lastRackOffset;
+	float lastRackZoom = 0.f;
+
+	int renderedFrames = 0;
+	int skippedFrames = 0;
+	double frameRateTime = NAN;
+	double renderedFrameRate = 0.0;
+	double skippedFrameRate = 0.0;
 };
 
 
+/** While skipping idle frames, the whole window is still redrawn this often, for changes that widgets don't report. */
+static const double IDLE_REDRAW_INTERVAL = 0.5;
+/** If dirty rectangles cover more than this fraction of the window, the whole window is redrawn instead. */
+static const float DIRTY_AREA_MAX = 0.5f;
+/** More dirty rectangles than this are merged into their bounding box, since the scene is traversed once per rectangle. */
+static const size_t DIRTY_RECTS_MAX = 16;
+
+
 static void windowPosCallback(GLFWwindow* win, int x, int y) {
 	if (glfwGetWindowAttrib(win, GLFW_MAXIMIZED))
 		return;
@@ -158,6 +191,7 @@ static void mouseButtonCallback(GLFWwindow* win, int button, int action, int mod
 	}
 #endif
 
+	APP->window->setDirty();
 	APP->event->handleButton(APP->window->internal->lastMousePos, button, action, mods);
 }
 
@@ -189,6 +223,9 @@ static void cursorPosCallback(GLFWwindow* win, double xpos, double ypos) {
 	glfwSetCursor(win, NULL);
 #endif
 
+	// This is called every frame, so only redraw if the mouse moved
+	if (!mousePos.equals(APP->window->internal->lastMousePos) || !mouseDelta.isZero())
+		APP->window->setDirty();
 	APP->window->internal->lastMousePos = mousePos;
 
 	APP->event->handleHover(mousePos, mouseDelta);
@@ -203,6 +240,7 @@ static void cursorPosCallback(GLFWwindow* win, double xpos, double ypos) {
 
 static void cursorEnterCallback(GLFWwindow* win, int entered) {
 	contextSet((Context*) glfwGetWindowUserPointer(win));
+	APP->window->setDirty();
 	if (!entered) {
 		APP->event->handleLeave();
 	}
@@ -218,12 +256,14 @@ static void scrollCallback(GLFWwindow* win, double x, double y) {
 	scrollDelta = scrollDelta.mult(50.0);
 #endif
 
+	APP->window->setDirty();
 	APP->event->handleScroll(APP->window->internal->lastMousePos, scrollDelta);
 }
 
 
 static void charCallback(GLFWwindow* win, unsigned int codepoint) {
 	contextSet((Context*) glfwGetWindowUserPointer(win));
+	APP->window->setDirty();
 	if (APP->event->handleText(APP->window->internal->lastMousePos, codepoint))
 		return;
 }
@@ -231,6 +271,7 @@ static void charCallback(GLFWwindow* win, unsigned int codepoint) {
 
 static void keyCallback(GLFWwindow* win, int key, int scancode, int action, int mods) {
 	contextSet((Context*) glfwGetWindowUserPointer(win));
+	APP->window->setDirty();
 	if (APP->event->handleKey(APP->window->internal->lastMousePos, key, scancode, action, mods))
 		return;
 
@@ -250,6 +291,7 @@ static void dropCallback(GLFWwindow* win, int count, const char** paths) {
 	for (int i = 0; i < count; i++) {
 		pathsVec.push_back(paths[i]);
 	}
+	APP->window->setDirty();
 	APP->event->handleDrop(APP->window->internal->lastMousePos, pathsVec);
 }
 
@@ -259,6 +301,150 @@ static void errorCallback(int error, const char* description) {
 }
 
 
+static void Window_deleteSceneFramebuffers(Window* that) {
+	if (that->internal->sceneFb) {
+		nvgluDeleteFramebuffer(that->internal->sceneFb);
+		that->internal->sceneFb = NULL;
+	}
+	if (that->internal->dirtyFb) {
+		nvgluDeleteFramebuffer(that->internal->dirtyFb);
+		that->internal->dirtyFb = NULL;
+	}
+}
+
+
+/** Draws the parts of the scene inside the given pixel rectangles to a framebuffer, or to the window if NULL. */
+static void Window_drawScene(Window* that, NVGLUframebuffer* fb, int width, int height, const std::vector<math::Rect>& rects) {
+	NVGcontext* vg = that->vg;
+	nvgBeginFrame(vg, width, height, that->pixelRatio);
+	nvgScale(vg, that->pixelRatio, that->pixelRatio);
+
+	for (const math::Rect& rect : rects) {
+		math::Rect clipBox = math::Rect(rect.pos.div(that->pixelRatio), rect.size.div(that->pixelRatio));
+		nvgSave(vg);
+		nvgScissor(vg, RECT_ARGS(clipBox));
+		widget::Widget::DrawArgs args;
+		args.vg = vg;
+		args.clipBox = clipBox;
+		APP->scene->draw(args);
+		nvgRestore(vg);
+	}
+
+	// FramebufferWidgets rendered while drawing bind their own framebuffers, so bind ours before flushing
+	nvgluBindFramebuffer(fb);
+	glViewport(0, 0, width, height);
+	glClearColor(0.0, 0.0, 0.0, 1.0);
+	glEnable(GL_SCISSOR_TEST);
+	for (const math::Rect& rect : rects) {
+		glScissor(rect.pos.x, height - rect.pos.y - rect.size.y, rect.size.x, rect.size.y);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	}
+	glDisable(GL_SCISSOR_TEST);
+	nvgEndFrame(vg);
+}
+
+
+/** Copies the given pixel rectangles of a framebuffer to another framebuffer, or to the window if NULL. */
+static void Window_copyFramebuffer(Window* that, NVGLUframebuffer* src, NVGLUframebuffer* dst, int width, int height, const std::vector<math::Rect>& rects) {
+	NVGcontext* vg = that->vg;
+	nvgBeginFrame(vg, width, height, 1.0);
+	nvgBeginPath(vg);
+	for (const math::Rect& rect : rects) {
+		nvgRect(vg, RECT_ARGS(rect));
+	}
+	// The scene is opaque, so drawing it replaces the destination pixels
+	nvgFillPaint(vg, nvgImagePattern(vg, 0.0, 0.0, width, height, 0.0, src->image, 1.0));
+	nvgFill(vg);
+
+	nvgluBindFramebuffer(dst);
+	glViewport(0, 0, width, height);
+	nvgEndFrame(vg);
+}
+
+
+/** Redraws the dirty parts of the scene and shows it in the window.
+Returns whether anything was redrawn.
+*/
+static bool Window_render(Window* that, int width, int height) {
+	Window::Internal* internal = that->internal;
+
+	// Reallocate scene framebuffers when the window is resized
+	if (!internal->sceneFb || width != internal->sceneFbWidth || height != internal->sceneFbHeight) {
+		Window_deleteSceneFramebuffers(that);
+		internal->sceneFb = nvgluCreateFramebuffer(that->vg, width, height, 0);
+		internal->dirtyFb = nvgluCreateFramebuffer(that->vg, width, height, 0);
+		internal->sceneFbWidth = width;
+		internal->sceneFbHeight = height;
+		internal->dirty = true;
+	}
+
+	// Redraw everything when the rack view moves or something is dragged
+	app::RackScrollWidget* rackScroll = APP->scene->rackScroll;
+	if (!rackScroll->offset.equals(internal->lastRackOffset) || rackScroll->getZoom() != internal->lastRackZoom) {
+		internal->lastRackOffset = rackScroll->offset;
+		internal->lastRackZoom = rackScroll->getZoom();
+		internal->dirty = true;
+	}
+	if (APP->event->getDraggedWidget())
+		internal->dirty = true;
+	// Periodically redraw everything for changes that widgets don't report
+	double frameTime = that->getFrameTime();
+	if (!settings::skipIdleFrames || !(frameTime - internal->lastFullRenderTime < IDLE_REDRAW_INTERVAL))
+		internal->dirty = true;
+	// Without scene framebuffers, the window's contents are undefined after swapping buffers, so draw everything
+	if (!internal->sceneFb || !internal->dirtyFb)
+		internal->dirty = true;
+
+	math::Rect windowRect = math::Rect(0, 0, width, height);
+	std::vector<math::Rect> rects;
+	if (!internal->dirty) {
+		float area = 0.f;
+		for (math::Rect rect : internal->dirtyRects) {
+			// Round outward to whole pixels
+			math::Vec a = rect.pos.mult(that->pixelRatio).floor();
+			math::Vec b = rect.getBottomRight().mult(that->pixelRatio).ceil();
+			rect = math::Rect::fromCorners(a, b).intersect(windowRect);
+			if (!(rect.size.x > 0.f && rect.size.y > 0.f))
+				continue;
+			rects.push_back(rect);
+			area += rect.size.area();
+		}
+		if (area > DIRTY_AREA_MAX * width * height)
+			internal->dirty = true;
+	}
+	internal->dirtyRects.clear();
+
+	bool full = internal->dirty;
+	internal->dirty = false;
+	if (full)
+		rects.assign(1, windowRect);
+	else if (rects.empty())
+		return false;
+	if (full)
+		internal->lastFullRenderTime = frameTime;
+
+	if (!internal->sceneFb || !internal->dirtyFb) {
+		// Draw directly to the window if framebuffers aren't available
+		Window_drawScene(that, NULL, width, height, rects);
+	}
+	else {
+		if (full) {
+			Window_drawScene(that, internal->sceneFb, width, height, rects);
+		}
+		else {
+			Window_drawScene(that, internal->dirtyFb, width, height, rects);
+			Window_copyFramebuffer(that, internal->dirtyFb, internal->sceneFb, width, height, rects);
+		}
+		Window_copyFramebuffer(that, internal->sceneFb, NULL, width, height, std::vector<math::Rect>{windowRect});
+	}
+
+	// Only full redraws draw every visible FramebufferWidget, so unused framebuffers can only be identified then
+	if (full)
+		widget::FramebufferWidget::evictUnused();
+	return true;
+}
+
+
 Window::Window() {
 	internal = new Internal;
 	int err;
@@ -384,6 +570,7 @@ Window::~Window() {
 	// Fonts and Images in the cache must be deleted before the NanoVG context is deleted
 	internal->fontCache.clear();
 	internal->imageCache.clear();
+	Window_deleteSceneFramebuffers(this);
 
 	// nvgDeleteClone(fbVg);
 
@@ -445,6 +632,9 @@ void Window::step() {
 	// In case glfwPollEvents() sets another OpenGL context
 	glfwMakeContextCurrent(win);
 
+	// Report failed background saves outside of Scene::step()
+	APP->patch->showSaveErrors();
+
 	// Call cursorPosCallback every frame, not just when the mouse moves
 	{
 		double xpos, ypos;
@@ -478,6 +668,7 @@ void Window::step() {
 	if (newPixelRatio != pixelRatio) {
 		pixelRatio = newPixelRatio;
 		APP->event->handleDirty();
+		setDirty();
 	}
 
 	// Get framebuffer/window ratio
@@ -488,6 +679,8 @@ void Window::step() {
 	windowRatio = (float)fbWidth / winWidth;
 	// t1 = system::getTime();
 
+	bool rendered = false;
+
 	if (APP->scene) {
 		// DEBUG("%f %f %d %d", pixelRatio, windowRatio, fbWidth, winWidth);
 		// Resize scene
@@ -500,26 +693,34 @@ void Window::step() {
 		// Render scene
 		bool visible = glfwGetWindowAttrib(win, GLFW_VISIBLE) && !glfwGetWindowAttrib(win, GLFW_ICONIFIED);
 		if (visible) {
-			// Update and render
-			nvgBeginFrame(vg, fbWidth, fbHeight, pixelRatio);
-			nvgScale(vg, pixelRatio, pixelRatio);
-
-			// Draw scene
-			widget::Widget::DrawArgs args;
-			args.vg = vg;
-			args.clipBox = APP->scene->box.zeroPos();
-			APP->scene->draw(args);
-			// t3 = system::getTime();
+			// Warm up framebuffers that didn't fit in previous frames
+			widget::FramebufferWidget::renderQueue();
 
-			glViewport(0, 0, fbWidth, fbHeight);
-			glClearColor(0.0, 0.0, 0.0, 1.0);
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-			nvgEndFrame(vg);
+			// Redraw dirty regions, or skip the frame if nothing changed
+			rendered = Window_render(this, fbWidth, fbHeight);
+			// t3 = system::getTime();
 		}
 		// t4 = system::getTime();
 	}
 
-	glfwSwapBuffers(win);
+	if (rendered)
+		glfwSwapBuffers(win);
+
+	// Count rendered and skipped frames each second
+	if (rendered)
+		internal->renderedFrames++;
+	else
+		internal->skippedFrames++;
+	if (!(frameTime - internal->frameRateTime < 1.0)) {
+		double duration = frameTime - internal->frameRateTime;
+		if (std::isfinite(duration)) {
+			internal->renderedFrameRate = internal->renderedFrames / duration;
+			internal->skippedFrameRate = internal->skippedFrames / duration;
+		}
+		internal->frameRateTime = frameTime;
+		internal->renderedFrames = 0;
+		internal->skippedFrames = 0;
+	}
 
 	// Limit frame rate
 	if (settings::frameRateLimit > 0) {
@@ -528,6 +729,12 @@ void Window::step() {
 			system::sleep(remaining);
 		}
 	}
+	else if (!rendered) {
+		// Skipped frames don't wait for vsync in glfwSwapBuffers(), so wait one monitor refresh instead
+		double refreshRate = getMonitorRefreshRate();
+		if (refreshRate > 0.0)
+			system::sleep(1.0 / refreshRate);
+	}
 
 	// t5 = system::getTime();
 	// DEBUG("pre-step %6.1f step %6.1f draw %6.1f nvgEndFrame %6.1f glfwSwapBuffers %6.1f total %6.1f",
@@ -542,6 +749,46 @@ void Window::step() {
 }
 
 
+void Window::benchmarkDraw(int frames) {
+	// Render as fast as possible
+	float frameRateLimit = settings::frameRateLimit;
+	settings::frameRateLimit = 0.f;
+	DEFER({settings::frameRateLimit = frameRateLimit;});
+
+	app::RackScrollWidget* rackScroll = APP->scene->rackScroll;
+	float oldZoom = rackScroll->getZoom();
+	math::Vec oldGridOffset = rackScroll->getGridOffset();
+
+	for (float zoom : {0.25f, 0.5f, 1.f, 2.f, 4.f}) {
+		// Center on the modules, so high zoom levels show a small part of the rack
+		rackScroll->zoomToModules();
+		rackScroll->setZoom(zoom);
+
+		// Let framebuffers render at the new zoom level before measuring
+		for (int i = 0; i < 10; i++) {
+			setDirty();
+			step();
+		}
+
+		double totalDuration = 0.0;
+		double maxDuration = 0.0;
+		for (int i = 0; i < frames; i++) {
+			// Measure full redraws, not skipped frames
+			setDirty();
+			double startTime = system::getTime();
+			step();
+			double duration = system::getTime() - startTime;
+			totalDuration += duration;
+			maxDuration = std::max(maxDuration, duration);
+		}
+		INFO("Zoom %g: mean frame %.3f ms, max frame %.3f ms", zoom, totalDuration / frames * 1e3, maxDuration * 1e3);
+	}
+
+	rackScroll->setZoom(oldZoom);
+	rackScroll->setGridOffset(oldGridOffset);
+}
+
+
 static void flipBitmap(uint8_t* pixels, int width, int height, int depth) {
 	for (int y = 0; y < height / 2; y++) {
 		int flipY = height - y - 1;
@@ -573,6 +820,37 @@ void Window::screenshot(const std::string& screenshotPath) {
 }
 
 
+/** Draws a ModuleWidget and its lights */
+struct ModuleWidgetContainer : widget::Widget {
+	void draw(const DrawArgs& args) override {
+		Widget::draw(args);
+		// Use the same light pass as RackWidget so screenshots show batched lights
+		app::beginLightBatch(args.vg);
+		Widget::drawLayer(args, 1);
+		app::endLightBatch(args.vg);
+	}
+};
+
+
+/** Creates a FramebufferWidget containing a ModuleWidget of the model without a Module, as shown in the Module Browser. */
+static widget::FramebufferWidget* createModuleFramebuffer(plugin::Model* model) {
+	widget::FramebufferWidget* fbw = new widget::FramebufferWidget;
+	fbw->oversample = 2;
+
+	ModuleWidgetContainer* mwc = new ModuleWidgetContainer;
+	fbw->addChild(mwc);
+
+	app::ModuleWidget* mw = model->createModuleWidget(NULL);
+	mwc->box.size = mw->box.size;
+	fbw->box.size = mw->box.size;
+	mwc->addChild(mw);
+
+	// Step to allow the ModuleWidget state to set its default appearance.
+	fbw->step();
+	return fbw;
+}
+
+
 void Window::screenshotModules(const std::string& screenshotsDir, float zoom) {
 	// Disable preferDarkPanels
 	bool preferDarkPanels = settings::preferDarkPanels;
@@ -584,6 +862,14 @@ void Window::screenshotModules(const std::string& screenshotsDir, float zoom) {
 	for (plugin::Plugin* p : plugin::plugins) {
 		std::string dir = system::join(screenshotsDir, p->slug);
 		system::createDirectory(dir);
+		// Load the plugin library first, since it replaces the plugin's models if it was deferred
+		try {
+			plugin::loadPluginLibrary(p);
+		}
+		catch (Exception& e) {
+			WARN("Cannot screenshot plugin %s: %s", p->slug.c_str(), e.what());
+			continue;
+		}
 		for (plugin::Model* model : p->models) {
 			std::string filename = system::join(dir, model->slug + ".png");
 
@@ -594,25 +880,7 @@ void Window::screenshotModules(const std::string& screenshotsDir, float zoom) {
 			INFO("Screenshotting %s %s to %s", p->slug.c_str(), model->slug.c_str(), filename.c_str());
 
 			// Create widgets
-			widget::FramebufferWidget* fbw = new widget::FramebufferWidget;
-			fbw->oversample = 2;
-
-			struct ModuleWidgetContainer : widget::Widget {
-				void draw(const DrawArgs& args) override {
-					Widget::draw(args);
-					Widget::drawLayer(args, 1);
-				}
-			};
-			ModuleWidgetContainer* mwc = new ModuleWidgetContainer;
-			fbw->addChild(mwc);
-
-			app::ModuleWidget* mw = model->createModuleWidget(NULL);
-			mwc->box.size = mw->box.size;
-			fbw->box.size = mw->box.size;
-			mwc->addChild(mw);
-
-			// Step to allow the ModuleWidget state to set its default appearance.
-			fbw->step();
+			widget::FramebufferWidget* fbw = createModuleFramebuffer(model);
 
 			// Draw to framebuffer
 			fbw->render(math::Vec(zoom, zoom));
@@ -637,6 +905,135 @@ void Window::screenshotModules(const std::string& screenshotsDir, float zoom) {
 }
 
 
+void Window::benchmarkPanels(int renders) {
+	DEFER({window::Svg::setDrawListsEnabled(true);});
+
+	double totalDurations[2] = {};
+	for (plugin::Plugin* p : plugin::plugins) {
+		try {
+			plugin::loadPluginLibrary(p);
+		}
+		catch (Exception& e) {
+			WARN("Cannot benchmark plugin %s: %s", p->slug.c_str(), e.what());
+			continue;
+		}
+		for (plugin::Model* model : p->models) {
+			widget::FramebufferWidget* fbw;
+			try {
+				fbw = createModuleFramebuffer(model);
+			}
+			catch (Exception& e) {
+				WARN("Cannot benchmark module %s: %s", model->getFullName().c_str(), e.what());
+				continue;
+			}
+			DEFER({delete fbw;});
+
+			// Re-render at alternating zoom levels, like zooming the rack does
+			double durations[2];
+			for (int cached = 0; cached < 2; cached++) {
+				window::Svg::setDrawListsEnabled(cached);
+				// The first render builds draw lists and framebuffers
+				fbw->render(math::Vec(1, 1));
+				glFinish();
+
+				double startTime = system::getTime();
+				for (int i = 0; i < renders; i++) {
+					float zoom = (i % 2 == 0) ? 2.f : 1.f;
+					fbw->render(math::Vec(zoom, zoom));
+				}
+				glFinish();
+				durations[cached] = (system::getTime() - startTime) / renders;
+				totalDurations[cached] += durations[cached];
+			}
+			INFO("Panel %s: %.3f ms uncached, %.3f ms cached", model->getFullName().c_str(), durations[0] * 1e3, durations[1] * 1e3);
+		}
+	}
+	INFO("All panels: %.3f ms uncached, %.3f ms cached", totalDurations[0] * 1e3, totalDurations[1] * 1e3);
+}
+
+
+void Window::benchmarkStep(int modules, int frames) {
+	DEFER({app::RackWidget::setOffscreenStepThrottling(true);});
+
+	std::vector<plugin::Model*> models;
+	for (plugin::Plugin* p : plugin::plugins) {
+		try {
+			plugin::loadPluginLibrary(p);
+		}
+		catch (Exception& e) {
+			WARN("Cannot benchmark plugin %s: %s", p->slug.c_str(), e.what());
+			continue;
+		}
+		for (plugin::Model* model : p->models) {
+			models.push_back(model);
+		}
+	}
+	if (models.empty()) {
+		WARN("No modules to benchmark");
+		return;
+	}
+
+	// Replace the patch with rows of modules, cycling through all models
+	APP->patch->clear();
+	DEFER({APP->patch->clear();});
+	math::Vec pos = app::RACK_OFFSET;
+	int count = 0;
+	for (int i = 0; i < modules; i++) {
+		plugin::Model* model = models[i % models.size()];
+		app::ModuleWidget* mw = NULL;
+		try {
+			engine::Module* module = model->createModule();
+			APP->engine->addModule(module);
+			mw = model->createModuleWidget(module);
+			if (pos.x + mw->box.size.x > app::RACK_OFFSET.x + app::RACK_GRID_WIDTH * 1000) {
+				pos.x = app::RACK_OFFSET.x;
+				pos.y += app::RACK_GRID_HEIGHT;
+			}
+			mw->box.pos = pos;
+			APP->scene->rack->addModule(mw);
+		}
+		catch (Exception& e) {
+			WARN("Cannot benchmark module %s: %s", model->getFullName().c_str(), e.what());
+			// Also removes and deletes the Module
+			delete mw;
+			continue;
+		}
+		pos.x += mw->box.size.x;
+		count++;
+	}
+
+	// Show part of the rack, like a user working on a large patch
+	app::RackScrollWidget* rackScroll = APP->scene->rackScroll;
+	rackScroll->zoomToModules();
+	rackScroll->setZoom(1.f);
+
+	for (int throttling = 0; throttling < 2; throttling++) {
+		app::RackWidget::setOffscreenStepThrottling(throttling);
+		// Let framebuffers render before measuring
+		for (int i = 0; i < 10; i++) {
+			setDirty();
+			step();
+		}
+
+		// Widget stepping alone
+		double startTime = system::getThreadTime();
+		for (int i = 0; i < frames; i++) {
+			APP->scene->step();
+		}
+		double stepDuration = system::getThreadTime() - startTime;
+
+		// Whole frames, including drawing
+		startTime = system::getThreadTime();
+		for (int i = 0; i < frames; i++) {
+			setDirty();
+			step();
+		}
+		double frameDuration = system::getThreadTime() - startTime;
+		INFO("%d modules, off-screen step throttling %s: mean scene step %.3f ms, mean frame %.3f ms CPU", count, throttling ? "on" : "off", stepDuration / frames * 1e3, frameDuration / frames * 1e3);
+	}
+}
+
+
 void Window::close() {
 	glfwSetWindowShouldClose(win, GLFW_TRUE);
 }
@@ -746,6 +1143,45 @@ double Window::getFrameDurationRemaining() {
 }
 
 
+double Window::getRenderedFrameRate() {
+	return internal->renderedFrameRate;
+}
+
+
+double Window::getSkippedFrameRate() {
+	return internal->skippedFrameRate;
+}
+
+
+void Window::setDirty() {
+	internal->dirty = true;
+}
+
+
+void Window::setDirtyRect(widget::Widget* w, math::Rect rect) {
+	if (internal->dirty)
+		return;
+	math::Vec a = w->getAbsoluteOffset(rect.pos);
+	math::Vec b = w->getAbsoluteOffset(rect.getBottomRight());
+	if (!a.isFinite() || !b.isFinite()) {
+		internal->dirty = true;
+		return;
+	}
+	// Clip to the scene rather than the widget's ancestors, since light halos are drawn outside their widget and module
+	rect = math::Rect::fromCorners(a, b).intersect(APP->scene->box);
+	if (!(rect.size.x > 0.f && rect.size.y > 0.f))
+		return;
+
+	if (internal->dirtyRects.size() >= DIRTY_RECTS_MAX) {
+		for (const math::Rect& dirtyRect : internal->dirtyRects) {
+			rect = rect.expand(dirtyRect);
+		}
+		internal->dirtyRects.clear();
+	}
+	internal->dirtyRects.push_back(rect);
+}
+
+
 std::shared_ptr<Font> Window::loadFont(const std::string& filename) {
 	const auto& pair = internal->fontCache.find(filename);
 	if (pair != internal->fontCache.end())